@@ -5,8 +5,67 @@ in vec2 f_texcoord;
 
 #define _PI_ 3.14159
 
-uniform vec3 uniform_camera_pos;
-uniform vec3 uniform_camera_dir;
+#define MAX_LIGHTS 256
+#define MAX_SHADOW_LIGHTS 16
+
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+
+struct Light
+{
+	vec4 color;
+	vec4 position;
+	vec4 direction;
+	// cosine of the half umbra and half penumbra, shadow map or -1, range of the clusters
+	vec4 cone;
+};
+
+layout(std140) uniform FrameData
+{
+	vec4 camera_pos;
+	vec4 camera_dir;
+	// lights, shadow maps
+	ivec4 light_count;
+	mat4 view;
+	// the world position of a pixel from its depth in the compact G-buffer
+	mat4 inverse_projection_view;
+	// clusters per pixel in x and y, slices per log of the view depth, near plane
+	vec4 clusters;
+} frame;
+
+layout(std140) uniform LightData
+{
+	Light lights[MAX_LIGHTS];
+};
+
+layout(std140) uniform ShadowData
+{
+	mat4 light_projection_view[MAX_SHADOW_LIGHTS];
+	// the tile of every shadow map in the atlas, offset and size in texture coordinates
+	vec4 atlas_rect[MAX_SHADOW_LIGHTS];
+};
+
+// the light of this pass, -1 shades every light in one pass, -2 the lights of the cluster
+uniform int uniform_light_index;
+
+// (offset, count) of every cluster and the light indices they point to
+uniform usamplerBuffer uniform_cluster_grid;
+uniform usamplerBuffer uniform_cluster_lights;
+
+// the view depths the light of a single light pass can reach
+uniform vec2 uniform_light_depth_range;
+
+// position from the depth, octahedral normal in RG16, albedo and mask in RGBA8
+uniform bool uniform_compact_gbuffer;
+
+vec3 octahedral_decode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
 
 uniform sampler2D uniform_tex_pos;
 uniform sampler2D uniform_tex_normal;
@@ -14,25 +73,29 @@ uniform sampler2D uniform_tex_albedo;
 uniform sampler2D uniform_tex_mask;
 uniform sampler2D uniform_tex_depth;
 
-uniform vec3 uniform_light_color;
-uniform vec3 uniform_light_pos;
-uniform vec3 uniform_light_dir;
+uniform float uniform_constant_bias = 0.0002;
 
-uniform float uniform_light_umbra;
-uniform float uniform_light_penumbra;
+uniform sampler2D uniform_shadow_atlas;
 
-uniform mat4 uniform_light_projection_view;
-uniform int uniform_cast_shadows;
-uniform float uniform_constant_bias = 0.0002;
+// pUV is in the tile of the map, the samples stay half a texel inside it
+float shadow_map_depth(const in int pMap, const in vec2 pUV)
+{
+	vec4 rect = atlas_rect[pMap];
+	vec2 half_texel = 0.5 / (rect.zw * vec2(textureSize(uniform_shadow_atlas, 0)));
+	return texture(uniform_shadow_atlas, rect.xy + clamp(pUV, half_texel, 1.0 - half_texel) * rect.zw).r;
+}
 
-uniform sampler2D uniform_shadow_map;
+ivec2 shadow_map_size(const in int pMap)
+{
+	return ivec2(atlas_rect[pMap].zw * vec2(textureSize(uniform_shadow_atlas, 0)) + 0.5);
+}
 
-float compute_spotlight(const in vec3 pSurfToLight)
+float compute_spotlight(const in Light pLight, const in vec3 pSurfToLight)
 {
-	float cos_umbra = cos(radians(0.5 * uniform_light_umbra));
-	float cos_penumbra = cos(radians(0.5 * uniform_light_penumbra));
+	float cos_umbra = pLight.cone.x;
+	float cos_penumbra = pLight.cone.y;
 	float spoteffect = 1;
-	float angle_vertex_spot_dir = dot(-pSurfToLight, uniform_light_dir);
+	float angle_vertex_spot_dir = dot(-pSurfToLight, pLight.direction.xyz);
 
 	if (angle_vertex_spot_dir > cos_umbra) 
 	{
@@ -50,11 +113,11 @@ float compute_spotlight(const in vec3 pSurfToLight)
 	return spoteffect;
 }
 
-float shadow_pcf2x2_weighted(vec3 light_space_xyz)
+float shadow_pcf2x2_weighted(const in int pMap, vec3 light_space_xyz)
 {
-	ivec2 shadow_map_size = textureSize(uniform_shadow_map, 0);
-	float xOffset = 1.0 / shadow_map_size.x;
-    float yOffset = 1.0 / shadow_map_size.y;
+	ivec2 map_size = shadow_map_size(pMap);
+	float xOffset = 1.0 / map_size.x;
+    float yOffset = 1.0 / map_size.y;
 
 	// compute the weights of the neighboring pixels
 	vec2 uv = light_space_xyz.xy - vec2(xOffset, yOffset);
@@ -67,20 +130,20 @@ float shadow_pcf2x2_weighted(vec3 light_space_xyz)
 	float z = light_space_xyz.z - uniform_constant_bias;
 
 	// compute the shadow percentage
-	float bottomLeft = (texture(uniform_shadow_map, uv).r > z) ? u_opposite : 0.0;
-	float bottomRight = (texture(uniform_shadow_map, uv + vec2(xOffset, 0)).r > z) ? u_ratio : 0.0; 
-	float topLeft = (texture(uniform_shadow_map, uv + vec2(0, yOffset), 0).r > z) ? u_opposite : 0.0;
-	float topRight = texture(uniform_shadow_map, uv + vec2(xOffset, yOffset)).r > z ? u_ratio : 0.0;
+	float bottomLeft = (shadow_map_depth(pMap, uv) > z) ? u_opposite : 0.0;
+	float bottomRight = (shadow_map_depth(pMap, uv + vec2(xOffset, 0)) > z) ? u_ratio : 0.0; 
+	float topLeft = (shadow_map_depth(pMap, uv + vec2(0, yOffset)) > z) ? u_opposite : 0.0;
+	float topRight = shadow_map_depth(pMap, uv + vec2(xOffset, yOffset)) > z ? u_ratio : 0.0;
 	float factor = (bottomLeft + bottomRight) * v_opposite + (topLeft + topRight) * v_ratio;
 
     return factor;
 }
 
-float shadow_pcf2x2_mean(vec3 light_space_xyz)
+float shadow_pcf2x2_mean(const in int pMap, vec3 light_space_xyz)
 {
-	ivec2 shadow_map_size = textureSize(uniform_shadow_map, 0);
-	float xOffset = 1.0 / shadow_map_size.x;
-    float yOffset = 1.0 / shadow_map_size.y;
+	ivec2 map_size = shadow_map_size(pMap);
+	float xOffset = 1.0 / map_size.x;
+    float yOffset = 1.0 / map_size.y;
 	vec2 texelSize = vec2(xOffset, yOffset);
 
 	vec2 uv_bl = light_space_xyz.xy + vec2(-1.0, -1.0) * texelSize;
@@ -91,19 +154,19 @@ float shadow_pcf2x2_mean(vec3 light_space_xyz)
 	float z = light_space_xyz.z - uniform_constant_bias;
 
 	// compute the shadow percentage
-	float bottomLeft = (texture(uniform_shadow_map, uv_bl).r > z) ? 1.0 : 0.0;
-	float bottomRight = (texture(uniform_shadow_map, uv_br).r > z) ? 1.0 : 0.0;
-	float topLeft = (texture(uniform_shadow_map, uv_tl).r > z) ? 1.0 : 0.0;
-	float topRight = texture(uniform_shadow_map, uv_tr).r > z ? 1.0 : 0.0;
+	float bottomLeft = (shadow_map_depth(pMap, uv_bl) > z) ? 1.0 : 0.0;
+	float bottomRight = (shadow_map_depth(pMap, uv_br) > z) ? 1.0 : 0.0;
+	float topLeft = (shadow_map_depth(pMap, uv_tl) > z) ? 1.0 : 0.0;
+	float topRight = shadow_map_depth(pMap, uv_tr) > z ? 1.0 : 0.0;
 	float factor = (bottomLeft + bottomRight + topLeft + topRight) / 4.0;
 
     return factor;
 }
 
-float shadow_nearest(vec3 light_space_xyz)
+float shadow_nearest(const in int pMap, vec3 light_space_xyz)
 {
 	// sample shadow map
-	float shadow_map_z = texture2D(uniform_shadow_map, light_space_xyz.xy).r;
+	float shadow_map_z = shadow_map_depth(pMap, light_space_xyz.xy);
 
 	// + shaded -> 0.0 
 	// - lit -> 1.0
@@ -112,10 +175,10 @@ float shadow_nearest(vec3 light_space_xyz)
 }
 
 // 1 sample per pixel
-float shadow(vec3 pwcs)
+float shadow(const in int pMap, vec3 pwcs)
 {
 	// project the pwcs to the light source point of view
-	vec4 plcs = uniform_light_projection_view * vec4(pwcs, 1.0);
+	vec4 plcs = light_projection_view[pMap] * vec4(pwcs, 1.0);
 	// perspective division
 	plcs /= plcs.w;
 	// convert from [-1 1] to [0 1]
@@ -131,9 +194,9 @@ float shadow(vec3 pwcs)
 	plcs.z = 0.5 * plcs.z + 0.5;
 
 	// sample shadow map
-	//return shadow_nearest(plcs.xyz);
-	//return shadow_pcf2x2_weighted(plcs.xyz);
-	return shadow_pcf2x2_mean(plcs.xyz);
+	//return shadow_nearest(pMap, plcs.xyz);
+	//return shadow_pcf2x2_weighted(pMap, plcs.xyz);
+	return shadow_pcf2x2_mean(pMap, plcs.xyz);
 }
 
 vec3 fresnel(
@@ -165,6 +228,7 @@ float geometric(float NH, float NO, float HO, float NI)
 }
 
 vec3 blinn_phong(
+	const in Light pLight,
 	const in vec3 pSurfToEye,
 	const in vec3 pSurfToLight,
 	const in vec3 pPos,
@@ -191,12 +255,13 @@ vec3 blinn_phong(
 	vec3 ks = NdotL > 0.0 ? reflectance * fn * pow(NdotH, alpha) : vec3(0.0);
 	ks *= F;
 
-	float dist = distance(uniform_light_pos, pPos);
+	float dist = distance(pLight.position.xyz, pPos);
 
-	return (kd + ks) * (uniform_light_color / pow(dist, 2)) * NdotL;
+	return (kd + ks) * (pLight.color.rgb / pow(dist, 2)) * NdotL;
 }
 
 vec3 cook_torrance(
+	const in Light pLight,
 	const in vec3 pSurfToEye,
 	const in vec3 pSurfToLight,
 	const in vec3 pPos,
@@ -222,9 +287,43 @@ vec3 cook_torrance(
 	float G = geometric(NdotH, NdotV, HdotV, NdotL);
 	vec3 ks = (F * G * D) / max((4.0 * NdotL * NdotV), 0.0001);
 	vec3 kd = ((ao * pAlbedo) / _PI_) * (1.0 - F) * (1.0 - metallic);
-	float dist = distance(uniform_light_pos, pPos);
+	float dist = distance(pLight.position.xyz, pPos);
+
+	return (kd + ks) * (pLight.color.rgb / pow(dist, 2)) * NdotL;
+}
+
+vec3 shade(
+	const in int pIndex,
+	const in vec3 pSurfToEye,
+	const in vec3 pPos,
+	const in vec3 pNormal,
+	const in vec3 pAlbedo,
+	const in vec4 pMask)
+{
+	Light light = lights[pIndex];
+	// every mode cuts the light at the range of the clusters and the scissor rectangles
+	if (distance(light.position.xyz, pPos) > light.cone.w) return vec3(0.0);
+
+	vec3 surfToLight = normalize(light.position.xyz - pPos);
+
+	float spotEffect = compute_spotlight(light, surfToLight);
+	if (spotEffect == 0.0) return vec3(0.0);
+
+	// check if we have shadows
+	int shadow_map = int(light.cone.z);
+	float shadow_value = (shadow_map >= 0) ? shadow(shadow_map, pPos) : 1.0;
+
+#if 0
+	vec3 brdf = blinn_phong(light, pSurfToEye, surfToLight, pPos,
+		pNormal,
+		pAlbedo, pMask);
+#else
+	vec3 brdf = cook_torrance(light, pSurfToEye, surfToLight, pPos,
+		pNormal,
+		pAlbedo, pMask);
+#endif
 
-	return (kd + ks) * (uniform_light_color / pow(dist, 2)) * NdotL;
+	return shadow_value * brdf * spotEffect;
 }
 
 void main(void)
@@ -233,28 +332,56 @@ void main(void)
 
 	if(d == 1.0) discard;
 
-	vec4 pos_wcs = texture(uniform_tex_pos, f_texcoord);
+	vec4 pos_wcs;
+	if (uniform_compact_gbuffer)
+	{
+		pos_wcs = frame.inverse_projection_view * vec4(vec3(f_texcoord, d) * 2.0 - 1.0, 1.0);
+		pos_wcs /= pos_wcs.w;
+	}
+	else
+	{
+		pos_wcs = texture(uniform_tex_pos, f_texcoord);
+	}
+
+	// the pass of one light rejects the pixels out of its depths before reading the rest
+	if (uniform_light_index >= 0)
+	{
+		float depth = -(frame.view * vec4(pos_wcs.xyz, 1.0)).z;
+		if (depth < uniform_light_depth_range.x || depth > uniform_light_depth_range.y) discard;
+	}
+
+	// the G-buffer is read once for every light of the pass
 	vec4 normal_wcs = texture(uniform_tex_normal, f_texcoord);
+	if (uniform_compact_gbuffer)
+		normal_wcs = vec4(octahedral_decode(normal_wcs.xy * 2.0 - 1.0), 0.0);
 	vec4 albedo = texture(uniform_tex_albedo, f_texcoord);
 	vec4 mask = texture(uniform_tex_mask, f_texcoord);
 
-	vec3 surfToEye = normalize(uniform_camera_pos - pos_wcs.xyz);
-	vec3 surfToLight = normalize(uniform_light_pos - pos_wcs.xyz);
+	vec3 surfToEye = normalize(frame.camera_pos.xyz - pos_wcs.xyz);
 
-	// check if we have shadows
-	float shadow_value = (uniform_cast_shadows == 1) ? shadow(pos_wcs.xyz) : 1.0;
-
-	float spotEffect = compute_spotlight(surfToLight);
+	vec3 color = vec3(0.0);
+	if (uniform_light_index == -2)
+	{
+		// the froxel of the pixel, the slices are exponential in the view depth
+		float depth = -(frame.view * vec4(pos_wcs.xyz, 1.0)).z;
+		ivec3 cluster = ivec3(gl_FragCoord.xy * frame.clusters.xy, log(max(depth, frame.clusters.w) / frame.clusters.w) * frame.clusters.z);
+		cluster = clamp(cluster, ivec3(0), ivec3(CLUSTERS_X - 1, CLUSTERS_Y - 1, CLUSTERS_Z - 1));
+
+		uvec2 list = texelFetch(uniform_cluster_grid, cluster.x + CLUSTERS_X * (cluster.y + CLUSTERS_Y * cluster.z)).rg;
+		for (uint n = 0u; n < list.y; n++)
+		{
+			int i = int(texelFetch(uniform_cluster_lights, int(list.x + n)).r);
+			color += shade(i, surfToEye, pos_wcs.xyz, normal_wcs.xyz, albedo.xyz, mask);
+		}
+	}
+	else
+	{
+		int first = uniform_light_index < 0 ? 0 : uniform_light_index;
+		int last = uniform_light_index < 0 ? frame.light_count.x : uniform_light_index + 1;
 
-#if 0
-	vec3 brdf = blinn_phong(surfToEye, surfToLight, pos_wcs.xyz,
-		normal_wcs.xyz,
-		albedo.xyz, mask);
-#else
-	vec3 brdf = cook_torrance(surfToEye, surfToLight, pos_wcs.xyz,
-		normal_wcs.xyz,
-		albedo.xyz, mask);
-#endif
+		for (int i = first; i < last; i++)
+			color += shade(i, surfToEye, pos_wcs.xyz, normal_wcs.xyz, albedo.xyz, mask);
+	}
 
-	out_color = vec4(shadow_value * brdf * spotEffect, 1.0);
+	out_color = vec4(color, 1.0);
 }
\ No newline at end of file
@@ -7,48 +7,77 @@ layout(location = 3) out vec4 out_mask;
 in vec2 f_texcoord;
 in vec3 f_position_wcs;
 in mat3 f_TBN;
+flat in int f_material;
 
 #define _PI_ 3.14159
+#define MAX_DRAW_MATERIALS 128
 
-uniform vec3 uniform_diffuse;
-uniform vec3 uniform_specular;
-uniform vec3 uniform_ambient;
-uniform float uniform_shininess;
-uniform float uniform_metallic;
+struct Material
+{
+	vec4 diffuse;
+	vec4 ambient;
+	vec4 specular;
+	// shininess, metallic
+	vec4 params;
+	// has diffuse, emissive, mask and normal texture
+	ivec4 textures;
+};
+
+// the material of the part of a single draw
+layout(std140) uniform MaterialData
+{
+	Material part_material;
+};
 
-uniform int uniform_has_tex_diffuse;
-uniform int uniform_has_tex_mask;
-uniform int uniform_has_tex_normal;
-uniform int uniform_has_tex_emissive;
+// the materials of the frame, a multi-draw reads the one of its instance
+layout(std140) uniform DrawMaterialData
+{
+	Material draw_materials[MAX_DRAW_MATERIALS];
+};
+
+uniform bool uniform_draw_materials;
 
 uniform sampler2D uniform_tex_diffuse;
 uniform sampler2D uniform_tex_mask;
 uniform sampler2D uniform_tex_normal;
 uniform sampler2D uniform_tex_emissive;
 
+// position from the depth, octahedral normal in RG16, albedo and mask in RGBA8
+uniform bool uniform_compact_gbuffer;
+
+// the unit sphere folded onto the [-1 1] square
+vec2 octahedral_encode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.z >= 0.0 ? n.xy : folded;
+}
+
 void main(void)
 {
+	Material material = uniform_draw_materials ? draw_materials[f_material] : part_material;
 	vec3 normal = f_TBN[2];
 
-	if(uniform_has_tex_normal == 1)
+	if(material.textures.w == 1)
 	{
-		vec3 nmap = texture(uniform_tex_normal, f_texcoord).rgb;
-		nmap = nmap * 2.0 - 1.0;
+		// only x and y are read, the compressed normal maps (BC5) have no third channel
+		vec3 nmap = vec3(texture(uniform_tex_normal, f_texcoord).rg * 2.0 - 1.0, 0.0);
+		nmap.z = sqrt(max(0.0, 1.0 - dot(nmap.xy, nmap.xy)));
 		normal = normalize(f_TBN * nmap);
 	}
 
-	vec3 albedo = uniform_has_tex_diffuse == 1 ?
-		texture(uniform_tex_diffuse, f_texcoord).rgb : uniform_diffuse;
+	vec3 albedo = material.textures.x == 1 ?
+		texture(uniform_tex_diffuse, f_texcoord).rgb : material.diffuse.rgb;
 
-	vec3 emission = uniform_has_tex_emissive == 1 ?
-		texture(uniform_tex_emissive, f_texcoord).rgb : uniform_ambient;
+	vec3 emission = material.textures.y == 1 ?
+		texture(uniform_tex_emissive, f_texcoord).rgb : material.ambient.rgb;
 
-	float reflectance = (uniform_specular.x + uniform_specular.y + uniform_specular.z) / 3;
-	float gloss = 1.0 - (uniform_shininess / 127);
-	float metallic =  uniform_has_tex_mask == 1 ? 0.0 : uniform_metallic;
-	float ao = uniform_has_tex_mask == 1 ? 0.0 : 1.0;
+	float reflectance = (material.specular.x + material.specular.y + material.specular.z) / 3;
+	float gloss = 1.0 - (material.params.x / 127);
+	float metallic =  material.textures.z == 1 ? 0.0 : material.params.y;
+	float ao = material.textures.z == 1 ? 0.0 : 1.0;
 
-	if(uniform_has_tex_mask == 1)
+	if(material.textures.z == 1)
 	{
 		vec4 mask = texture(uniform_tex_mask, f_texcoord);
 		metallic = mask.r;
@@ -57,8 +86,18 @@ void main(void)
 		gloss = 1.0 - mask.a;
 	}
 
-	out_pos = vec4(f_position_wcs, emission.x);
-	out_normal = vec4(normal, emission.y);
-	out_albedo = vec4(albedo, emission.z);
+	if (uniform_compact_gbuffer)
+	{
+		// the deferred pass does not read the emission, the compact layout drops it
+		out_pos = vec4(0.0);
+		out_normal = vec4(octahedral_encode(normal) * 0.5 + 0.5, 0.0, 0.0);
+		out_albedo = vec4(albedo, 0.0);
+	}
+	else
+	{
+		out_pos = vec4(f_position_wcs, emission.x);
+		out_normal = vec4(normal, emission.y);
+		out_albedo = vec4(albedo, emission.z);
+	}
 	out_mask = vec4(metallic, ao, reflectance, gloss);
 }
\ No newline at end of file
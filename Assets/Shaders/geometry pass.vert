@@ -4,23 +4,29 @@ layout(location = 1) in vec3 v_normal;
 layout(location = 2) in vec2 texcoord;
 layout(location = 3) in vec3 v_tangent;
 layout(location = 4) in vec3 v_bitangent;
+// the world matrix of the instance and its inverse transpose
+layout(location = 5) in mat4 instance_world;
+layout(location = 9) in mat4 instance_normal;
+// the material of the instance in a multi-draw
+layout(location = 13) in int instance_material;
 
 out vec2 v_texcoord;
 out vec3 v_position_wcs;
 out mat3 v_TBN;
+flat out int v_material;
 
+// projection * view
 uniform mat4 uniform_projection_matrix;
-uniform mat4 uniform_normal_matrix;
-uniform mat4 uniform_world_matrix;
 
 void main(void)
 {
 	v_TBN = mat3(
-		normalize(vec3(uniform_normal_matrix * vec4(v_tangent, 0.0))),
-		normalize(vec3(uniform_normal_matrix * vec4(v_bitangent, 0.0))),
-		normalize(vec3(uniform_normal_matrix * vec4(v_normal, 0.0))));
+		normalize(vec3(instance_normal * vec4(v_tangent, 0.0))),
+		normalize(vec3(instance_normal * vec4(v_bitangent, 0.0))),
+		normalize(vec3(instance_normal * vec4(v_normal, 0.0))));
 
 	v_texcoord = texcoord;
-	v_position_wcs = vec3(uniform_world_matrix * vec4(coord3d, 1.0));
-	gl_Position = uniform_projection_matrix * vec4(coord3d, 1.0);
+	v_material = instance_material;
+	v_position_wcs = vec3(instance_world * vec4(coord3d, 1.0));
+	gl_Position = uniform_projection_matrix * vec4(v_position_wcs, 1.0);
 }
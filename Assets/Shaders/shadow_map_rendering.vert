@@ -1,9 +1,12 @@
 #version 330 core
 layout(location = 0) in vec3 coord3d;
+// the world matrix of the instance
+layout(location = 5) in mat4 instance_world;
 
+// projection * view of the light
 uniform mat4 uniform_projection_matrix;
 
 void main(void) 
 {
-	gl_Position = uniform_projection_matrix * vec4(coord3d, 1.0);
+	gl_Position = uniform_projection_matrix * instance_world * vec4(coord3d, 1.0);
 }
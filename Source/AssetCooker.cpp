@@ -0,0 +1,233 @@
+#define SDL_MAIN_HANDLED
+#include "PackFile.h"
+#include "LZ4.h"
+#include "Tools.h"
+#include "OBJLoader.h"
+#include "GeometricMesh.h"
+#include "TextureCompressor.h"
+#include "SDL2/SDL_image.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Offline cooker of the game assets into a single .pak archive
+//   AssetCooker [--lz4] [output.pak] [folder ...]
+// without arguments it cooks Assets/Dungeon and Assets/Shaders into Assets/Assets.pak
+// run it from the folder the game runs from, the entries are named by the paths the game opens
+// the archive only depends on the contents of the files, so cooking twice gives the same bytes
+// every .png also gets the .dds of its blocks, so a game reading the archive never encodes a texture
+
+namespace
+{
+	struct CookedFile
+	{
+		std::string name;
+		std::vector<char> data;
+	};
+
+	const char* cooked_extensions[] = { ".obj", ".mtl", ".png", ".vert", ".frag", ".geom" };
+
+	bool read_file(const std::string& filename, std::vector<char>& data)
+	{
+		Tools::MappedFile file;
+		if (!file.Open(filename.c_str()))
+			return false;
+		data.assign(file.Data(), file.Data() + file.Size());
+		return true;
+	}
+
+	// the padding is always zero
+	void align(std::vector<char>& archive)
+	{
+		size_t aligned = (size_t)((archive.size() + PackFile::Alignment - 1) / PackFile::Alignment * PackFile::Alignment);
+		archive.resize(aligned, 0);
+	}
+
+	// the parsed mesh of an OBJ, so the game never parses a cooked OBJ
+	bool cook_mesh(OBJLoader& loader, const std::string& filename, const std::vector<char>& text, CookedFile& cooked)
+	{
+		const char* data = text.empty() ? "" : text.data();
+		uint64_t hash = OBJLoader::contentHash(filename.c_str(), data, text.size());
+		GeometricMesh* mesh = loader.load(filename.c_str(), data, text.size(), hash);
+		if (mesh == nullptr)
+			return false;
+
+		cooked.name = PackFile::NormalizeName(OBJLoader::binaryFilename(filename.c_str()));
+		bool serialized = loader.serializeBinary(filename.c_str(), hash, mesh, false, cooked.data);
+		delete mesh;
+		return serialized;
+	}
+
+	// the blocks of an image as TextureManager would encode them, from the rows flipped the same way
+	bool cook_texture(const std::string& filename, const std::vector<char>& image, CookedFile& cooked)
+	{
+		SDL_Surface* surface = IMG_Load_RW(SDL_RWFromConstMem(image.data(), (int)image.size()), 1);
+		if (surface == nullptr)
+			return false;
+
+		const int bytes = surface->format->BytesPerPixel;
+		const bool swap_rb = (surface->format->Rmask != 0x000000ff);
+		if (bytes != 3 && bytes != 4)
+		{
+			SDL_FreeSurface(surface);
+			return false;
+		}
+
+		SDL_LockSurface(surface);
+		unsigned char* pixels = static_cast<unsigned char*>(surface->pixels);
+		const int row_bytes = surface->w * bytes;
+		for (int y = 0; y < surface->h / 2; y++)
+		{
+			unsigned char* top = pixels + (size_t)y * surface->pitch;
+			unsigned char* bottom = pixels + (size_t)(surface->h - y - 1) * surface->pitch;
+			std::swap_ranges(top, top + row_bytes, bottom);
+		}
+
+		TextureCompressor::Format format = TextureCompressor::ChooseFormat(filename.c_str(), pixels, surface->w, surface->h, surface->pitch, bytes);
+		TextureCompressor::CompressedTexture texture;
+		bool compressed = TextureCompressor::Compress(pixels, surface->w, surface->h, surface->pitch, bytes, swap_rb, format, texture);
+		SDL_UnlockSurface(surface);
+		SDL_FreeSurface(surface);
+		if (!compressed)
+			return false;
+
+		cooked.name = PackFile::NormalizeName(TextureCompressor::CacheFilename(filename.c_str()));
+		TextureCompressor::SerializeCache(texture, nullptr, cooked.data);
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool compress = false;
+	std::vector<std::string> arguments;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--lz4") == 0) compress = true;
+		else arguments.push_back(argv[i]);
+	}
+
+	std::string output = arguments.empty() ? "Assets/Assets.pak" : arguments[0];
+	std::vector<std::string> folders;
+	if (arguments.size() > 1) folders.assign(arguments.begin() + 1, arguments.end());
+	else folders = { "Assets/Dungeon", "Assets/Shaders" };
+
+	OBJLoader loader;
+	loader.setBinaryCache(false);
+
+	std::vector<CookedFile> files;
+	for (auto& folder : folders)
+	{
+		for (const char* extension : cooked_extensions)
+		{
+			for (auto& filename : Tools::ListFiles(folder.c_str(), extension, true))
+			{
+				CookedFile cooked;
+				cooked.name = PackFile::NormalizeName(filename);
+				if (!read_file(filename, cooked.data))
+				{
+					printf("AssetCooker: could not read %s\n", filename.c_str());
+					return EXIT_FAILURE;
+				}
+
+				if (strcmp(extension, ".obj") == 0)
+				{
+					CookedFile mesh;
+					if (!cook_mesh(loader, filename, cooked.data, mesh))
+					{
+						printf("AssetCooker: could not cook %s\n", filename.c_str());
+						return EXIT_FAILURE;
+					}
+					files.push_back(std::move(mesh));
+				}
+				else if (strcmp(extension, ".png") == 0)
+				{
+					// the game decodes the images that cannot be encoded, as it does for loose files
+					CookedFile blocks;
+					if (cook_texture(filename, cooked.data, blocks))
+						files.push_back(std::move(blocks));
+					else
+						printf("AssetCooker: kept %s without blocks\n", filename.c_str());
+				}
+				files.push_back(std::move(cooked));
+			}
+		}
+	}
+
+	// the table of contents is sorted by name, a file listed by two folders is cooked once
+	std::sort(files.begin(), files.end(), [](const CookedFile& a, const CookedFile& b) { return a.name < b.name; });
+	files.erase(std::unique(files.begin(), files.end(), [](const CookedFile& a, const CookedFile& b) { return a.name == b.name; }), files.end());
+
+	std::vector<char> archive(sizeof(PackFile::Header), 0);
+	std::vector<PackFile::Entry> entries;
+	std::string names;
+	std::vector<char> compressed;
+	uint64_t total_size = 0;
+
+	printf("\n%-56s %10s %10s %s\n", "entry", "KB", "stored KB", "hash");
+	for (auto& file : files)
+	{
+		align(archive);
+
+		PackFile::Entry entry = {};
+		entry.offset = archive.size();
+		entry.size = file.data.size();
+		entry.hash = Tools::HashBytes(file.data.data(), file.data.size());
+		entry.name_offset = (uint32_t)names.size();
+		entry.name_length = (uint32_t)file.name.size();
+		names += file.name;
+
+		// compressed only when it saves at least an eighth, the png files are already compressed
+		size_t compressed_size = 0;
+		if (compress && !file.data.empty())
+		{
+			compressed.resize(LZ4::CompressBound(file.data.size()));
+			compressed_size = LZ4::Compress(file.data.data(), file.data.size(), compressed.data(), compressed.size());
+		}
+
+		if (compressed_size > 0 && compressed_size < file.data.size() - file.data.size() / 8)
+		{
+			entry.flags = PackFile::COMPRESSED_LZ4;
+			entry.stored_size = compressed_size;
+			archive.insert(archive.end(), compressed.begin(), compressed.begin() + compressed_size);
+		}
+		else
+		{
+			entry.stored_size = file.data.size();
+			archive.insert(archive.end(), file.data.begin(), file.data.end());
+		}
+
+		entries.push_back(entry);
+		total_size += entry.size;
+		printf("%-56s %10.1f %10.1f %016llx\n", file.name.c_str(), entry.size / 1024.0, entry.stored_size / 1024.0, (unsigned long long)entry.hash);
+	}
+
+	PackFile::Header header = {};
+	memcpy(header.magic, PackFile::Magic, sizeof(PackFile::Magic));
+	header.version = PackFile::Version;
+	header.entry_count = (uint32_t)entries.size();
+
+	align(archive);
+	header.toc_offset = archive.size();
+	const char* toc = reinterpret_cast<const char*>(entries.data());
+	archive.insert(archive.end(), toc, toc + entries.size() * sizeof(PackFile::Entry));
+
+	header.names_offset = archive.size();
+	header.names_size = names.size();
+	archive.insert(archive.end(), names.begin(), names.end());
+
+	memcpy(archive.data(), &header, sizeof(header));
+
+	if (!Tools::WriteFileAtomic(output.c_str(), archive.data(), archive.size()))
+	{
+		printf("AssetCooker: could not write %s\n", output.c_str());
+		return EXIT_FAILURE;
+	}
+
+	printf("\n%s: %zu files, %.1f MB of data in %.1f MB\n", output.c_str(), entries.size(),
+		total_size / (1024.0 * 1024.0), archive.size() / (1024.0 * 1024.0));
+	return EXIT_SUCCESS;
+}
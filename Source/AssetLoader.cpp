@@ -0,0 +1,205 @@
+#include "AssetLoader.h"
+#include "MeshCache.h"
+#include "GeometryNode.h"
+#include "GeometricMesh.h"
+#include <algorithm>
+
+AssetLoader::AssetLoader()
+{
+	statistics = Statistics();
+	loading = false;
+
+	// the singletons the jobs use have to outlive this one
+	JobSystem::GetInstance();
+	MeshCache::GetInstance();
+	TextureManager::GetInstance();
+}
+
+AssetLoader::~AssetLoader()
+{
+	// the jobs still running write into this loader
+	JobSystem::GetInstance().Wait(jobs);
+}
+
+void AssetLoader::RequestMesh(const std::string& filename, GeometryNode* node)
+{
+	std::string path = filename;
+	std::replace(path.begin(), path.end(), '\\', '/');
+
+	auto resident = residentMeshes.find(path);
+	if (resident != residentMeshes.end())
+	{
+		attach_mesh(node, resident->second);
+		return;
+	}
+
+	auto& users = meshUsers[path];
+	users.push_back(node);
+	if (users.size() > 1)
+		return;
+
+	if (!loading)
+	{
+		loading = true;
+		start = std::chrono::steady_clock::now();
+	}
+	statistics.meshes_requested++;
+	JobSystem::GetInstance().Run(jobs, [this, path]() { load_mesh(path); });
+}
+
+void AssetLoader::load_mesh(const std::string& filename)
+{
+	LoadedAsset asset;
+	asset.texture = false;
+	asset.filename = filename;
+	asset.mesh = MeshCache::GetInstance().RequestMesh(filename, &asset.assetName);
+
+	// the textures are decoded by jobs of their own, each file once
+	std::vector<std::string> textures;
+	if (asset.mesh != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(requestedMutex);
+		for (auto& material : asset.mesh->materials)
+		{
+			for (int slot = 0; slot < GeometryNode::TEXTURE_SLOTS; slot++)
+			{
+				const std::string& texture = GeometryNode::TextureFile(material, slot);
+				if (!texture.empty() && requestedTextures.insert(texture).second)
+					textures.push_back(texture);
+			}
+		}
+	}
+
+	// the mesh is queued before its textures, so its users know about the texture slots first
+	loaded.Push(std::move(asset));
+
+	JobSystem& job_system = JobSystem::GetInstance();
+	for (auto& texture : textures)
+		job_system.Run(jobs, [this, texture]() { load_texture(texture); });
+}
+
+void AssetLoader::load_texture(const std::string& filename)
+{
+	LoadedAsset asset;
+	asset.texture = true;
+	asset.filename = filename;
+	asset.image.reset(new TextureManager::Image());
+	if (!TextureManager::DecodeImage(filename.c_str(), *asset.image))
+		asset.image.reset();
+	loaded.Push(std::move(asset));
+}
+
+bool AssetLoader::Update(double budget_ms)
+{
+	if (!loading)
+		return false;
+
+	auto update_start = std::chrono::steady_clock::now();
+	double elapsed_ms = 0.0;
+
+	// every job pushes before it finishes, so when the counter is done the queue is complete
+	bool jobs_done = jobs.IsDone();
+
+	LoadedAsset asset;
+	while (loaded.Pop(asset))
+	{
+		if (asset.texture)
+			upload_texture(asset);
+		else
+			upload_mesh(asset);
+
+		elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - update_start).count();
+		if (elapsed_ms >= budget_ms)
+			break;
+	}
+
+	statistics.longest_update = std::max(statistics.longest_update, elapsed_ms);
+
+	if (jobs_done && loaded.Empty())
+	{
+		loading = false;
+		double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		printf("Assets resident after %.1f ms: %u meshes, %u textures, %u failed, longest upload frame %.2f ms\n",
+			total_ms, statistics.meshes_uploaded, statistics.textures_uploaded, statistics.failed, statistics.longest_update);
+
+		MeshCache::Statistics cache = MeshCache::GetInstance().GetStatistics();
+		printf("Meshes: %u requests, %u parsed (%.1f MB), %u from .meshbin, %u path hits, %u content hits\n",
+			cache.requests, cache.parsed, cache.bytes_parsed / (1024.0 * 1024.0),
+			cache.binary_loads, cache.path_hits, cache.content_hits);
+	}
+	return loading;
+}
+
+void AssetLoader::upload_mesh(LoadedAsset& asset)
+{
+	auto users = meshUsers.find(asset.filename);
+	if (asset.mesh == nullptr)
+	{
+		// the nodes of a mesh that could not be loaded stay invisible
+		printf("AssetLoader: could not load %s\n", asset.filename.c_str());
+		statistics.failed++;
+		if (users != meshUsers.end())
+			meshUsers.erase(users);
+		return;
+	}
+
+	LoadedAsset& resident = residentMeshes[asset.filename];
+	resident.filename = asset.filename;
+	resident.assetName = asset.assetName;
+	resident.mesh = asset.mesh;
+	statistics.meshes_uploaded++;
+
+	if (users != meshUsers.end())
+	{
+		for (GeometryNode* node : users->second)
+			attach_mesh(node, resident);
+		meshUsers.erase(users);
+	}
+}
+
+void AssetLoader::attach_mesh(GeometryNode* node, const LoadedAsset& asset)
+{
+	// the first node creates the VAO, the others share it
+	node->Init(asset.assetName, asset.mesh.get(), false);
+
+	TextureManager& textures = TextureManager::GetInstance();
+	for (size_t part = 0; part < node->parts.size(); part++)
+	{
+		const OBJMaterial& material = asset.mesh->materials[asset.mesh->objects[part].material_id];
+		for (int slot = 0; slot < GeometryNode::TEXTURE_SLOTS; slot++)
+		{
+			const std::string& file = GeometryNode::TextureFile(material, slot);
+			if (file.empty())
+				continue;
+
+			GLuint texture = textures.FindTexture(file.c_str());
+			if (texture != 0)
+				GeometryNode::TextureID(node->parts[part], slot) = texture;
+			else
+				textureUsers[file].push_back({ node, part, slot });
+		}
+	}
+}
+
+void AssetLoader::upload_texture(LoadedAsset& asset)
+{
+	GLuint texture = (asset.image != nullptr) ? TextureManager::GetInstance().RequestTexture(asset.filename.c_str(), false, asset.image.get()) : 0;
+	auto users = textureUsers.find(asset.filename);
+	if (texture == 0)
+	{
+		// the parts keep the colours of their materials
+		statistics.failed++;
+	}
+	else
+	{
+		statistics.textures_uploaded++;
+		if (users != textureUsers.end())
+		{
+			for (auto& user : users->second)
+				GeometryNode::TextureID(user.node->parts[user.part], user.slot) = texture;
+		}
+	}
+
+	if (users != textureUsers.end())
+		textureUsers.erase(users);
+}
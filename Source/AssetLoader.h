@@ -0,0 +1,101 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include "JobSystem.h"
+#include "LockFreeQueue.h"
+#include "TextureManager.h"
+
+class GeometryNode;
+class GeometricMesh;
+
+// Singleton Class of the asynchronous Asset Loader
+// the meshes are read and parsed and the textures decoded as jobs, the finished data
+// waits in a lock free queue until Update uploads it on the OpenGL thread.
+// a node stays invisible until its mesh is uploaded and its parts draw with the plain
+// colours of their materials until their textures are uploaded
+class AssetLoader
+{
+public:
+	struct Statistics
+	{
+		unsigned int meshes_requested;
+		unsigned int meshes_uploaded;
+		unsigned int textures_uploaded;
+		unsigned int failed;
+		// the longest Update, in ms
+		double longest_update;
+	};
+
+protected:
+	// the result of a job, either a mesh or a texture
+	struct LoadedAsset
+	{
+		bool texture;
+		std::string filename;
+		std::string assetName;
+		std::shared_ptr<const GeometricMesh> mesh;
+		std::unique_ptr<TextureManager::Image> image;
+	};
+
+	struct TextureUser
+	{
+		GeometryNode* node;
+		size_t part;
+		int slot;
+	};
+
+	LockFreeQueue<LoadedAsset> loaded;
+	JobCounter jobs;
+
+	// only touched by the OpenGL thread
+	std::unordered_map<std::string, std::vector<GeometryNode*>> meshUsers;
+	std::unordered_map<std::string, std::vector<TextureUser>> textureUsers;
+	std::unordered_map<std::string, LoadedAsset> residentMeshes;
+	bool loading;
+
+	// the textures that were already given to a job, jobs add to it
+	std::mutex requestedMutex;
+	std::unordered_set<std::string> requestedTextures;
+
+	Statistics statistics;
+	std::chrono::steady_clock::time_point start;
+
+	void load_mesh(const std::string& filename);
+	void load_texture(const std::string& filename);
+	void upload_mesh(LoadedAsset& asset);
+	void upload_texture(LoadedAsset& asset);
+	void attach_mesh(GeometryNode* node, const LoadedAsset& asset);
+
+public:
+	// get the static instance of Asset Loader
+	static AssetLoader& GetInstance()
+	{
+		static AssetLoader loader;
+		return loader;
+	}
+	~AssetLoader();
+
+	// load the mesh of an OBJ file and its textures in the background and init the node
+	// with them when they are uploaded, call it from the OpenGL thread
+	void RequestMesh(const std::string& filename, GeometryNode* node);
+
+	// upload finished assets until the budget is used up, at least one per call
+	// returns true while assets are still loading, call it every frame on the OpenGL thread
+	bool Update(double budget_ms);
+
+	bool IsLoading() const { return loading; }
+	const Statistics& GetStatistics() const { return statistics; }
+
+protected:
+	AssetLoader();
+	void operator=(AssetLoader const&);
+};
+
+#endif
@@ -5,25 +5,24 @@
 #include <string>
 #include <vector>
 #include "GeometricMesh.h"
+#include "MeshArena.h"
 
 // Singleton Class of Texture Manager
 class AssetManager
 {
 protected:
+	// the vertices and indices of an asset in the arena
 	struct AssetContainer
 	{
-		unsigned int m_vao;
-		unsigned int m_vbo_positions;
-		unsigned int m_vbo_normals;
-		unsigned int m_vbo_tangents;
-		unsigned int m_vbo_bitangents;
-		unsigned int m_vbo_texcoords;
 		std::string name;
+		MeshArena::Range range;
 	};
 
 	std::vector<AssetContainer> assets;
+	MeshArena arena;
 
-	unsigned int findAsset(const std::string& assetName);
+	AssetContainer* findAsset(const std::string& assetName);
+	void deleteAsset(AssetContainer& asset);
 
 public:
 	
@@ -37,7 +36,22 @@ public:
 
 	void Clear();
 
-	unsigned int RequestAsset(const std::string & assetName, GeometricMesh* mesh=nullptr);
+	// the vao of the arena, every asset draws with it from the range GetArenaRange gives, 0 if the asset could not be uploaded
+	unsigned int RequestAsset(const std::string & assetName, const GeometricMesh* mesh=nullptr);
+	// frees the range of an asset, a later request with a mesh uploads it again
+	void ReleaseAsset(const std::string & assetName);
+
+	// the size of the arena when nothing sized it before the first asset
+	static const size_t DEFAULT_ARENA_VERTICES = 64 * 1024;
+	static const size_t DEFAULT_ARENA_INDICES = 256 * 1024;
+
+	// sizes the arena before the first asset, in vertices and indices, it grows on its own after
+	bool InitArena(size_t vertices, size_t indices);
+	// false if the asset has not been requested
+	bool GetArenaRange(const std::string & assetName, MeshArena::Range& range);
+	const MeshArena& GetArena() const { return arena; }
+	size_t GetAssetCount() const { return assets.size(); }
+	MeshArena::Statistics GetArenaStatistics() const { return arena.GetStatistics(); }
 
 protected:
 	AssetManager();
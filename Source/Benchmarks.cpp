@@ -0,0 +1,1365 @@
+#include "Benchmarks.h"
+#include "OBJLoader.h"
+#include "GeometricMesh.h"
+#include "Tools.h"
+#include "VirtualFileSystem.h"
+#include "JobSystem.h"
+#include "TextureManager.h"
+#include "TextureCompressor.h"
+#include "Renderer.h"
+#include "AssetLoader.h"
+#include "LightClusters.h"
+#include "FrustumCuller.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include "SDL2/SDL.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	template<typename T>
+	bool same_data(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+	}
+
+	bool same_mesh(const GeometricMesh* a, const GeometricMesh* b)
+	{
+		if (!a || !b) return a == b;
+		if (!same_data(a->vertices, b->vertices) || !same_data(a->normals, b->normals) ||
+			!same_data(a->textureCoord, b->textureCoord) || !same_data(a->tangents, b->tangents) || !same_data(a->indices, b->indices) ||
+			a->objects.size() != b->objects.size() || a->materials.size() != b->materials.size())
+			return false;
+
+		for (size_t i = 0; i < a->objects.size(); i++)
+		{
+			if (a->objects[i].start != b->objects[i].start || a->objects[i].end != b->objects[i].end ||
+				a->objects[i].material_id != b->objects[i].material_id || a->objects[i].name != b->objects[i].name)
+				return false;
+		}
+		return true;
+	}
+
+	// the welded mesh draws the same corners as the one with three vertices per triangle
+	bool same_corners(const GeometricMesh* separate, const GeometricMesh* welded)
+	{
+		if (!separate || !welded || separate->vertices.size() != welded->indices.size())
+			return false;
+
+		for (size_t i = 0; i < welded->indices.size(); i++)
+		{
+			unsigned int index = welded->indices[i];
+			if (separate->vertices[i] != welded->vertices[index] || separate->normals[i] != welded->normals[index] ||
+				(!separate->textureCoord.empty() && separate->textureCoord[i] != welded->textureCoord[index]))
+				return false;
+		}
+		return true;
+	}
+
+	// the lights that reach a point of a cluster without being in its list. the points are spread over
+	// the froxel from its tile and slice, and every light is tested against them in world space with the
+	// range and cone of the deferred shader, independently of the bounds the binning uses
+	size_t missed_lights(const LightClusters& clusters, const glm::mat4& view, const glm::mat4& projection,
+		float z_near, float z_far, const std::vector<LightClusters::Light>& lights)
+	{
+		const int samples = 3;
+		const glm::mat4 inverse_view = glm::inverse(view);
+		const std::vector<LightClusters::Cluster>& list = clusters.GetClusters();
+		const std::vector<uint16_t>& indices = clusters.GetIndices();
+		if (list.size() != CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z)
+			return lights.size();
+
+		size_t missed = 0;
+		std::vector<glm::vec3> points(samples * samples * samples);
+		for (int z = 0; z < CLUSTERS_Z; z++)
+		{
+			for (int y = 0; y < CLUSTERS_Y; y++)
+			{
+				for (int x = 0; x < CLUSTERS_X; x++)
+				{
+					// the points inside the froxel and the sphere around them, lights out of its reach light none of them
+					glm::vec3 center(0.f);
+					for (int s = 0; s < (int)points.size(); s++)
+					{
+						float depth = z_near * powf(z_far / z_near, (z + (s / (samples * samples) + 0.5f) / samples) / CLUSTERS_Z);
+						float ndc_x = -1.f + 2.f * (x + (s % samples + 0.5f) / samples) / CLUSTERS_X;
+						float ndc_y = -1.f + 2.f * (y + (s / samples % samples + 0.5f) / samples) / CLUSTERS_Y;
+						points[s] = glm::vec3(inverse_view * glm::vec4(ndc_x * depth / projection[0][0], ndc_y * depth / projection[1][1], -depth, 1.f));
+						center += points[s] / (float)points.size();
+					}
+					float radius = 0.f;
+					for (auto& point : points)
+						radius = std::max(radius, glm::length(point - center));
+
+					const LightClusters::Cluster& cluster = list[x + CLUSTERS_X * (y + CLUSTERS_Y * z)];
+					const uint16_t* begin = indices.data() + cluster.offset;
+					const uint16_t* end = begin + cluster.count;
+					for (size_t i = 0; i < lights.size(); i++)
+					{
+						const LightClusters::Light& light = lights[i];
+						if (glm::length(center - light.position) > light.range + radius || std::find(begin, end, (uint16_t)i) != end)
+							continue;
+
+						for (auto& point : points)
+						{
+							glm::vec3 to_point = point - light.position;
+							float distance = glm::length(to_point);
+							if (distance <= light.range && glm::dot(to_point, light.direction) >= light.cos_cone * distance)
+							{
+								missed++;
+								break;
+							}
+						}
+					}
+				}
+			}
+		}
+		return missed;
+	}
+
+	size_t vertex_bytes(const GeometricMesh* mesh)
+	{
+		return mesh->vertices.size() * sizeof(glm::vec3) + mesh->normals.size() * sizeof(glm::vec3) +
+			mesh->textureCoord.size() * sizeof(glm::vec2) + mesh->tangents.size() * sizeof(glm::vec3) +
+			mesh->bitangents.size() * sizeof(glm::vec3) + mesh->indices.size() * sizeof(unsigned int);
+	}
+
+	// every frame draws the same scene once the loading finished
+	void finish_loading(Renderer& renderer, SDL_Window* window)
+	{
+		while (AssetLoader::GetInstance().IsLoading())
+		{
+			renderer.Render();
+			SDL_GL_SwapWindow(window);
+		}
+	}
+
+	// the extra lights are unshadowed spots scattered over the dungeon
+	void add_lights(Renderer& renderer, int count)
+	{
+		while ((int)renderer.GetLightCount() < count)
+		{
+			LightNode& light = renderer.AddLight();
+			glm::vec3 position(-10.f + 30.f * rand() / RAND_MAX, 3.f + 3.f * rand() / RAND_MAX, -40.f + 40.f * rand() / RAND_MAX);
+			light.SetColor(glm::vec3(2.f + 10.f * rand() / RAND_MAX));
+			light.SetPosition(position);
+			light.SetTarget(position + glm::vec3(0.f, -1.f, 0.f));
+			float cone = 20.f + 120.f * rand() / RAND_MAX;
+			light.SetConeSize(cone, cone + 20.f);
+		}
+	}
+
+	// best of a few runs, in seconds
+	template<typename F>
+	double best_time(int runs, F function)
+	{
+		double best = 1e30;
+		for (int i = 0; i < runs; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			function();
+			best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+		return best;
+	}
+
+	// warms up the settings of the renderer with a frame, then the best of frames frames in ms and shows the last
+	// one. after_frame runs after each of them, for the GPU queries, render_ms gets the best CPU time of Render
+	double frame_time(Renderer& renderer, SDL_Window* window, int frames, const std::function<void()>& after_frame = {}, double* render_ms = nullptr)
+	{
+		renderer.Render();
+		glFinish();
+
+		double render = 1e30;
+		double frame = best_time(frames, [&]()
+		{
+			auto start = std::chrono::steady_clock::now();
+			renderer.Render();
+			render = std::min(render, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			glFinish();
+			if (after_frame)
+				after_frame();
+		});
+		SDL_GL_SwapWindow(window);
+
+		if (render_ms)
+			*render_ms = render;
+		return frame * 1000.0;
+	}
+
+	// the settings of the renderer a benchmark may change, put back when it returns
+	class RendererSettings
+	{
+		Renderer& m_renderer;
+		Renderer::LightingMode m_lighting_mode;
+		Renderer::GBufferLayout m_gbuffer_layout;
+		size_t m_shadow_budget;
+		bool m_light_bounds;
+		bool m_frustum_culling;
+		bool m_shadow_caching;
+		bool m_instancing;
+		bool m_static_batching;
+		bool m_render_queue_sorting;
+		bool m_indirect_drawing;
+
+	public:
+		explicit RendererSettings(Renderer& renderer) : m_renderer(renderer)
+		{
+			m_lighting_mode = renderer.GetLightingMode();
+			m_gbuffer_layout = renderer.GetGBufferLayout();
+			m_shadow_budget = renderer.GetShadowBudget();
+			m_light_bounds = renderer.GetLightBounds();
+			m_frustum_culling = renderer.GetFrustumCulling();
+			m_shadow_caching = renderer.GetShadowCaching();
+			m_instancing = renderer.GetInstancing();
+			m_static_batching = renderer.GetStaticBatching();
+			m_render_queue_sorting = renderer.GetRenderQueueSorting();
+			m_indirect_drawing = renderer.GetIndirectDrawing();
+		}
+
+		~RendererSettings()
+		{
+			m_renderer.SetLightingMode(m_lighting_mode);
+			m_renderer.SetGBufferLayout(m_gbuffer_layout);
+			if (m_renderer.GetShadowBudget() != m_shadow_budget)
+				m_renderer.SetShadowBudget(m_shadow_budget);
+			m_renderer.SetLightBounds(m_light_bounds);
+			m_renderer.SetFrustumCulling(m_frustum_culling);
+			m_renderer.SetShadowCaching(m_shadow_caching);
+			m_renderer.SetInstancing(m_instancing);
+			m_renderer.SetStaticBatching(m_static_batching);
+			m_renderer.SetRenderQueueSorting(m_render_queue_sorting);
+			m_renderer.SetIndirectDrawing(m_indirect_drawing);
+		}
+
+		// the shadow maps draw every caster every frame, as without their cache
+		void DrawEveryCaster() { m_renderer.SetShadowCaching(false); }
+	};
+
+	// the benchmarks that draw, by the name that follows --bench
+	struct RendererBenchmark
+	{
+		const char* name;
+		void (*run)(Renderer& renderer, SDL_Window* window);
+	};
+
+	const RendererBenchmark renderer_benchmarks[] =
+	{
+		{ "lights", Benchmarks::DeferredLighting },
+		{ "bounds", Benchmarks::LightBounds },
+		{ "gbuffer", Benchmarks::GBufferLayouts },
+		{ "shadows", Benchmarks::ShadowCulling },
+		{ "atlas", Benchmarks::ShadowAtlasBudgets },
+		{ "instancing", Benchmarks::Instancing },
+		{ "batching", Benchmarks::StaticBatching },
+		{ "queue", Benchmarks::RenderQueueSorting },
+		{ "indirect", Benchmarks::IndirectDrawing },
+		{ "arena", Benchmarks::MeshArenaUsage },
+	};
+
+	const RendererBenchmark* find_renderer_benchmark(int argc, char* argv[])
+	{
+		if (argc < 2 || strcmp(argv[0], "--bench") != 0)
+			return nullptr;
+
+		for (const RendererBenchmark& benchmark : renderer_benchmarks)
+		{
+			if (strcmp(argv[1], benchmark.name) == 0)
+				return &benchmark;
+		}
+		return nullptr;
+	}
+}
+
+namespace Benchmarks
+{
+	bool NeedsRenderer(int argc, char* argv[])
+	{
+		return find_renderer_benchmark(argc, argv) != nullptr;
+	}
+
+	void RunWithRenderer(int argc, char* argv[], Renderer& renderer, SDL_Window* window)
+	{
+		if (const RendererBenchmark* benchmark = find_renderer_benchmark(argc, argv))
+			benchmark->run(renderer, window);
+	}
+
+	bool Run(int argc, char* argv[])
+	{
+		if (argc < 2 || strcmp(argv[0], "--bench") != 0 || NeedsRenderer(argc, argv))
+			return false;
+
+		const char* folder = (argc > 2) ? argv[2] : "Assets/Dungeon";
+
+		if (strcmp(argv[1], "obj") == 0) OBJParsing(folder);
+		else if (strcmp(argv[1], "weld") == 0) VertexWelding(folder);
+		else if (strcmp(argv[1], "meshbin") == 0) BinaryMeshes(folder);
+		else if (strcmp(argv[1], "jobs") == 0) JobScheduling((argc > 2) ? (unsigned int)atoi(argv[2]) : 0);
+		else if (strcmp(argv[1], "textures") == 0) TextureDecoding(folder);
+		else if (strcmp(argv[1], "bc") == 0) TextureCompression(folder);
+		else if (strcmp(argv[1], "culling") == 0) FrustumCulling((argc > 2) ? atoi(argv[2]) : 4096);
+		else if (strcmp(argv[1], "clusters") == 0) LightClustering((argc > 2) ? atoi(argv[2]) : MAX_LIGHTS);
+		else if (strcmp(argv[1], "pak") == 0) PackedFiles(folder, (argc > 3) ? argv[3] : "Assets/Assets.pak");
+		else printf("Unknown benchmark %s\n", argv[1]);
+
+		return true;
+	}
+
+	void OBJParsing(const char* folder)
+	{
+		std::vector<std::string> files = Tools::ListFiles(folder, ".obj");
+		const int runs = 3;
+
+		struct Row { std::string name; size_t bytes; double stdio; double mapped; double parallel; bool same; };
+		std::vector<Row> rows;
+
+		for (auto& file : files)
+		{
+			Tools::MappedFile mapped;
+			if (!mapped.Open(file.c_str())) continue;
+
+			Row row;
+			row.name = file.substr(file.find_last_of("/\\") + 1);
+			row.bytes = mapped.Size();
+			mapped.Close();
+
+			// always parse, the .meshbin files would skip the work that is measured
+			OBJLoader loader, parallel_loader;
+			loader.setBinaryCache(false);
+			parallel_loader.setBinaryCache(false);
+			loader.setParallelism(1);
+			row.stdio = best_time(runs, [&]() { delete loader.loadStdio(file.c_str()); });
+			row.mapped = best_time(runs, [&]() { delete loader.load(file.c_str()); });
+			row.parallel = best_time(runs, [&]() { delete parallel_loader.load(file.c_str()); });
+
+			GeometricMesh* reference = loader.loadStdio(file.c_str());
+			GeometricMesh* mesh = loader.load(file.c_str());
+			GeometricMesh* parallel_mesh = parallel_loader.load(file.c_str());
+			row.same = same_mesh(reference, mesh) && same_mesh(reference, parallel_mesh);
+			delete reference;
+			delete mesh;
+			delete parallel_mesh;
+
+			rows.push_back(row);
+		}
+
+		// scaling of the chunked parser on the largest file, with small chunks so that every thread gets work
+		auto largest = std::max_element(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.bytes < b.bytes; });
+		struct Scaling { unsigned int threads; double time; bool same; };
+		std::vector<Scaling> scaling;
+		if (largest != rows.end())
+		{
+			std::string file = files[largest - rows.begin()];
+			OBJLoader loader;
+			loader.setBinaryCache(false);
+			GeometricMesh* reference = loader.loadStdio(file.c_str());
+			unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+			std::vector<unsigned int> thread_counts;
+			for (unsigned int threads = 1; threads < cores; threads *= 2)
+				thread_counts.push_back(threads);
+			thread_counts.push_back(cores);
+
+			for (unsigned int threads : thread_counts)
+			{
+				JobSystem::GetInstance().Init(threads);
+				loader.setParallelism(threads, 64 * 1024);
+				Scaling s;
+				s.threads = threads;
+				s.time = best_time(runs, [&]() { delete loader.load(file.c_str()); });
+				GeometricMesh* mesh = loader.load(file.c_str());
+				s.same = same_mesh(reference, mesh);
+				delete mesh;
+				scaling.push_back(s);
+			}
+			delete reference;
+			JobSystem::GetInstance().Init();
+		}
+
+		// the loaders are chatty, print the tables after all of them finished
+		size_t total_bytes = 0;
+		double total_stdio = 0.0, total_mapped = 0.0, total_parallel = 0.0;
+		printf("\n%-36s %10s %12s %12s %12s %8s %s\n", "file", "KB", "stdio MB/s", "mapped MB/s", "chunked MB/s", "speedup", "result");
+		for (auto& row : rows)
+		{
+			double mb = row.bytes / (1024.0 * 1024.0);
+			printf("%-36s %10.1f %12.1f %12.1f %12.1f %7.2fx %s\n", row.name.c_str(), row.bytes / 1024.0,
+				mb / row.stdio, mb / row.mapped, mb / row.parallel, row.stdio / std::min(row.mapped, row.parallel), row.same ? "identical" : "MISMATCH");
+			total_bytes += row.bytes;
+			total_stdio += row.stdio;
+			total_mapped += row.mapped;
+			total_parallel += row.parallel;
+		}
+		double total_mb = total_bytes / (1024.0 * 1024.0);
+		if (!rows.empty())
+			printf("%-36s %10.1f %12.1f %12.1f %12.1f %7.2fx\n", "total", total_bytes / 1024.0,
+				total_mb / total_stdio, total_mb / total_mapped, total_mb / total_parallel, total_stdio / total_parallel);
+
+		if (!scaling.empty())
+		{
+			double mb = largest->bytes / (1024.0 * 1024.0);
+			printf("\n%s, 64 KB minimum chunk\n%8s %12s %8s %s\n", largest->name.c_str(), "threads", "MB/s", "scaling", "result");
+			for (auto& s : scaling)
+				printf("%8u %12.1f %7.2fx %s\n", s.threads, mb / s.time, scaling[0].time / s.time, s.same ? "identical" : "MISMATCH");
+		}
+	}
+
+	void VertexWelding(const char* folder)
+	{
+		std::vector<std::string> files = Tools::ListFiles(folder, ".obj");
+
+		struct Row { std::string name; size_t triangles; size_t separate; size_t welded; size_t separate_bytes; size_t welded_bytes; bool same; };
+		std::vector<Row> rows;
+
+		for (auto& file : files)
+		{
+			OBJLoader loader;
+			loader.setBinaryCache(false);
+			loader.setIndexedOutput(false);
+			GeometricMesh* separate = loader.load(file.c_str());
+			loader.setIndexedOutput(true);
+			GeometricMesh* welded = loader.load(file.c_str());
+
+			if (separate && welded)
+			{
+				Row row;
+				row.name = file.substr(file.find_last_of("/\\") + 1);
+				row.triangles = welded->indices.size() / 3;
+				row.separate = separate->vertices.size();
+				row.welded = welded->vertices.size();
+				row.separate_bytes = vertex_bytes(separate);
+				row.welded_bytes = vertex_bytes(welded);
+				row.same = same_corners(separate, welded);
+				rows.push_back(row);
+			}
+			delete separate;
+			delete welded;
+		}
+
+		size_t total_separate = 0, total_welded = 0, total_separate_bytes = 0, total_welded_bytes = 0;
+		printf("\n%-36s %10s %10s %10s %8s %10s %10s %s\n", "file", "triangles", "vertices", "welded", "ratio", "KB before", "KB after", "result");
+		for (auto& row : rows)
+		{
+			printf("%-36s %10zu %10zu %10zu %7.2fx %10.1f %10.1f %s\n", row.name.c_str(), row.triangles, row.separate, row.welded,
+				row.separate / (double)std::max<size_t>(1, row.welded), row.separate_bytes / 1024.0, row.welded_bytes / 1024.0,
+				row.same ? "identical" : "MISMATCH");
+			total_separate += row.separate;
+			total_welded += row.welded;
+			total_separate_bytes += row.separate_bytes;
+			total_welded_bytes += row.welded_bytes;
+		}
+		if (!rows.empty())
+			printf("%-36s %10s %10zu %10zu %7.2fx %10.1f %10.1f\n", "total", "", total_separate, total_welded,
+				total_separate / (double)std::max<size_t>(1, total_welded), total_separate_bytes / 1024.0, total_welded_bytes / 1024.0);
+	}
+
+	void BinaryMeshes(const char* folder)
+	{
+		std::vector<std::string> files = Tools::ListFiles(folder, ".obj");
+		const int runs = 3;
+
+		struct Row { std::string name; size_t obj_bytes; size_t binary_bytes; double parse; double binary; bool same; };
+		std::vector<Row> rows;
+
+		for (auto& file : files)
+		{
+			Tools::FileInfo obj, binary;
+			if (!Tools::GetFileInfo(file.c_str(), obj)) continue;
+
+			// the parsing loader writes the .meshbin that the binary reads are measured on
+			OBJLoader loader;
+			Row row;
+			row.name = file.substr(file.find_last_of("/\\") + 1);
+			row.obj_bytes = (size_t)obj.size;
+			row.parse = best_time(runs, [&]()
+			{
+				Tools::MappedFile text;
+				if (text.Open(file.c_str()))
+					delete loader.load(file.c_str(), text.Data(), text.Size(), OBJLoader::contentHash(file.c_str(), text.Data(), text.Size()));
+			});
+			row.binary = best_time(runs, [&]() { delete OBJLoader::loadBinary(file.c_str()); });
+			row.binary_bytes = Tools::GetFileInfo(OBJLoader::binaryFilename(file.c_str()).c_str(), binary) ? (size_t)binary.size : 0;
+
+			loader.setBinaryCache(false);
+			GeometricMesh* parsed = loader.load(file.c_str());
+			GeometricMesh* cached = OBJLoader::loadBinary(file.c_str());
+			row.same = same_mesh(parsed, cached) && cached->aabb_min == parsed->aabb_min && cached->aabb_max == parsed->aabb_max;
+			delete parsed;
+			delete cached;
+
+			rows.push_back(row);
+		}
+
+		double total_parse = 0.0, total_binary = 0.0;
+		printf("\n%-36s %10s %10s %10s %10s %8s %s\n", "file", "OBJ KB", "bin KB", "parse ms", "bin ms", "speedup", "result");
+		for (auto& row : rows)
+		{
+			printf("%-36s %10.1f %10.1f %10.2f %10.2f %7.1fx %s\n", row.name.c_str(), row.obj_bytes / 1024.0, row.binary_bytes / 1024.0,
+				row.parse * 1000.0, row.binary * 1000.0, row.parse / row.binary, row.same ? "identical" : "MISMATCH");
+			total_parse += row.parse;
+			total_binary += row.binary;
+		}
+		if (!rows.empty())
+			printf("%-36s %10s %10s %10.2f %10.2f %7.1fx\n", "total", "", "", total_parse * 1000.0, total_binary * 1000.0, total_parse / total_binary);
+	}
+
+	void PackedFiles(const char* folder, const char* archive)
+	{
+		std::vector<std::string> files;
+		for (const char* extension : { ".obj", ".mtl", ".png" })
+		{
+			std::vector<std::string> listed = Tools::ListFiles(folder, extension, true);
+			files.insert(files.end(), listed.begin(), listed.end());
+		}
+		const int runs = 3;
+
+		// every byte is hashed so that both ways really read the data
+		size_t total_bytes = 0;
+		std::vector<uint64_t> loose_hashes(files.size()), packed_hashes(files.size());
+		double loose = best_time(runs, [&]()
+		{
+			total_bytes = 0;
+			for (size_t i = 0; i < files.size(); i++)
+			{
+				Tools::MappedFile file;
+				loose_hashes[i] = file.Open(files[i].c_str()) ? Tools::HashBytes(file.Data(), file.Size()) : 0;
+				total_bytes += file.Size();
+			}
+		});
+
+		VirtualFileSystem& vfs = VirtualFileSystem::GetInstance();
+		auto start = std::chrono::steady_clock::now();
+		if (!vfs.Mount(archive))
+		{
+			printf("Cook %s with the AssetCooker first\n", archive);
+			return;
+		}
+		double mount = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		size_t packed_files = 0;
+		double packed = best_time(runs, [&]()
+		{
+			packed_files = 0;
+			for (size_t i = 0; i < files.size(); i++)
+			{
+				VirtualFile file;
+				packed_hashes[i] = vfs.Open(files[i].c_str(), file) ? Tools::HashBytes(file.Data(), file.Size()) : 0;
+				packed_files += file.IsPacked() ? 1 : 0;
+			}
+		});
+		vfs.Clear();
+
+		size_t mismatches = 0;
+		for (size_t i = 0; i < files.size(); i++)
+			mismatches += (loose_hashes[i] != packed_hashes[i]) ? 1 : 0;
+
+		printf("\n%zu files, %.1f MB, %zu of them in %s\n", files.size(), total_bytes / (1024.0 * 1024.0), packed_files, archive);
+		printf("%-24s %10.2f ms\n", "loose files", loose * 1000.0);
+		printf("%-24s %10.2f ms (+ %.2f ms to mount)\n", "packed archive", packed * 1000.0, mount * 1000.0);
+		printf("%-24s %10.1fx %s\n", "speedup", loose / (packed + mount), mismatches == 0 ? "identical" : "MISMATCH");
+	}
+
+	void JobScheduling(unsigned int max_threads)
+	{
+		JobSystem& jobs = JobSystem::GetInstance();
+		const int runs = 3;
+		const size_t empty_jobs = 100000;
+		const size_t work_jobs = 1024;
+		const size_t parents = 64, children = 64;
+
+		// a few microseconds of arithmetic per job, the same for every thread count
+		auto work = [](size_t seed)
+		{
+			float x = (float)seed;
+			for (int i = 0; i < 4000; i++)
+				x = std::sqrt(x * x + 1.0f) * 0.999f;
+			return x;
+		};
+		std::vector<float> reference(work_jobs), results(work_jobs);
+		for (size_t i = 0; i < work_jobs; i++)
+			reference[i] = work(i);
+
+		unsigned int cores = (max_threads > 0) ? max_threads : std::max(1u, std::thread::hardware_concurrency());
+		std::vector<unsigned int> thread_counts;
+		for (unsigned int threads = 1; threads < cores; threads *= 2)
+			thread_counts.push_back(threads);
+		thread_counts.push_back(cores);
+
+		struct Row { unsigned int threads; double empty; double work; double nested; uint64_t stolen; bool correct; };
+		std::vector<Row> rows;
+
+		for (unsigned int threads : thread_counts)
+		{
+			jobs.Init(threads);
+			Row row;
+			row.threads = threads;
+			row.correct = true;
+
+			// scheduling overhead: jobs that do nothing, submitted from this thread
+			row.empty = best_time(runs, [&]()
+			{
+				JobCounter counter;
+				for (size_t i = 0; i < empty_jobs; i++)
+					jobs.Run(counter, []() {});
+				jobs.Wait(counter);
+			});
+
+			jobs.ResetStatistics();
+			row.work = best_time(runs, [&]()
+			{
+				JobCounter counter;
+				jobs.ParallelFor(counter, work_jobs, 1, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+						results[i] = work(i);
+				});
+				jobs.Wait(counter);
+			});
+			row.stolen = jobs.GetStatistics().stolen;
+			row.correct = row.correct && results == reference;
+
+			// every parent job adds children to its own counter, the root is done when all of them are
+			std::atomic<size_t> finished_children(0);
+			row.nested = best_time(runs, [&]()
+			{
+				JobCounter root;
+				std::vector<std::unique_ptr<JobCounter>> groups;
+				for (size_t p = 0; p < parents; p++)
+					groups.emplace_back(new JobCounter(&root));
+				finished_children = 0;
+				for (size_t p = 0; p < parents; p++)
+				{
+					JobCounter* group = groups[p].get();
+					jobs.Run(root, [&jobs, &finished_children, group, children]()
+					{
+						for (size_t c = 0; c < children; c++)
+							jobs.Run(*group, [&finished_children]() { finished_children++; });
+					});
+				}
+				jobs.Wait(root);
+				for (auto& group : groups)
+					row.correct = row.correct && group->IsDone();
+				row.correct = row.correct && finished_children.load() == parents * children;
+			});
+
+			rows.push_back(row);
+		}
+
+		// the single thread mode has to run the nested jobs in the same order every time
+		jobs.Init(1);
+		std::vector<size_t> orders[2];
+		for (auto& order : orders)
+		{
+			JobCounter root;
+			for (size_t p = 0; p < 8; p++)
+			{
+				jobs.Run(root, [&jobs, &root, &order, p]()
+				{
+					order.push_back(p * 100);
+					for (size_t c = 0; c < 8; c++)
+						jobs.Run(root, [&order, p, c]() { order.push_back(p * 100 + c + 1); });
+				});
+			}
+			jobs.Wait(root);
+		}
+		bool deterministic = orders[0] == orders[1] && orders[0].size() == 8 * 9;
+		jobs.Init();
+
+		printf("\n%8s %12s %12s %8s %12s %10s %s\n", "threads", "ns/job", "work ms", "scaling", "nested ms", "stolen", "result");
+		for (auto& row : rows)
+		{
+			printf("%8u %12.1f %12.2f %7.2fx %12.2f %10llu %s\n", row.threads, row.empty * 1e9 / empty_jobs, row.work * 1000.0,
+				rows[0].work / row.work, row.nested * 1000.0, (unsigned long long)row.stolen, row.correct ? "correct" : "WRONG");
+		}
+		printf("1 thread runs every job at once on the submitting thread (deterministic mode), %zu empty jobs, "
+			"%zu work jobs, %zu x %zu nested jobs\n", empty_jobs, work_jobs, parents, children);
+		printf("single thread order: %s\n", deterministic ? "deterministic" : "DIFFERENT");
+	}
+	void TextureDecoding(const char* folder)
+	{
+		std::vector<std::string> files = Tools::ListFiles(folder, ".png", true);
+		const int runs = 3;
+
+		// the pixels are hashed row by row, the padding at the end of the rows is not part of the image
+		auto image_hash = [](const TextureManager::Image& image)
+		{
+			const SDL_Surface* surface = image.surface.get();
+			const size_t row_bytes = (size_t)surface->w * surface->format->BytesPerPixel;
+			uint64_t hash = 0;
+			for (int y = 0; y < surface->h; y++)
+				hash = Tools::HashBytes(static_cast<const char*>(surface->pixels) + (size_t)y * surface->pitch, row_bytes, hash ^ y);
+			return hash;
+		};
+
+		size_t pixel_bytes = 0;
+		std::vector<uint64_t> reference(files.size(), 0);
+		double sequential = best_time(runs, [&]()
+		{
+			pixel_bytes = 0;
+			for (size_t i = 0; i < files.size(); i++)
+			{
+				TextureManager::Image image;
+				if (!TextureManager::DecodeImage(files[i].c_str(), image))
+					continue;
+				reference[i] = image_hash(image);
+				pixel_bytes += (size_t)image.width * image.height * image.surface->format->BytesPerPixel;
+			}
+		});
+
+		unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<unsigned int> thread_counts;
+		for (unsigned int threads = 1; threads < cores; threads *= 2)
+			thread_counts.push_back(threads);
+		thread_counts.push_back(cores);
+
+		struct Row { unsigned int threads; double time; bool same; };
+		std::vector<Row> rows;
+		JobSystem& jobs = JobSystem::GetInstance();
+		for (unsigned int threads : thread_counts)
+		{
+			jobs.Init(threads);
+
+			// the decoding of TextureManager::RequestTextures, without the uploads
+			std::vector<uint64_t> hashes(files.size(), 0);
+			Row row;
+			row.threads = threads;
+			row.time = best_time(runs, [&]()
+			{
+				JobCounter counter;
+				jobs.ParallelFor(counter, files.size(), 1, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						TextureManager::Image image;
+						hashes[i] = TextureManager::DecodeImage(files[i].c_str(), image) ? image_hash(image) : 0;
+					}
+				});
+				jobs.Wait(counter);
+			});
+			row.same = (hashes == reference);
+			rows.push_back(row);
+		}
+		jobs.Init();
+
+		printf("\n%zu textures, %.1f MB of pixels, flipped in the decoded surfaces without a copy\n", files.size(), pixel_bytes / (1024.0 * 1024.0));
+		printf("%-24s %10.2f ms\n", "one after the other", sequential * 1000.0);
+		for (auto& row : rows)
+			printf("batch on %2u threads %12.2f ms %7.2fx %s\n", row.threads, row.time * 1000.0, sequential / row.time, row.same ? "identical" : "MISMATCH");
+	}
+	void TextureCompression(const char* folder)
+	{
+		std::vector<std::string> files = Tools::ListFiles(folder, ".png", true);
+
+		// the pixels are decoded without the cache, the encoder is timed on its own and nothing is written
+		bool compressing = TextureManager::IsCompressing();
+		TextureManager::SetCompression(false);
+
+		struct Row { std::string name; int width; int height; TextureCompressor::Format format; size_t raw; size_t compressed; float psnr; double time; };
+		std::vector<Row> rows;
+		for (auto& file : files)
+		{
+			TextureManager::Image image;
+			if (!TextureManager::DecodeImage(file.c_str(), image))
+				continue;
+
+			const SDL_Surface* surface = image.surface.get();
+			const unsigned char* pixels = static_cast<const unsigned char*>(surface->pixels);
+			const int channels = surface->format->BytesPerPixel;
+
+			Row row;
+			row.name = file.substr(file.find_last_of("/\\") + 1);
+			row.width = image.width;
+			row.height = image.height;
+			row.format = TextureCompressor::ChooseFormat(file.c_str(), pixels, image.width, image.height, surface->pitch, channels);
+
+			TextureCompressor::CompressedTexture compressed;
+			auto start = std::chrono::steady_clock::now();
+			TextureCompressor::Compress(pixels, image.width, image.height, surface->pitch, channels,
+				image.format == GL_BGR || image.format == GL_BGRA, row.format, compressed);
+			row.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			// the uncompressed texture with the mip levels glGenerateMipmap adds
+			row.raw = (size_t)image.width * image.height * channels * 4 / 3;
+			row.compressed = compressed.blocks.size();
+			row.psnr = compressed.psnr;
+			rows.push_back(row);
+		}
+		TextureManager::SetCompression(compressing);
+
+		size_t total_raw = 0, total_compressed = 0;
+		double total_time = 0.0;
+		printf("\n%-32s %11s %6s %10s %10s %7s %10s %10s\n", "texture", "size", "format", "raw KB", "BC KB", "ratio", "PSNR dB", "encode ms");
+		for (auto& row : rows)
+		{
+			printf("%-32s %5dx%-5d %6s %10.1f %10.1f %6.1fx %10.2f %10.2f\n", row.name.c_str(), row.width, row.height,
+				TextureCompressor::FormatName(row.format), row.raw / 1024.0, row.compressed / 1024.0,
+				(double)row.raw / std::max<size_t>(1, row.compressed), row.psnr, row.time * 1000.0);
+			total_raw += row.raw;
+			total_compressed += row.compressed;
+			total_time += row.time;
+		}
+		printf("%-32s %11s %6s %10.1f %10.1f %6.1fx %10s %10.2f on %u threads\n", "total", "", "", total_raw / 1024.0, total_compressed / 1024.0,
+			(double)total_raw / std::max<size_t>(1, total_compressed), "", total_time * 1000.0, JobSystem::GetInstance().GetThreadCount());
+	}
+
+	void LightClustering(int max_lights)
+	{
+		const int cameras = 16;
+		const int runs = 5;
+		max_lights = std::max(1, std::min(max_lights, MAX_LIGHTS));
+
+		// the projection of the game, cameras and spots scattered over the dungeon
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), 1080.f / 640.f, 0.1f, 100.f);
+		srand(1);
+		auto random = [](float low, float high) { return low + (high - low) * rand() / (float)RAND_MAX; };
+
+		std::vector<glm::mat4> views;
+		for (int i = 0; i < cameras; i++)
+		{
+			glm::vec3 eye(random(-10.f, 20.f), random(1.f, 6.f), random(-40.f, 0.f));
+			glm::vec3 target(random(-10.f, 20.f), 0.f, random(-40.f, 0.f));
+			views.push_back(glm::lookAt(eye, target, glm::vec3(0.f, 1.f, 0.f)));
+		}
+
+		std::vector<LightClusters::Light> all_lights;
+		for (int i = 0; i < max_lights; i++)
+		{
+			LightClusters::Light light;
+			light.position = glm::vec3(random(-10.f, 20.f), random(2.f, 6.f), random(-40.f, 0.f));
+			light.range = LightClusters::Range(glm::vec3(random(2.f, 50.f)));
+			light.direction = glm::normalize(glm::vec3(random(-1.f, 1.f), -1.f, random(-1.f, 1.f)));
+			// narrow spots, wide cones and point lights
+			light.cos_cone = cos(glm::radians(0.5f * random(20.f, 360.f)));
+			all_lights.push_back(light);
+		}
+
+		std::vector<int> counts;
+		for (int count = 5; count < max_lights; count *= 2)
+			counts.push_back(count);
+		counts.push_back(max_lights);
+
+		struct Row { int lights; double reference; double binned; double per_cluster; size_t missed; };
+		std::vector<Row> rows;
+		LightClusters reference, clusters;
+		for (int count : counts)
+		{
+			std::vector<LightClusters::Light> lights(all_lights.begin(), all_lights.begin() + count);
+
+			Row row;
+			row.lights = count;
+			row.missed = 0;
+			row.reference = best_time(runs, [&]()
+			{
+				for (auto& view : views)
+					reference.BuildReference(view, projection, lights);
+			}) / cameras;
+			row.binned = best_time(runs, [&]()
+			{
+				for (auto& view : views)
+					clusters.Build(view, projection, lights);
+			}) / cameras;
+
+			// the lists may hold lights that miss the froxel, never leave out one that lights it
+			size_t indices = 0;
+			for (auto& view : views)
+			{
+				clusters.Build(view, projection, lights);
+				row.missed += missed_lights(clusters, view, projection, 0.1f, 100.f, lights);
+				indices += clusters.GetIndices().size();
+			}
+			row.per_cluster = indices / (double)(cameras * CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z);
+			rows.push_back(row);
+		}
+
+		printf("\n%dx%dx%d clusters, %d cameras, %u threads\n", CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, cameras, JobSystem::GetInstance().GetThreadCount());
+		printf("%8s %14s %14s %8s %14s %8s %s\n", "lights", "every pair ms", "binned ms", "speedup", "lights/cluster", "missed", "result");
+		for (auto& row : rows)
+			printf("%8d %14.3f %14.3f %7.2fx %14.2f %8zu %s\n", row.lights, row.reference * 1000.0, row.binned * 1000.0,
+				row.reference / row.binned, row.per_cluster, row.missed, row.missed == 0 ? "ok" : "MISSED LIGHTS");
+	}
+
+	void FrustumCulling(int boxes)
+	{
+		const int cameras = 64;
+		const int runs = 5;
+		boxes = std::max(1, boxes);
+
+		// boxes of level pieces scattered and rotated over a large dungeon, the cameras inside it
+		glm::mat4 projection = glm::perspective(glm::radians(45.f), 1080.f / 640.f, 0.1f, 100.f);
+		srand(1);
+		auto random = [](float low, float high) { return low + (high - low) * rand() / (float)RAND_MAX; };
+
+		FrustumCuller culler;
+		for (int i = 0; i < boxes; i++)
+		{
+			glm::vec3 size(random(0.2f, 4.f), random(0.2f, 4.f), random(0.2f, 4.f));
+			glm::mat4 transform = glm::translate(glm::mat4(1.f), glm::vec3(random(-200.f, 200.f), random(0.f, 10.f), random(-200.f, 200.f))) *
+				glm::rotate(glm::mat4(1.f), random(0.f, 6.28f), glm::vec3(0.f, 1.f, 0.f));
+			culler.AddBox(-0.5f * size, 0.5f * size, transform);
+		}
+
+		std::vector<glm::mat4> view_projections;
+		for (int i = 0; i < cameras; i++)
+		{
+			glm::vec3 eye(random(-150.f, 150.f), random(1.f, 6.f), random(-150.f, 150.f));
+			glm::vec3 target = eye + glm::vec3(random(-1.f, 1.f), random(-0.5f, 0.f), random(-1.f, 1.f));
+			view_projections.push_back(projection * glm::lookAt(eye, target, glm::vec3(0.f, 1.f, 0.f)));
+		}
+
+		std::vector<uint8_t> visible, reference;
+		size_t visible_count = 0;
+		double scalar = best_time(runs, [&]()
+		{
+			for (auto& view_projection : view_projections)
+				culler.CullReference(view_projection, reference);
+		}) / cameras;
+		double simd = best_time(runs, [&]()
+		{
+			for (auto& view_projection : view_projections)
+				culler.Cull(view_projection, visible);
+		}) / cameras;
+
+		bool same = true;
+		for (auto& view_projection : view_projections)
+		{
+			visible_count += culler.Cull(view_projection, visible);
+			culler.CullReference(view_projection, reference);
+			same = same && visible == reference;
+		}
+
+		printf("\n%d boxes, %d cameras, %.1f%% visible\n", boxes, cameras, 100.0 * visible_count / ((double)boxes * cameras));
+		printf("%-16s %12s %12s\n", "", "us/frustum", "ns/box");
+		printf("%-16s %12.2f %12.2f\n", "one at a time", scalar * 1e6, scalar * 1e9 / boxes);
+		printf("%-16s %12.2f %12.2f %7.2fx %s\n", "four with SSE", simd * 1e6, simd * 1e9 / boxes, scalar / simd, same ? "identical" : "MISMATCH");
+	}
+
+	void DeferredLighting(Renderer& renderer, SDL_Window* window)
+	{
+		const int frames = 32;
+
+		finish_loading(renderer, window);
+
+		int width, height;
+		SDL_GL_GetDrawableSize(window, &width, &height);
+		const double pixels = (double)width * height;
+		// the targets and the 24 bit depth are read by every full-screen pass, an additive pass also
+		// reads and writes the result: four RGBA32F targets and an RGBA32F result, or the compact
+		// normal, albedo and mask of 4 bytes and an R11G11B10F result
+		const bool compact = (renderer.GetGBufferLayout() == Renderer::GBUFFER_COMPACT);
+		const double gbuffer_bytes = pixels * (compact ? 3 * 4 + 4 : 4 * 16 + 4);
+		const double target_bytes = pixels * (compact ? 4 : 16);
+
+		const int counts[] = { 5, 8, 16, 32, 64, 128, 256 };
+		// the modes in the order of Renderer::LightingMode
+		const int modes = 3;
+		struct Row { int lights; double gpu_ms[modes]; double frame_ms[modes]; };
+		std::vector<Row> rows;
+
+		RendererSettings settings(renderer);
+		srand(1);
+		for (int count : counts)
+		{
+			add_lights(renderer, count);
+
+			Row row;
+			row.lights = count;
+			for (int mode = 0; mode < modes; mode++)
+			{
+				renderer.SetLightingMode((Renderer::LightingMode)mode);
+
+				// the query is read after every frame so it belongs to that one
+				double gpu = 0.0;
+				row.frame_ms[mode] = frame_time(renderer, window, frames, [&]() { gpu += renderer.GetLightingTime(); });
+				row.gpu_ms[mode] = gpu / frames;
+			}
+			rows.push_back(row);
+		}
+		renderer.RemoveAddedLights();
+
+		printf("\n%dx%d, deferred shading GPU time averaged and frame time best of %d frames\n", width, height, frames);
+		printf("%8s %10s %10s %10s %10s %10s %12s %12s %12s\n", "lights", "multi MB", "single MB",
+			"multi ms", "single ms", "cluster ms", "multi frame", "single frame", "cluster frame");
+		for (auto& row : rows)
+		{
+			// the single pass and the clustered pass read the same G-buffer once
+			double multi_bytes = row.lights * (gbuffer_bytes + 2 * target_bytes) - target_bytes;
+			double single_bytes = gbuffer_bytes + target_bytes;
+			printf("%8d %10.1f %10.1f %10.3f %10.3f %10.3f %12.3f %12.3f %12.3f\n", row.lights,
+				multi_bytes / (1024.0 * 1024.0), single_bytes / (1024.0 * 1024.0),
+				row.gpu_ms[0], row.gpu_ms[1], row.gpu_ms[2], row.frame_ms[0], row.frame_ms[1], row.frame_ms[2]);
+		}
+	}
+
+	void LightBounds(Renderer& renderer, SDL_Window* window)
+	{
+		const int frames = 32;
+		const int lights = 32;
+
+		finish_loading(renderer, window);
+		RendererSettings settings(renderer);
+		srand(1);
+		add_lights(renderer, lights);
+		renderer.SetLightingMode(Renderer::LIGHTING_MULTI_PASS);
+
+		int width, height;
+		SDL_GL_GetDrawableSize(window, &width, &height);
+
+		double gpu_ms[2];
+		std::vector<Renderer::LightCoverage> coverage[2];
+		for (int bounded = 0; bounded < 2; bounded++)
+		{
+			renderer.SetLightBounds(bounded != 0);
+			double gpu = 0.0;
+			frame_time(renderer, window, frames, [&]() { gpu += renderer.GetLightingTime(); });
+			gpu_ms[bounded] = gpu / frames;
+			coverage[bounded] = renderer.GetLightCoverage();
+		}
+		renderer.RemoveAddedLights();
+
+		// the first five are the lights of the scene
+		const double screen = (double)width * height;
+		double total_full = 0.0, total_bounded = 0.0, total_shaded = 0.0;
+		printf("\n%dx%d, %d lights, one pass per light, GPU time averaged over %d frames\n", width, height, lights, frames);
+		printf("%6s %14s %14s %14s %10s\n", "light", "full shaded", "scissor", "bounded shaded", "of screen");
+		for (size_t i = 0; i < coverage[1].size(); i++)
+		{
+			printf("%6zu %14u %14u %14u %9.1f%%\n", i, coverage[0][i].shaded, coverage[1][i].bounded,
+				coverage[1][i].shaded, 100.0 * coverage[1][i].shaded / screen);
+			total_full += coverage[0][i].shaded;
+			total_bounded += coverage[1][i].bounded;
+			total_shaded += coverage[1][i].shaded;
+		}
+		printf("%6s %14.0f %14.0f %14.0f %9.1f%%\n", "total", total_full, total_bounded, total_shaded, 100.0 * total_shaded / std::max(1.0, total_full));
+		printf("full screen passes %.3f ms, bounded passes %.3f ms, %.2fx\n", gpu_ms[0], gpu_ms[1], gpu_ms[0] / std::max(gpu_ms[1], 1e-6));
+	}
+
+	void GBufferLayouts(Renderer& renderer, SDL_Window* window)
+	{
+		const int frames = 64;
+
+		finish_loading(renderer, window);
+
+		int width, height;
+		SDL_GL_GetDrawableSize(window, &width, &height);
+
+		struct Row { const char* name; size_t bytes; double gpu_ms; double frame_ms; };
+		std::vector<Row> rows;
+		RendererSettings settings(renderer);
+		for (int layout = 0; layout < 2; layout++)
+		{
+			if (!renderer.SetGBufferLayout((Renderer::GBufferLayout)layout))
+				continue;
+
+			double gpu = 0.0;
+			Row row;
+			row.name = (layout == Renderer::GBUFFER_FULL) ? "RGBA32F" : "compact";
+			row.bytes = renderer.GetGBufferBytes();
+			row.frame_ms = frame_time(renderer, window, frames, [&]() { gpu += renderer.GetLightingTime(); });
+			row.gpu_ms = gpu / frames;
+			rows.push_back(row);
+		}
+
+		printf("\n%dx%d, deferred shading GPU time averaged and frame time best of %d frames\n", width, height, frames);
+		printf("%-10s %12s %10s %12s %12s\n", "layout", "bytes/pixel", "MB", "shading ms", "frame ms");
+		for (auto& row : rows)
+			printf("%-10s %12.0f %10.1f %12.3f %12.3f\n", row.name, (double)row.bytes / ((double)width * height),
+				row.bytes / (1024.0 * 1024.0), row.gpu_ms, row.frame_ms);
+	}
+
+	void ShadowCulling(Renderer& renderer, SDL_Window* window)
+	{
+		const int frames = 64;
+
+		finish_loading(renderer, window);
+
+		struct Row { const char* name; Renderer::CullStatistics shadow; double gpu_ms; double frame_ms; };
+		std::vector<Row> rows;
+		RendererSettings settings(renderer);
+		const char* names[] = { "all nodes", "culled", "cached" };
+		for (int variant = 0; variant < 3; variant++)
+		{
+			renderer.SetFrustumCulling(variant >= 1);
+			renderer.SetShadowCaching(variant >= 2);
+			// the warm up frame renders the caches
+			double gpu = 0.0;
+			Row row;
+			row.name = names[variant];
+			row.frame_ms = frame_time(renderer, window, frames, [&]() { gpu += renderer.GetShadowTime(); });
+			row.gpu_ms = gpu / frames;
+			row.shadow = renderer.GetCullStatistics(Renderer::CULL_PASS_SHADOW);
+			rows.push_back(row);
+		}
+
+		printf("\nshadow maps, GPU time averaged and frame time best of %d frames\n", frames);
+		printf("%-10s %8s %8s %12s %8s %12s %12s\n", "casters", "drawn", "culled", "no receiver", "draws", "shadow ms", "frame ms");
+		for (auto& row : rows)
+			printf("%-10s %8u %8u %12u %8u %12.3f %12.3f\n", row.name, row.shadow.visible, row.shadow.culled,
+				row.shadow.no_receiver, row.shadow.draws, row.gpu_ms, row.frame_ms);
+	}
+
+	void ShadowAtlasBudgets(Renderer& renderer, SDL_Window* window)
+	{
+		const int frames = 64;
+		const size_t budgets[] = { 8, 16, 32, 64, 128 };
+
+		finish_loading(renderer, window);
+
+		RendererSettings settings(renderer);
+		printf("\nshadow atlas and its cache, GPU time of the shadow maps averaged over %d frames\n", frames);
+		printf("%8s %8s %8s %12s  %s\n", "budget", "side", "MB", "shadow ms", "tiles");
+		for (size_t budget : budgets)
+		{
+			if (!renderer.SetShadowBudget(budget * 1024 * 1024))
+				continue;
+
+			// the warm up frame renders the caches
+			double gpu = 0.0;
+			frame_time(renderer, window, frames, [&]() { gpu += renderer.GetShadowTime(); });
+
+			const ShadowAtlas& atlas = renderer.GetShadowAtlas();
+			printf("%8zu %8d %8.1f %12.3f ", budget, atlas.GetSize(), atlas.GetBytes() / (1024.0 * 1024.0), gpu / frames);
+			for (auto& tile : renderer.GetShadowTiles())
+				printf(" %d", tile.size);
+			printf("\n");
+		}
+	}
+
+	void Instancing(Renderer& renderer, SDL_Window* window)
+	{
+		const int frames = 64;
+
+		finish_loading(renderer, window);
+
+		RendererSettings settings(renderer);
+		settings.DrawEveryCaster();
+
+		printf("\ndraw calls of the last frame, frame time best of %d frames\n", frames);
+		printf("%-10s %8s %14s %8s %14s %12s\n", "draws", "nodes", "camera draws", "casters", "shadow draws", "frame ms");
+		for (int instancing = 0; instancing < 2; instancing++)
+		{
+			renderer.SetInstancing(instancing != 0);
+			double frame_ms = frame_time(renderer, window, frames);
+
+			const Renderer::CullStatistics& camera = renderer.GetCullStatistics(Renderer::CULL_PASS_CAMERA);
+			const Renderer::CullStatistics& shadow = renderer.GetCullStatistics(Renderer::CULL_PASS_SHADOW);
+			printf("%-10s %8u %14u %8u %14u %12.3f\n", instancing ? "per mesh" : "per node", camera.visible, camera.draws,
+				shadow.visible, shadow.draws, frame_ms);
+		}
+	}
+
+	void StaticBatching(Renderer& renderer, SDL_Window* window)
+	{
+		const int runs = 4;
+		const int frames = 64;
+
+		finish_loading(renderer, window);
+
+		// the static nodes of the level, copies of them side by side stand for larger levels
+		std::vector<GeometryNode*> level;
+		glm::vec3 level_min(1e30f), level_max(-1e30f);
+		for (GeometryNode* node : renderer.GetNodes())
+		{
+			if (node == nullptr || !node->IsResident() || node->m_dynamic)
+				continue;
+			level.push_back(node);
+			level_min = glm::min(level_min, glm::vec3(node->app_model_matrix[3]) + node->m_aabb.min);
+			level_max = glm::max(level_max, glm::vec3(node->app_model_matrix[3]) + node->m_aabb.max);
+		}
+		const float spacing = level_max.x - level_min.x + 1.f;
+
+		printf("\nstartup cost of the static batch, best of %d merges and uploads\n", runs);
+		printf("%8s %8s %10s %10s %10s %12s %12s\n", "levels", "nodes", "merge ms", "upload ms", "MB", "node draws", "batch draws");
+		for (int copies : { 1, 4, 16, 64 })
+		{
+			std::vector<GeometryNode> nodes;
+			nodes.reserve(level.size() * copies);
+			for (int copy = 0; copy < copies; copy++)
+			{
+				for (GeometryNode* node : level)
+				{
+					nodes.push_back(*node);
+					nodes.back().app_model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(copy * spacing, 0.f, 0.f)) * node->app_model_matrix;
+				}
+			}
+			std::vector<GeometryNode*> pointers;
+			unsigned int node_draws = 0;
+			for (auto& node : nodes)
+			{
+				pointers.push_back(&node);
+				node_draws += (unsigned int)node.parts.size();
+			}
+
+			StaticBatch batch;
+			double merge = best_time(runs, [&]() { batch.Merge(pointers); });
+			double upload = best_time(runs, [&]()
+			{
+				batch.Upload();
+				glFinish();
+			});
+			printf("%8d %8zu %10.3f %10.3f %10.1f %12u %12zu\n", copies, nodes.size(), merge * 1000.0, upload * 1000.0,
+				batch.GetBytes() / (1024.0 * 1024.0), node_draws, batch.GetMaterialCount());
+		}
+
+		RendererSettings settings(renderer);
+		settings.DrawEveryCaster();
+
+		printf("\nframe time of the level, best of %d frames\n", frames);
+		printf("%-10s %8s %14s %14s %12s\n", "draws", "nodes", "camera draws", "shadow draws", "frame ms");
+		for (int batching = 0; batching < 2; batching++)
+		{
+			renderer.SetStaticBatching(batching != 0);
+			double frame_ms = frame_time(renderer, window, frames);
+
+			const Renderer::CullStatistics& camera = renderer.GetCullStatistics(Renderer::CULL_PASS_CAMERA);
+			const Renderer::CullStatistics& shadow = renderer.GetCullStatistics(Renderer::CULL_PASS_SHADOW);
+			printf("%-10s %8u %14u %14u %12.3f\n", batching ? "batched" : "per node", camera.visible, camera.draws, shadow.draws, frame_ms);
+		}
+		printf("batch built in %.3f ms\n", renderer.GetStaticBatchTime());
+	}
+
+	void RenderQueueSorting(Renderer& renderer, SDL_Window* window)
+	{
+		const int frames = 64;
+
+		finish_loading(renderer, window);
+
+		RendererSettings settings(renderer);
+
+		printf("\nbinds issued/skipped in the geometry pass of the last frame, frame time best of %d frames\n", frames);
+		printf("%-8s %-10s %6s %12s %12s %12s %12s %12s %10s\n", "nodes", "order", "draws", "materials", "textures", "vaos", "instances", "uploads", "frame ms");
+		for (int batching = 0; batching < 2; batching++)
+		{
+			renderer.SetStaticBatching(batching != 0);
+			for (int sorting = 0; sorting < 2; sorting++)
+			{
+				renderer.SetRenderQueueSorting(sorting != 0);
+				double frame_ms = frame_time(renderer, window, frames);
+
+				const RenderQueue::Statistics& queue = renderer.GetRenderQueueStatistics();
+				printf("%-8s %-10s %6u %6u/%-5u %6u/%-5u %6u/%-5u %6u/%-5u %6u/%-5u %10.3f\n", batching ? "batched" : "per node", sorting ? "sorted" : "node", queue.draws,
+					queue.material_binds, queue.material_binds_skipped, queue.texture_binds, queue.texture_binds_skipped, queue.vao_binds, queue.vao_binds_skipped,
+					queue.instance_binds, queue.instance_binds_skipped, queue.material_uploads, queue.material_uploads_skipped, frame_ms);
+			}
+		}
+	}
+
+	void IndirectDrawing(Renderer& renderer, SDL_Window* window)
+	{
+		const int frames = 64;
+
+		finish_loading(renderer, window);
+		if (!renderer.IsIndirectDrawingSupported())
+		{
+			printf("\nthe context has neither GL 4.3 nor ARB_multi_draw_indirect with ARB_base_instance\n");
+			return;
+		}
+
+		RendererSettings settings(renderer);
+		settings.DrawEveryCaster();
+
+		printf("\ndraws of the last frame, CPU time of Render and frame time best of %d frames\n", frames);
+		printf("%-8s %-10s %12s %12s %12s %12s %10s\n", "nodes", "draws", "camera draws", "multi-draws", "shadow draws", "render ms", "frame ms");
+		for (int batching = 0; batching < 2; batching++)
+		{
+			renderer.SetStaticBatching(batching != 0);
+			for (int indirect = 0; indirect < 2; indirect++)
+			{
+				renderer.SetIndirectDrawing(indirect != 0);
+				double render_ms = 0.0;
+				double frame_ms = frame_time(renderer, window, frames, {}, &render_ms);
+
+				const RenderQueue::Statistics& queue = renderer.GetRenderQueueStatistics();
+				const Renderer::CullStatistics& shadow = renderer.GetCullStatistics(Renderer::CULL_PASS_SHADOW);
+				printf("%-8s %-10s %12u %12u %12u %12.3f %10.3f%s\n", batching ? "batched" : "per node", indirect ? "indirect" : "per part", queue.draws,
+					queue.multi_draws, shadow.draws, render_ms, frame_ms, (indirect && !renderer.IsIndirectFrame()) ? " (fell back)" : "");
+			}
+		}
+	}
+
+	void MeshArenaUsage(Renderer& renderer, SDL_Window* window)
+	{
+		const int copies = 16;
+		const int rounds = 8;
+
+		finish_loading(renderer, window);
+		AssetManager& assets = AssetManager::GetInstance();
+
+		auto print_arena = [&](const char* label, double ms)
+		{
+			MeshArena::Statistics arena = assets.GetArenaStatistics();
+			printf("%-14s %8zu %8.1f %9.1f%% %9.1f%% %8zu %8zu %9.1f%% %9.1f%% %10.3f\n", label, assets.GetAssetCount(), arena.bytes / (1024.0 * 1024.0),
+				100.f * arena.vertex_occupancy, 100.f * arena.index_occupancy, arena.vertex_free_blocks, arena.index_free_blocks,
+				100.f * arena.vertex_fragmentation, 100.f * arena.index_fragmentation, ms);
+		};
+
+		// the meshes of the level, each of them requested again under other names
+		std::vector<const GeometricMesh*> meshes;
+		for (GeometryNode* node : renderer.GetNodes())
+		{
+			if (node != nullptr && node->IsResident() && node->m_mesh != nullptr &&
+				std::find(meshes.begin(), meshes.end(), node->m_mesh) == meshes.end())
+				meshes.push_back(node->m_mesh);
+		}
+		std::vector<std::string> names;
+		for (int copy = 0; copy < copies; copy++)
+			for (size_t i = 0; i < meshes.size(); i++)
+				names.push_back("ArenaBench" + std::to_string(names.size()));
+
+		// the buffers of a vao and five vertex buffers and an index buffer per asset against the three of the arena
+		printf("\n%zu meshes in one vao, one vertex buffer and one index buffer, %zu buffer objects with a set per mesh\n", assets.GetAssetCount(), assets.GetAssetCount() * 7);
+		printf("%-14s %8s %8s %10s %10s %8s %8s %10s %10s %10s\n", "", "assets", "MB", "vertices", "indices", "v blocks", "i blocks", "v frag", "i frag", "ms");
+		print_arena("level", 0.0);
+
+		std::vector<bool> resident(names.size(), false);
+		auto request = [&](size_t i)
+		{
+			assets.RequestAsset(names[i], meshes[i % meshes.size()]);
+			resident[i] = true;
+		};
+		auto release = [&](size_t i)
+		{
+			assets.ReleaseAsset(names[i]);
+			resident[i] = false;
+		};
+
+		double upload = best_time(1, [&]()
+		{
+			for (size_t i = 0; i < names.size(); i++)
+				request(i);
+			glFinish();
+		});
+		print_arena("uploaded", upload * 1000.0);
+
+		// streaming out a random half of the copies and back in, the holes they leave are reused first fit
+		srand(1);
+		for (int round = 0; round < rounds; round++)
+		{
+			double churn = best_time(1, [&]()
+			{
+				for (size_t i = 0; i < names.size(); i++)
+					if (rand() % 2 == 0)
+						release(i);
+				for (size_t i = 0; i < names.size(); i++)
+					if (!resident[i] && rand() % 2 == 0)
+						request(i);
+				glFinish();
+			});
+			print_arena(("churn " + std::to_string(round + 1)).c_str(), churn * 1000.0);
+		}
+
+		// the level still renders from the same vao
+		double frame_ms = frame_time(renderer, window, 16);
+
+		for (size_t i = 0; i < names.size(); i++)
+			release(i);
+		print_arena("released", 0.0);
+		printf("frame time of the level with the copies in the arena %.3f ms\n", frame_ms);
+	}
+};
@@ -0,0 +1,60 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+// Measurements that run from the command line instead of the game,
+// e.g. OpenGl_DungeonGame.exe --bench obj Assets/Dungeon
+class Renderer;
+struct SDL_Window;
+
+namespace Benchmarks
+{
+	// runs the benchmark named by the arguments, returns false if there was none
+	bool Run(int argc, char* argv[]);
+	// the benchmarks that draw need the window and the renderer of the game, Run skips them
+	bool NeedsRenderer(int argc, char* argv[]);
+	// runs the benchmark that draws named by the arguments once the renderer is initialized
+	void RunWithRenderer(int argc, char* argv[], Renderer& renderer, SDL_Window* window);
+
+	// MB/s of the stdio and the memory mapped OBJ readers over a folder
+	void OBJParsing(const char* folder);
+	// vertex count and memory of the welded meshes against three vertices per triangle
+	void VertexWelding(const char* folder);
+	// parsing the OBJ files against reading their .meshbin
+	void BinaryMeshes(const char* folder);
+	// reading the loose files against reading them from a cooked archive
+	void PackedFiles(const char* folder, const char* archive);
+	// scheduling overhead per job and scaling of the JobSystem from 1 to max_threads (0 is every core)
+	void JobScheduling(unsigned int max_threads);
+	// decoding every texture of a folder one after the other against a parallel batch
+	void TextureDecoding(const char* folder);
+	// format, size and PSNR of every texture of a folder encoded into BC blocks
+	void TextureCompression(const char* folder);
+	// light lists of the froxel grid binned in parallel against testing every light in every cluster, for 5 to max_lights lights
+	void LightClustering(int max_lights);
+	// frustum culling of boxes four at a time with SSE against one at a time
+	void FrustumCulling(int boxes);
+	// GPU time and G-buffer traffic of one additive pass per light, one pass for every light and one pass over the
+	// light lists of the clusters, from 5 to 256 lights
+	void DeferredLighting(Renderer& renderer, SDL_Window* window);
+	// pixels and GPU time of the passes of the multi-pass mode over the whole screen against their scissor rectangles and depths
+	void LightBounds(Renderer& renderer, SDL_Window* window);
+	// memory, shading time and frame time of the RGBA32F G-buffer against the compact one
+	void GBufferLayouts(Renderer& renderer, SDL_Window* window);
+	// the shadow maps drawing every node, culling their casters and copying the static ones from a cache
+	void ShadowCulling(Renderer& renderer, SDL_Window* window);
+	// the tiles of the shadow lights and the shadow time for a few budgets of the shadow atlas
+	void ShadowAtlasBudgets(Renderer& renderer, SDL_Window* window);
+	// draw calls and frame time with a draw per node against a draw per mesh
+	void Instancing(Renderer& renderer, SDL_Window* window);
+	// merge and upload time, memory and draws of the static batch for the level repeated up to
+	// 64 times, and the frame time of the level with and without it
+	void StaticBatching(Renderer& renderer, SDL_Window* window);
+	// binds, material uploads and frame time of the geometry pass drawing in node order against the sorted render queue
+	void RenderQueueSorting(Renderer& renderer, SDL_Window* window);
+	// CPU time of Render and frame time of the draws per part against one multi-draw per pass
+	void IndirectDrawing(Renderer& renderer, SDL_Window* window);
+	// occupancy and fragmentation of the mesh arena while copies of the meshes of the level stream in and out
+	void MeshArenaUsage(Renderer& renderer, SDL_Window* window);
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include "FrustumCuller.h"
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+FrustumCuller::FrustumCuller()
+{
+	m_count = 0;
+}
+
+void FrustumCuller::ExtractPlanes(const glm::mat4& m, glm::vec4 planes[6])
+{
+	// the rows of the column major matrix
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	planes[0] = row3 + row0;
+	planes[1] = row3 - row0;
+	planes[2] = row3 + row1;
+	planes[3] = row3 - row1;
+	planes[4] = row3 + row2;
+	planes[5] = row3 - row2;
+}
+
+bool FrustumCuller::ProjectBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& transform, glm::vec3& ndc_min, glm::vec3& ndc_max)
+{
+	ndc_min = glm::vec3(1e30f);
+	ndc_max = glm::vec3(-1e30f);
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 position((corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y, (corner & 4) ? max.z : min.z);
+		glm::vec4 clip = transform * glm::vec4(position, 1.f);
+		if (clip.w <= 1e-6f)
+			return false;
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		ndc_min = glm::min(ndc_min, ndc);
+		ndc_max = glm::max(ndc_max, ndc);
+	}
+	return true;
+}
+
+void FrustumCuller::Clear()
+{
+	m_count = 0;
+	m_center_x.clear();
+	m_center_y.clear();
+	m_center_z.clear();
+	m_extent_x.clear();
+	m_extent_y.clear();
+	m_extent_z.clear();
+}
+
+size_t FrustumCuller::AddBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& transform)
+{
+	// the transformed center and the extent along every world axis of the transformed box
+	glm::vec3 center = glm::vec3(transform * glm::vec4(0.5f * (min + max), 1.f));
+	glm::vec3 half = 0.5f * (max - min);
+	glm::vec3 extent(0.f);
+	for (int axis = 0; axis < 3; axis++)
+		extent += glm::abs(glm::vec3(transform[axis])) * half[axis];
+
+	// the padding boxes are tested with the others and dropped from the results
+	size_t index = m_count++;
+	if (index % 4 == 0)
+	{
+		m_center_x.resize(index + 4, 0.f);
+		m_center_y.resize(index + 4, 0.f);
+		m_center_z.resize(index + 4, 0.f);
+		m_extent_x.resize(index + 4, 0.f);
+		m_extent_y.resize(index + 4, 0.f);
+		m_extent_z.resize(index + 4, 0.f);
+	}
+	m_center_x[index] = center.x;
+	m_center_y[index] = center.y;
+	m_center_z[index] = center.z;
+	m_extent_x[index] = extent.x;
+	m_extent_y[index] = extent.y;
+	m_extent_z[index] = extent.z;
+	return index;
+}
+
+size_t FrustumCuller::Cull(const glm::mat4& view_projection, std::vector<uint8_t>& visible) const
+{
+#ifdef FRUSTUM_CULLER_SSE
+	glm::vec4 planes[6];
+	ExtractPlanes(view_projection, planes);
+
+	__m128 normal_x[6], normal_y[6], normal_z[6], distance[6], abs_x[6], abs_y[6], abs_z[6];
+	for (int p = 0; p < 6; p++)
+	{
+		normal_x[p] = _mm_set1_ps(planes[p].x);
+		normal_y[p] = _mm_set1_ps(planes[p].y);
+		normal_z[p] = _mm_set1_ps(planes[p].z);
+		distance[p] = _mm_set1_ps(planes[p].w);
+		abs_x[p] = _mm_set1_ps(fabsf(planes[p].x));
+		abs_y[p] = _mm_set1_ps(fabsf(planes[p].y));
+		abs_z[p] = _mm_set1_ps(fabsf(planes[p].z));
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	visible.resize(m_center_x.size());
+	size_t count = 0;
+	for (size_t i = 0; i < m_center_x.size(); i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&m_center_x[i]), cy = _mm_loadu_ps(&m_center_y[i]), cz = _mm_loadu_ps(&m_center_z[i]);
+		__m128 ex = _mm_loadu_ps(&m_extent_x[i]), ey = _mm_loadu_ps(&m_extent_y[i]), ez = _mm_loadu_ps(&m_extent_z[i]);
+
+		// the signed distance of the center plus the projected radius of the box, negative outside
+		__m128 outside = zero;
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(normal_x[p], cx), _mm_mul_ps(normal_y[p], cy)), _mm_mul_ps(normal_z[p], cz)), distance[p]);
+			__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_x[p], ex), _mm_mul_ps(abs_y[p], ey)), _mm_mul_ps(abs_z[p], ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for (int lane = 0; lane < 4; lane++)
+			visible[i + lane] = (mask & (1 << lane)) ? 0 : 1;
+	}
+
+	visible.resize(m_count);
+	for (size_t i = 0; i < m_count; i++)
+		count += visible[i];
+	return count;
+#else
+	return CullReference(view_projection, visible);
+#endif
+}
+
+size_t FrustumCuller::CullReference(const glm::mat4& view_projection, std::vector<uint8_t>& visible) const
+{
+	glm::vec4 planes[6];
+	ExtractPlanes(view_projection, planes);
+
+	visible.resize(m_count);
+	size_t count = 0;
+	for (size_t i = 0; i < m_count; i++)
+	{
+		bool outside = false;
+		for (int p = 0; p < 6; p++)
+		{
+			float d = planes[p].x * m_center_x[i] + planes[p].y * m_center_y[i] + planes[p].z * m_center_z[i] + planes[p].w;
+			float r = fabsf(planes[p].x) * m_extent_x[i] + fabsf(planes[p].y) * m_extent_y[i] + fabsf(planes[p].z) * m_extent_z[i];
+			outside = outside || (d + r < 0.f);
+		}
+		visible[i] = outside ? 0 : 1;
+		count += visible[i];
+	}
+	return count;
+}
@@ -0,0 +1,38 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include "glm\glm.hpp"
+#include <cstdint>
+#include <vector>
+
+// Frustum culling of world space boxes, four boxes per SSE instruction
+// the boxes are kept as centers and half extents in SoA arrays padded to a multiple of four,
+// a box is culled when it is entirely on the outer side of one of the six planes
+class FrustumCuller
+{
+	std::vector<float> m_center_x, m_center_y, m_center_z;
+	std::vector<float> m_extent_x, m_extent_y, m_extent_z;
+	size_t m_count;
+
+public:
+	FrustumCuller();
+
+	// the planes of a view-projection (left, right, bottom, top, near, far), the normals point inside
+	// they are not normalized, the test only needs the sign
+	static void ExtractPlanes(const glm::mat4& view_projection, glm::vec4 planes[6]);
+	// the normalized device bounds of the corners of a box under a projection, false when
+	// a corner is behind the eye and the bounds are meaningless
+	static bool ProjectBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& transform, glm::vec3& ndc_min, glm::vec3& ndc_max);
+
+	void Clear();
+	// the world space bounds of a local box under a transform, returns the index of the box
+	size_t AddBox(const glm::vec3& min, const glm::vec3& max, const glm::mat4& transform);
+	size_t Size() const { return m_count; }
+
+	// visible[i] is 1 for the boxes inside or across the frustum, returns how many are visible
+	size_t Cull(const glm::mat4& view_projection, std::vector<uint8_t>& visible) const;
+	// the same test one box at a time without SSE
+	size_t CullReference(const glm::mat4& view_projection, std::vector<uint8_t>& visible) const;
+};
+
+#endif
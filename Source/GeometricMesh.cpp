@@ -4,7 +4,8 @@
 
 GeometricMesh::GeometricMesh()
 {
-
+	aabb_min = glm::vec3(0.f);
+	aabb_max = glm::vec3(0.f);
 }
 
 
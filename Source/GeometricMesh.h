@@ -35,6 +35,13 @@ public:
 	std::vector<glm::vec2> textureCoord;
 	std::vector<glm::vec3> tangents;
 	std::vector<glm::vec3> bitangents;
+	// triangles of the welded vertices, when empty every three vertices form a triangle
+	// the object ranges (start, end) index this array instead of the vertices
+	std::vector<unsigned int> indices;
+
+	// bounds of the vertices
+	glm::vec3 aabb_min;
+	glm::vec3 aabb_max;
 };
 
 #endif
\ No newline at end of file
@@ -3,14 +3,27 @@
 #include <glm/gtc/type_ptr.hpp>
 #include "TextureManager.h"
 
-GeometryNode::GeometryNode() { /* Empty */ }
+GeometryNode::GeometryNode()
+{
+	m_vao = 0;
+	m_indexed = false;
+	m_dynamic = false;
+	m_mesh = nullptr;
+	m_batched = false;
+	m_arena_range = {};
+	m_aabb.min = m_aabb.max = m_aabb.center = glm::vec3(0.f);
+}
 
 GeometryNode::~GeometryNode() { /* Empty */ }
 
-void GeometryNode::Init(const std::string & name, GeometricMesh* mesh)
+void GeometryNode::Init(const std::string & name, const GeometricMesh* mesh, bool requestTextures)
 {
 	this->m_vao = AssetManager::GetInstance().RequestAsset(name, mesh);
+	this->m_indexed = !mesh->indices.empty();
+	this->m_mesh = mesh;
+	AssetManager::GetInstance().GetArenaRange(name, this->m_arena_range);
 
+	const size_t first_part = parts.size();
 	for (int i = 0; i < mesh->objects.size(); i++)
 	{
 		Objects part;
@@ -24,23 +37,70 @@ void GeometryNode::Init(const std::string & name, GeometricMesh* mesh)
 
 		part.shininess = material.shininess;
 		part.metallic = material.metallic;
-		part.diffuse_textureID = (material.textureDiffuse.empty())? 0 : TextureManager::GetInstance().RequestTexture(material.textureDiffuse.c_str());
-		part.mask_textureID = (material.textureSpecular.empty()) ? 0 : TextureManager::GetInstance().RequestTexture(material.textureSpecular.c_str());
-		part.emissive_textureID = (material.textureAmbient.empty()) ? 0 : TextureManager::GetInstance().RequestTexture(material.textureAmbient.c_str());
-		part.normal_textureID = (material.textureNormal.empty())? 0 : TextureManager::GetInstance().RequestTexture(material.textureNormal.c_str());
-		part.bump_textureID = (material.textureBump.empty()) ? 0 : TextureManager::GetInstance().RequestTexture(material.textureBump.c_str());
+		for (int slot = 0; slot < TEXTURE_SLOTS; slot++)
+			TextureID(part, slot) = 0;
 
 		parts.push_back(part);
 	}
 
-	this->m_aabb.min = glm::vec3(std::numeric_limits<float_t>::max());
-	this->m_aabb.max = glm::vec3(-std::numeric_limits<float_t>::max());
-
-	for (auto& v : mesh->vertices)
+	if (requestTextures)
 	{
-		this->m_aabb.min = glm::min(this->m_aabb.min, v);
-		this->m_aabb.max = glm::max(this->m_aabb.max, v);
+		// all textures of the mesh are decoded together
+		std::vector<std::string> files;
+		for (size_t i = 0; i < mesh->objects.size(); i++)
+		{
+			for (int slot = 0; slot < TEXTURE_SLOTS; slot++)
+				files.push_back(TextureFile(mesh->materials[mesh->objects[i].material_id], slot));
+		}
+
+		std::vector<std::string> requested;
+		for (auto& file : files)
+		{
+			if (!file.empty())
+				requested.push_back(file);
+		}
+		std::vector<GLuint> ids;
+		TextureManager::GetInstance().RequestTextures(requested, ids);
+
+		size_t next = 0;
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			if (!files[i].empty())
+				TextureID(parts[first_part + i / TEXTURE_SLOTS], (int)(i % TEXTURE_SLOTS)) = ids[next++];
+		}
 	}
 
+	this->m_aabb.min = mesh->aabb_min;
+	this->m_aabb.max = mesh->aabb_max;
 	this->m_aabb.center = (this->m_aabb.min + this->m_aabb.max) * 0.5f;
+}
+
+const std::string& GeometryNode::TextureFile(const OBJMaterial& material, int slot)
+{
+	switch (slot)
+	{
+		case DIFFUSE_TEXTURE: return material.textureDiffuse;
+		case MASK_TEXTURE: return material.textureSpecular;
+		case EMISSIVE_TEXTURE: return material.textureAmbient;
+		case NORMAL_TEXTURE: return material.textureNormal;
+		default: return material.textureBump;
+	}
+}
+
+GLuint& GeometryNode::TextureID(Objects& part, int slot)
+{
+	switch (slot)
+	{
+		case DIFFUSE_TEXTURE: return part.diffuse_textureID;
+		case MASK_TEXTURE: return part.mask_textureID;
+		case EMISSIVE_TEXTURE: return part.emissive_textureID;
+		case NORMAL_TEXTURE: return part.normal_textureID;
+		default: return part.bump_textureID;
+	}
+}
+
+void GeometryNode::DrawPart(const Objects& part, GLsizei instances) const
+{
+	const GLuint first_index = m_arena_range.first_index + part.start_offset;
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, part.count, GL_UNSIGNED_INT, reinterpret_cast<const void*>(first_index * sizeof(GLuint)), instances, m_arena_range.base_vertex);
 }
\ No newline at end of file
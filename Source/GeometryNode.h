@@ -13,10 +13,12 @@ public:
 	GeometryNode();
 	virtual ~GeometryNode();
 
-	virtual void Init(const std::string & name, class GeometricMesh* mesh);
+	// without requestTextures the texture handles stay 0 and the caller fills them in later
+	virtual void Init(const std::string & name, const class GeometricMesh* mesh, bool requestTextures = true);
 
 	struct Objects
 	{
+		// range of the indices of the mesh, or of the vertices when it is not indexed, which the arena indexes in order
 		unsigned int start_offset;
 		unsigned int count;
 
@@ -40,12 +42,40 @@ public:
 		glm::vec3 center;
 	};
 
+	enum TextureSlot
+	{
+		DIFFUSE_TEXTURE = 0,
+		MASK_TEXTURE,
+		EMISSIVE_TEXTURE,
+		NORMAL_TEXTURE,
+		BUMP_TEXTURE,
+		TEXTURE_SLOTS
+	};
+	// the texture file of a material and the texture handle of a part for a slot
+	static const std::string& TextureFile(const struct OBJMaterial& material, int slot);
+	static GLuint& TextureID(Objects& part, int slot);
+
+	// draw instances of one part with the vao of the arena and its instances bound
+	void DrawPart(const Objects& part, GLsizei instances = 1) const;
+	// false until the mesh has been uploaded
+	bool IsResident() const { return m_vao != 0; }
+
 	std::vector<Objects> parts;
 
 	glm::mat4 model_matrix;
 	glm::mat4 app_model_matrix;
 	aabb m_aabb;
 	GLuint m_vao;
+	bool m_indexed;
+	// moved by the game, drawn into the shadow maps every frame over the cache of the static nodes
+	bool m_dynamic;
+	// the mesh the node was made of, kept by the loader
+	const class GeometricMesh* m_mesh;
+	// merged into the static batch and drawn by it
+	bool m_batched;
+	// the vertices and indices of the mesh in the arena of the AssetManager, the first index
+	// also tells the meshes apart since every node draws with the vao of the arena
+	MeshArena::Range m_arena_range;
 };
 
 #endif
\ No newline at end of file
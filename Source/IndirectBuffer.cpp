@@ -0,0 +1,119 @@
+#include "IndirectBuffer.h"
+#include "Tools.h"
+#include <algorithm>
+#include <cstdio>
+
+IndirectBuffer::IndirectBuffer()
+{
+	m_commands = 0;
+	m_materials = 0;
+	m_command_capacity = 0;
+	m_command_count = 0;
+	m_material_capacity = 0;
+}
+
+IndirectBuffer::~IndirectBuffer()
+{
+	glDeleteBuffers(1, &m_commands);
+	glDeleteBuffers(1, &m_materials);
+}
+
+bool IndirectBuffer::Supported()
+{
+	return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+}
+
+bool IndirectBuffer::Init()
+{
+	glGenBuffers(1, &m_commands);
+	glGenBuffers(1, &m_materials);
+	m_command_capacity = 0;
+	m_command_count = 0;
+	m_material_capacity = 0;
+	return m_commands != 0 && m_materials != 0;
+}
+
+void IndirectBuffer::Begin(size_t commands, size_t instances)
+{
+	// orphan the storage of the last frame like the instance buffer
+	m_command_capacity = std::max(m_command_capacity, std::max<size_t>(commands, 256));
+	m_material_capacity = std::max(m_material_capacity, std::max<size_t>(instances, 256));
+	m_command_count = 0;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commands);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, m_command_capacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, m_materials);
+	glBufferData(GL_ARRAY_BUFFER, m_material_capacity * sizeof(GLint), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+size_t IndirectBuffer::Write(const std::vector<DrawElementsIndirectCommand>& commands)
+{
+	size_t first = m_command_count;
+	if (m_command_count + commands.size() > m_command_capacity)
+	{
+		size_t capacity = std::max(2 * m_command_capacity, m_command_count + commands.size());
+		GLuint grown = Tools::GrowBuffer(m_commands, m_command_count * sizeof(DrawElementsIndirectCommand), capacity * sizeof(DrawElementsIndirectCommand), GL_STREAM_DRAW);
+		if (grown == 0)
+		{
+			printf("IndirectBuffer: could not grow to %zu commands\n", capacity);
+			return WRITE_FAILED;
+		}
+		m_commands = grown;
+		m_command_capacity = capacity;
+	}
+
+	if (!commands.empty())
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commands);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, m_command_count * sizeof(DrawElementsIndirectCommand), commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	m_command_count += commands.size();
+	return first;
+}
+
+bool IndirectBuffer::WriteMaterials(size_t first, const std::vector<GLint>& materials)
+{
+	if (first + materials.size() > m_material_capacity)
+	{
+		// the materials below first belong to the instances of the passes before
+		size_t capacity = std::max(2 * m_material_capacity, first + materials.size());
+		GLuint grown = Tools::GrowBuffer(m_materials, m_material_capacity * sizeof(GLint), capacity * sizeof(GLint), GL_STREAM_DRAW);
+		if (grown == 0)
+		{
+			printf("IndirectBuffer: could not grow to %zu materials\n", capacity);
+			return false;
+		}
+		m_materials = grown;
+		m_material_capacity = capacity;
+	}
+
+	if (!materials.empty())
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_materials);
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(GLint), materials.size() * sizeof(GLint), materials.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	return true;
+}
+
+void IndirectBuffer::BindMaterials()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, m_materials);
+	glEnableVertexAttribArray(MATERIAL_ATTRIBUTE);
+	glVertexAttribIPointer(MATERIAL_ATTRIBUTE, 1, GL_INT, sizeof(GLint), nullptr);
+	glVertexAttribDivisor(MATERIAL_ATTRIBUTE, 1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void IndirectBuffer::Draw(size_t first, size_t count)
+{
+	if (count == 0)
+		return;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commands);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(first * sizeof(DrawElementsIndirectCommand)), (GLsizei)count, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,57 @@
+#ifndef INDIRECT_BUFFER_H
+#define INDIRECT_BUFFER_H
+
+#include "GLEW\glew.h"
+#include <vector>
+
+// the material of an instance of a multi-draw, an index in the materials of the frame
+#define MATERIAL_ATTRIBUTE 13
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	// the first instance of the per-instance attributes
+	GLuint base_instance;
+};
+
+// Draw commands and per-instance materials of the multi-draws, streamed every frame
+// a pass appends its commands and issues them with one glMultiDrawElementsIndirect over the
+// vao of the mesh arena. The base instance of a command selects its matrices in the instance
+// buffer and its materials here, which both have one element per instance. Like the instance
+// buffer they grow when a pass writes past their end
+class IndirectBuffer
+{
+	GLuint m_commands;
+	GLuint m_materials;
+	size_t m_command_capacity;
+	size_t m_command_count;
+	size_t m_material_capacity;
+
+public:
+	IndirectBuffer();
+	~IndirectBuffer();
+
+	// GL 4.3 or ARB_multi_draw_indirect with ARB_base_instance, without them the draws stay per part
+	static bool Supported();
+
+	bool Init();
+
+	// room for the commands of the frame and a material for every instance of the instance buffer
+	void Begin(size_t commands, size_t instances);
+	static const size_t WRITE_FAILED = ~(size_t)0;
+
+	// the index of the first of the commands, WRITE_FAILED if the buffer could not grow and nothing was written
+	size_t Write(const std::vector<DrawElementsIndirectCommand>& commands);
+	// the materials of the instances from first on, false if the buffer could not grow
+	bool WriteMaterials(size_t first, const std::vector<GLint>& materials);
+	// the vao bound reads one material per instance
+	void BindMaterials();
+	// count commands from first with the vao of the arena bound
+	void Draw(size_t first, size_t count);
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "InstanceBuffer.h"
+#include "Tools.h"
+#include <algorithm>
+#include <cstdio>
+
+InstanceBuffer::InstanceBuffer()
+{
+	m_buffer = 0;
+	m_capacity = 0;
+	m_count = 0;
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+	glDeleteBuffers(1, &m_buffer);
+}
+
+bool InstanceBuffer::Init()
+{
+	glGenBuffers(1, &m_buffer);
+	m_capacity = 0;
+	m_count = 0;
+	return m_buffer != 0;
+}
+
+void InstanceBuffer::Begin(size_t count)
+{
+	// orphan the storage of the last frame instead of waiting for the GPU to finish reading it
+	m_capacity = std::max(m_capacity, std::max<size_t>(count, 256));
+	m_count = 0;
+	glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+	glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+size_t InstanceBuffer::Write(const std::vector<InstanceData>& instances)
+{
+	size_t first = m_count;
+	if (m_count + instances.size() > m_capacity)
+	{
+		// the instances written so far are kept, the passes that drew from them are done with them
+		size_t capacity = std::max(2 * m_capacity, m_count + instances.size());
+		GLuint grown = Tools::GrowBuffer(m_buffer, m_count * sizeof(InstanceData), capacity * sizeof(InstanceData), GL_STREAM_DRAW);
+		if (grown == 0)
+		{
+			printf("InstanceBuffer: could not grow to %zu instances\n", capacity);
+			return WRITE_FAILED;
+		}
+		m_buffer = grown;
+		m_capacity = capacity;
+	}
+
+	if (!instances.empty())
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, m_count * sizeof(InstanceData), instances.size() * sizeof(InstanceData), instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	m_count += instances.size();
+	return first;
+}
+
+void InstanceBuffer::Bind(size_t first)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+	for (int column = 0; column < 8; column++)
+	{
+		const GLuint attribute = INSTANCE_ATTRIBUTE + column;
+		glEnableVertexAttribArray(attribute);
+		glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+			reinterpret_cast<const void*>(first * sizeof(InstanceData) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(attribute, 1);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
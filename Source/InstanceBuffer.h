@@ -0,0 +1,44 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include "GLEW\glew.h"
+#include "glm\glm.hpp"
+#include <vector>
+
+// the first vertex attribute of the instances, the world matrix takes 5-8 and the normal matrix 9-12
+#define INSTANCE_ATTRIBUTE 5
+
+struct InstanceData
+{
+	glm::mat4 world;
+	// the inverse transpose of world
+	glm::mat4 normal;
+};
+
+// Per-instance matrices of the instanced draws, streamed every frame
+// Begin orphans the storage of the last frame, every pass appends the instances of its
+// groups with Write and Bind points the instance attributes of the bound vao at a group.
+// A Write past the end grows the buffer, the next frames begin at the grown size
+class InstanceBuffer
+{
+	GLuint m_buffer;
+	size_t m_capacity;
+	size_t m_count;
+
+public:
+	InstanceBuffer();
+	~InstanceBuffer();
+
+	bool Init();
+
+	// room for at least count instances this frame
+	void Begin(size_t count);
+	static const size_t WRITE_FAILED = ~(size_t)0;
+
+	// the index of the first of the instances, WRITE_FAILED if the buffer could not grow and nothing was written
+	size_t Write(const std::vector<InstanceData>& instances);
+	// the vao bound reads one instance per draw instance from first on
+	void Bind(size_t first);
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+thread_local unsigned int JobSystem::queueIndex = 0;
+
+void JobCounter::Add(int count)
+{
+	// the first job of a child group keeps the parent unfinished
+	if (m_pending.fetch_add(count) == 0 && m_parent != nullptr)
+		m_parent->Add(1);
+}
+
+void JobCounter::Finish()
+{
+	// the last decrement lets Wait return and the counter go out of scope, nothing of this is read after it
+	JobCounter* parent = m_parent;
+	if (m_pending.fetch_sub(1) == 1 && parent != nullptr)
+		parent->Finish();
+}
+
+JobSystem::JobSystem()
+{
+	queued = 0;
+	sleeping = 0;
+	quit = false;
+	executed = 0;
+	stolen = 0;
+	singleThreaded = false;
+
+	this->Init(0);
+}
+
+JobSystem::~JobSystem()
+{
+	this->Shutdown();
+}
+
+void JobSystem::Init(unsigned int threads)
+{
+	this->Shutdown();
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	singleThreaded = (threads == 1);
+	quit = false;
+
+	for (unsigned int i = 0; i < threads; i++)
+		queues.emplace_back(new WorkQueue());
+
+	if (!singleThreaded)
+	{
+		for (unsigned int i = 1; i < threads; i++)
+			workers.emplace_back(&JobSystem::worker_loop, this, i);
+	}
+}
+
+void JobSystem::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		quit = true;
+	}
+	wake.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+	workers.clear();
+	queues.clear();
+	queued = 0;
+}
+
+void JobSystem::Run(JobCounter& counter, Job job)
+{
+	counter.Add(1);
+
+	if (singleThreaded || queues.empty())
+	{
+		QueuedJob now = { std::move(job), &counter };
+		execute(now);
+		return;
+	}
+
+	WorkQueue& queue = *queues[queueIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back({ std::move(job), &counter });
+	}
+
+	// a worker counts itself as sleeping before it checks for jobs, so either it sees
+	// this job or this sees it sleeping
+	queued++;
+	if (sleeping.load() > 0)
+	{
+		{ std::lock_guard<std::mutex> lock(wakeMutex); }
+		wake.notify_one();
+	}
+}
+
+void JobSystem::ParallelFor(JobCounter& counter, size_t count, size_t grain, const std::function<void(size_t, size_t)>& function)
+{
+	// the ranges share one copy, the caller's function may be gone before they run
+	auto shared = std::make_shared<std::function<void(size_t, size_t)>>(function);
+	grain = std::max<size_t>(1, grain);
+	for (size_t begin = 0; begin < count; begin += grain)
+	{
+		size_t end = std::min(count, begin + grain);
+		this->Run(counter, [shared, begin, end]() { (*shared)(begin, end); });
+	}
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (!counter.IsDone())
+	{
+		QueuedJob job;
+		if (take_job(queueIndex, job))
+			execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+bool JobSystem::take_job(unsigned int index, QueuedJob& job)
+{
+	if (queues.empty())
+		return false;
+
+	// the newest job of the own deque is the one with the warmest data
+	{
+		WorkQueue& own = *queues[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.empty())
+		{
+			job = std::move(own.jobs.back());
+			own.jobs.pop_back();
+			queued--;
+			return true;
+		}
+	}
+
+	// steal the oldest job of the next deque that has one
+	const size_t count = queues.size();
+	for (size_t i = 1; i < count; i++)
+	{
+		WorkQueue& victim = *queues[(index + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty())
+		{
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			queued--;
+			stolen.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::execute(QueuedJob& job)
+{
+	job.function();
+	executed.fetch_add(1, std::memory_order_relaxed);
+	job.counter->Finish();
+}
+
+void JobSystem::worker_loop(unsigned int index)
+{
+	queueIndex = index;
+
+	while (!quit.load())
+	{
+		QueuedJob job;
+		if (take_job(index, job))
+		{
+			execute(job);
+			continue;
+		}
+
+		// a short spin before sleeping, jobs often come in bursts
+		bool found = false;
+		for (int spin = 0; spin < 64 && !found; spin++)
+		{
+			std::this_thread::yield();
+			found = queued.load() > 0;
+		}
+		if (found)
+			continue;
+
+		sleeping++;
+		{
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wake.wait(lock, [this]() { return quit.load() || queued.load() > 0; });
+		}
+		sleeping--;
+	}
+}
+
+JobSystem::Statistics JobSystem::GetStatistics() const
+{
+	Statistics statistics;
+	statistics.executed = executed.load();
+	statistics.stolen = stolen.load();
+	return statistics;
+}
+
+void JobSystem::ResetStatistics()
+{
+	executed = 0;
+	stolen = 0;
+}
@@ -0,0 +1,123 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// number of unfinished jobs of a group, JobSystem::Wait returns when it reaches zero
+// a counter with a parent keeps the parent unfinished until its own jobs are done, so a job
+// can split its work into child jobs and whoever waits for the parent also waits for them
+// (add the children from inside the parent job, while the parent is still unfinished)
+class JobCounter
+{
+public:
+	explicit JobCounter(JobCounter* parent = nullptr) : m_pending(0), m_parent(parent) {}
+
+	bool IsDone() const { return m_pending.load() == 0; }
+
+private:
+	friend class JobSystem;
+
+	void Add(int count);
+	void Finish();
+
+	std::atomic<int> m_pending;
+	JobCounter* m_parent;
+
+	JobCounter(const JobCounter&);
+	void operator=(const JobCounter&);
+};
+
+// Singleton Class of the work stealing Job System
+// every worker owns a deque, it pushes and pops its own jobs at the back and steals
+// the oldest jobs of the others from the front. The threads that are not workers
+// (the main thread) share the first deque. A thread that waits for a counter runs
+// queued jobs until the counter is done, so jobs can wait for their children.
+class JobSystem
+{
+public:
+	typedef std::function<void()> Job;
+
+	struct Statistics
+	{
+		uint64_t executed;
+		uint64_t stolen;
+	};
+
+protected:
+	struct QueuedJob
+	{
+		Job function;
+		JobCounter* counter;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<QueuedJob> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> workers;
+
+	// jobs that are in a queue and workers that sleep until there are some
+	std::atomic<int> queued;
+	std::atomic<int> sleeping;
+	std::atomic<bool> quit;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+
+	std::atomic<uint64_t> executed;
+	std::atomic<uint64_t> stolen;
+
+	bool singleThreaded;
+
+	// the queue of the calling thread, 0 for the threads that are not workers
+	static thread_local unsigned int queueIndex;
+
+	void worker_loop(unsigned int index);
+	bool take_job(unsigned int index, QueuedJob& job);
+	void execute(QueuedJob& job);
+
+public:
+	// get the static instance of Job System, it starts with a worker on every core
+	static JobSystem& GetInstance()
+	{
+		static JobSystem jobs;
+		return jobs;
+	}
+	~JobSystem();
+
+	// restart with threads in total, counting the calling thread (0 uses every core)
+	// 1 is the deterministic single thread mode: every job runs on the thread that
+	// submits it, at once and in submission order, which is what a debugger wants
+	// only call it while no jobs are running
+	void Init(unsigned int threads = 0);
+	void Shutdown();
+
+	unsigned int GetThreadCount() const { return (unsigned int)workers.size() + 1; }
+	bool IsSingleThreaded() const { return singleThreaded; }
+
+	// queue a job on the calling thread's deque, the counter counts it until it finished
+	void Run(JobCounter& counter, Job job);
+	// split [0, count) in ranges of at most grain items and run function(begin, end) on each
+	void ParallelFor(JobCounter& counter, size_t count, size_t grain, const std::function<void(size_t, size_t)>& function);
+	// run queued jobs on the calling thread until the counter is done
+	void Wait(JobCounter& counter);
+
+	Statistics GetStatistics() const;
+	void ResetStatistics();
+
+protected:
+	JobSystem();
+	void operator=(JobSystem const&);
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "LZ4.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const size_t min_match = 4;
+	// the last match has to start 12 bytes before the end and the last 5 bytes are always literals
+	const size_t match_limit = 12;
+	const size_t last_literals = 5;
+	const size_t max_offset = 65535;
+	const int hash_bits = 16;
+
+	inline uint32_t read32(const char* p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t hash_sequence(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - hash_bits);
+	}
+
+	// lengths of 15 and more continue in bytes of 255
+	inline char* write_length(char* op, size_t length)
+	{
+		while (length >= 255)
+		{
+			*op++ = (char)255;
+			length -= 255;
+		}
+		*op++ = (char)length;
+		return op;
+	}
+}
+
+namespace LZ4
+{
+	size_t CompressBound(size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	size_t Compress(const char* source, size_t size, char* destination, size_t capacity)
+	{
+		if (capacity < CompressBound(size))
+			return 0;
+
+		std::vector<uint32_t> table(size_t(1) << hash_bits, 0);
+
+		const char* ip = source;
+		const char* anchor = source;
+		const char* const end = source + size;
+		const char* const match_end = (size > match_limit) ? end - match_limit : source;
+		char* op = destination;
+
+		// position 0 can not be told apart from an empty slot, so matching starts at 1
+		if (size > match_limit)
+			ip++;
+
+		while (ip < match_end)
+		{
+			uint32_t sequence = read32(ip);
+			uint32_t& slot = table[hash_sequence(sequence)];
+			const char* candidate = source + slot;
+			slot = (uint32_t)(ip - source);
+
+			if (candidate == source || ip - candidate > (ptrdiff_t)max_offset || read32(candidate) != sequence)
+			{
+				ip++;
+				continue;
+			}
+
+			// extend the match backwards over the pending literals and forwards up to the limit
+			while (ip > anchor && candidate > source && ip[-1] == candidate[-1])
+			{
+				ip--;
+				candidate--;
+			}
+			const char* match = ip + min_match;
+			const char* reference = candidate + min_match;
+			const char* const forward_limit = end - last_literals;
+			while (match < forward_limit && *match == *reference)
+			{
+				match++;
+				reference++;
+			}
+
+			size_t literals = (size_t)(ip - anchor);
+			size_t match_length = (size_t)(match - ip) - min_match;
+			uint16_t offset = (uint16_t)(ip - candidate);
+
+			char* token = op++;
+			*token = (char)(((literals >= 15 ? 15 : literals) << 4) | (match_length >= 15 ? 15 : match_length));
+			if (literals >= 15) op = write_length(op, literals - 15);
+			memcpy(op, anchor, literals);
+			op += literals;
+			*op++ = (char)(offset & 0xff);
+			*op++ = (char)(offset >> 8);
+			if (match_length >= 15) op = write_length(op, match_length - 15);
+
+			ip = anchor = match;
+		}
+
+		// the rest are literals
+		size_t literals = (size_t)(end - anchor);
+		*op++ = (char)((literals >= 15 ? 15 : literals) << 4);
+		if (literals >= 15) op = write_length(op, literals - 15);
+		memcpy(op, anchor, literals);
+		op += literals;
+
+		return (size_t)(op - destination);
+	}
+
+	bool Decompress(const char* source, size_t compressed_size, char* destination, size_t size)
+	{
+		const unsigned char* ip = reinterpret_cast<const unsigned char*>(source);
+		const unsigned char* const input_end = ip + compressed_size;
+		char* op = destination;
+		char* const output_end = destination + size;
+
+		while (ip < input_end)
+		{
+			unsigned int token = *ip++;
+
+			size_t literals = token >> 4;
+			if (literals == 15)
+			{
+				unsigned char extra;
+				do
+				{
+					if (ip >= input_end) return false;
+					extra = *ip++;
+					literals += extra;
+				} while (extra == 255);
+			}
+			if ((size_t)(input_end - ip) < literals || (size_t)(output_end - op) < literals)
+				return false;
+			memcpy(op, ip, literals);
+			ip += literals;
+			op += literals;
+
+			// the last sequence has no match
+			if (ip == input_end)
+				break;
+
+			if (input_end - ip < 2) return false;
+			size_t offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+			if (offset == 0 || offset > (size_t)(op - destination))
+				return false;
+
+			size_t match_length = token & 15;
+			if (match_length == 15)
+			{
+				unsigned char extra;
+				do
+				{
+					if (ip >= input_end) return false;
+					extra = *ip++;
+					match_length += extra;
+				} while (extra == 255);
+			}
+			match_length += min_match;
+			if ((size_t)(output_end - op) < match_length)
+				return false;
+
+			// the match can overlap what it writes, so it is copied byte by byte
+			const char* match = op - offset;
+			for (size_t i = 0; i < match_length; i++)
+				op[i] = match[i];
+			op += match_length;
+		}
+
+		return op == output_end;
+	}
+};
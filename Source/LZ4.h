@@ -0,0 +1,20 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <cstddef>
+
+// LZ4 block format (no frame header), compatible with the reference lz4 library
+namespace LZ4
+{
+	// largest compressed size of size bytes
+	size_t CompressBound(size_t size);
+
+	// returns the compressed size, 0 if it did not fit in capacity
+	// the output only depends on the input, so the same data always compresses the same way
+	size_t Compress(const char* source, size_t size, char* destination, size_t capacity);
+
+	// decompresses exactly size bytes, false if the block is damaged
+	bool Decompress(const char* source, size_t compressed_size, char* destination, size_t size);
+};
+
+#endif
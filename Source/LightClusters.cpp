@@ -0,0 +1,244 @@
+#include "LightClusters.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+
+const float LightClusters::LIGHT_CUTOFF = 0.02f;
+
+float LightClusters::Range(const glm::vec3& color)
+{
+	return sqrtf(std::max(color.r, std::max(color.g, color.b)) / LIGHT_CUTOFF);
+}
+
+LightClusters::LightClusters()
+{
+	m_near = 0.1f;
+	m_far = 100.f;
+	m_cluster_buffer = 0;
+	m_cluster_texture = 0;
+	m_index_buffer = 0;
+	m_index_texture = 0;
+}
+
+LightClusters::~LightClusters()
+{
+	glDeleteTextures(1, &m_cluster_texture);
+	glDeleteTextures(1, &m_index_texture);
+	glDeleteBuffers(1, &m_cluster_buffer);
+	glDeleteBuffers(1, &m_index_buffer);
+}
+
+void LightClusters::setup(const glm::mat4& view, const glm::mat4& projection, const std::vector<Light>& lights)
+{
+	// the planes of a perspective projection
+	m_near = projection[3][2] / (projection[2][2] - 1.f);
+	m_far = projection[3][2] / (projection[2][2] + 1.f);
+
+	for (int z = 0; z < CLUSTERS_Z; z++)
+	{
+		Slice& slice = m_slices[z];
+		slice.z_near = m_near * powf(m_far / m_near, z / (float)CLUSTERS_Z);
+		slice.z_far = m_near * powf(m_far / m_near, (z + 1) / (float)CLUSTERS_Z);
+
+		// a tile spans its NDC range at every depth of the slice
+		for (int x = 0; x < CLUSTERS_X; x++)
+		{
+			float t0 = (-1.f + 2.f * x / CLUSTERS_X) / projection[0][0];
+			float t1 = (-1.f + 2.f * (x + 1) / CLUSTERS_X) / projection[0][0];
+			slice.x_min[x] = std::min(t0 * slice.z_near, t0 * slice.z_far);
+			slice.x_max[x] = std::max(t1 * slice.z_near, t1 * slice.z_far);
+		}
+		for (int y = 0; y < CLUSTERS_Y; y++)
+		{
+			float t0 = (-1.f + 2.f * y / CLUSTERS_Y) / projection[1][1];
+			float t1 = (-1.f + 2.f * (y + 1) / CLUSTERS_Y) / projection[1][1];
+			slice.y_min[y] = std::min(t0 * slice.z_near, t0 * slice.z_far);
+			slice.y_max[y] = std::max(t1 * slice.z_near, t1 * slice.z_far);
+		}
+	}
+
+	m_lights.resize(lights.size());
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		ViewLight& light = m_lights[i];
+		light.position = glm::vec3(view * glm::vec4(lights[i].position, 1.f));
+		light.direction = glm::normalize(glm::vec3(view * glm::vec4(lights[i].direction, 0.f)));
+		light.range = lights[i].range;
+		light.cos_cone = lights[i].cos_cone;
+		light.sin_cone = sqrtf(std::max(0.f, 1.f - light.cos_cone * light.cos_cone));
+	}
+
+	m_clusters.resize(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z);
+}
+
+bool LightClusters::reaches(const ViewLight& light, int x, int y, int z) const
+{
+	const Slice& slice = m_slices[z];
+	glm::vec3 box_min(slice.x_min[x], slice.y_min[y], -slice.z_far);
+	glm::vec3 box_max(slice.x_max[x], slice.y_max[y], -slice.z_near);
+
+	// the sphere of the range against the bounds of the froxel
+	glm::vec3 closest = glm::clamp(light.position, box_min, box_max);
+	glm::vec3 offset = closest - light.position;
+	if (glm::dot(offset, offset) > light.range * light.range)
+		return false;
+
+	// cones wider than a hemisphere only use the sphere
+	if (light.cos_cone <= 0.f)
+		return true;
+
+	// the cone against the bounding sphere of the froxel
+	glm::vec3 center = 0.5f * (box_min + box_max);
+	float radius = 0.5f * glm::length(box_max - box_min);
+	glm::vec3 v = center - light.position;
+	float along = glm::dot(v, light.direction);
+	float across = sqrtf(std::max(0.f, glm::dot(v, v) - along * along));
+	float distance = light.cos_cone * across - light.sin_cone * along;
+
+	return !(distance > radius || along > light.range + radius || along < -radius);
+}
+
+void LightClusters::bin_slice(int z)
+{
+	const Slice& slice = m_slices[z];
+	uint32_t* counts = m_slice_counts[z];
+	std::fill(counts, counts + CLUSTERS_X * CLUSTERS_Y, 0u);
+
+	// (cluster of the slice, light) in light order, only the tiles the bounds of the sphere overlap are tested
+	std::vector<uint32_t> hits;
+	for (size_t i = 0; i < m_lights.size(); i++)
+	{
+		const ViewLight& light = m_lights[i];
+		if (light.position.z - light.range > -slice.z_near || light.position.z + light.range < -slice.z_far)
+			continue;
+
+		for (int y = 0; y < CLUSTERS_Y; y++)
+		{
+			if (slice.y_max[y] < light.position.y - light.range || slice.y_min[y] > light.position.y + light.range)
+				continue;
+
+			for (int x = 0; x < CLUSTERS_X; x++)
+			{
+				if (slice.x_max[x] < light.position.x - light.range || slice.x_min[x] > light.position.x + light.range)
+					continue;
+
+				if (reaches(light, x, y, z))
+				{
+					uint32_t cluster = x + CLUSTERS_X * y;
+					hits.push_back(cluster << 16 | (uint32_t)i);
+					counts[cluster]++;
+				}
+			}
+		}
+	}
+
+	// counting sort by cluster keeps the light order of every list
+	uint32_t starts[CLUSTERS_X * CLUSTERS_Y];
+	uint32_t start = 0;
+	for (int c = 0; c < CLUSTERS_X * CLUSTERS_Y; c++)
+	{
+		starts[c] = start;
+		start += counts[c];
+	}
+
+	std::vector<uint16_t>& indices = m_slice_indices[z];
+	indices.resize(hits.size());
+	for (uint32_t hit : hits)
+		indices[starts[hit >> 16]++] = (uint16_t)(hit & 0xFFFF);
+}
+
+void LightClusters::Build(const glm::mat4& view, const glm::mat4& projection, const std::vector<Light>& lights)
+{
+	setup(view, projection, lights);
+
+	JobSystem& jobs = JobSystem::GetInstance();
+	JobCounter counter;
+	jobs.ParallelFor(counter, CLUSTERS_Z, 1, [this](size_t begin, size_t end)
+	{
+		for (size_t z = begin; z < end; z++)
+			bin_slice((int)z);
+	});
+	jobs.Wait(counter);
+
+	// the slices follow each other in the index list
+	uint32_t offset = 0;
+	m_indices.clear();
+	for (int z = 0; z < CLUSTERS_Z; z++)
+	{
+		for (int c = 0; c < CLUSTERS_X * CLUSTERS_Y; c++)
+		{
+			Cluster& cluster = m_clusters[z * CLUSTERS_X * CLUSTERS_Y + c];
+			cluster.offset = offset;
+			cluster.count = m_slice_counts[z][c];
+			offset += cluster.count;
+		}
+		m_indices.insert(m_indices.end(), m_slice_indices[z].begin(), m_slice_indices[z].end());
+	}
+}
+
+void LightClusters::BuildReference(const glm::mat4& view, const glm::mat4& projection, const std::vector<Light>& lights)
+{
+	setup(view, projection, lights);
+
+	m_indices.clear();
+	for (int z = 0; z < CLUSTERS_Z; z++)
+	{
+		for (int y = 0; y < CLUSTERS_Y; y++)
+		{
+			for (int x = 0; x < CLUSTERS_X; x++)
+			{
+				Cluster& cluster = m_clusters[x + CLUSTERS_X * (y + CLUSTERS_Y * z)];
+				cluster.offset = (uint32_t)m_indices.size();
+				for (size_t i = 0; i < m_lights.size(); i++)
+				{
+					if (reaches(m_lights[i], x, y, z))
+						m_indices.push_back((uint16_t)i);
+				}
+				cluster.count = (uint32_t)m_indices.size() - cluster.offset;
+			}
+		}
+	}
+}
+
+bool LightClusters::InitTextures()
+{
+	glGenBuffers(1, &m_cluster_buffer);
+	glGenBuffers(1, &m_index_buffer);
+	glGenTextures(1, &m_cluster_texture);
+	glGenTextures(1, &m_index_texture);
+
+	// the textures keep pointing at the buffers when Upload reallocates them
+	glBindBuffer(GL_TEXTURE_BUFFER, m_cluster_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(Cluster) * CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_index_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(uint16_t), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glBindTexture(GL_TEXTURE_BUFFER, m_cluster_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, m_cluster_buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, m_index_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, m_index_buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	return m_cluster_texture != 0 && m_index_texture != 0;
+}
+
+void LightClusters::Upload()
+{
+	// orphan the storage of the last frame instead of waiting for the GPU to finish reading it
+	glBindBuffer(GL_TEXTURE_BUFFER, m_cluster_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, m_clusters.size() * sizeof(Cluster), m_clusters.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_index_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(1, m_indices.size()) * sizeof(uint16_t), nullptr, GL_STREAM_DRAW);
+	if (!m_indices.empty())
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, m_indices.size() * sizeof(uint16_t), m_indices.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::Bind(GLenum cluster_unit, GLenum index_unit)
+{
+	glActiveTexture(cluster_unit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_cluster_texture);
+	glActiveTexture(index_unit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_index_texture);
+}
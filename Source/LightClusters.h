@@ -0,0 +1,99 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include "GLEW\glew.h"
+#include "glm\glm.hpp"
+#include <cstdint>
+#include <vector>
+
+// Froxel grid of the view frustum with the lights that reach every cluster
+// the screen is split in CLUSTERS_X x CLUSTERS_Y tiles and the view depth between the near
+// and far planes of the projection in CLUSTERS_Z exponential slices. Build bins the lights
+// on the CPU, the slices in parallel on the job system, and Upload copies the compact lists
+// into two buffer textures: (offset, count) per cluster and the light indices they point to.
+// the deferred shader finds its cluster from gl_FragCoord and the view depth
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+
+class LightClusters
+{
+public:
+	// a light in world space, range is where it falls below LIGHT_CUTOFF
+	// a cone of 180 degrees or more is a point light
+	struct Light
+	{
+		glm::vec3 position;
+		float range;
+		glm::vec3 direction;
+		// cosine of half the outer angle of the cone
+		float cos_cone;
+	};
+
+	struct Cluster
+	{
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	// the radiance of the lights ends where color / distance^2 drops below it
+	static const float LIGHT_CUTOFF;
+	static float Range(const glm::vec3& color);
+
+protected:
+	// the light in view space with the bounding sphere of its cone
+	struct ViewLight
+	{
+		glm::vec3 position;
+		float range;
+		glm::vec3 direction;
+		float cos_cone;
+		float sin_cone;
+	};
+
+	// view space bounds of the froxels, x depends only on the column and y on the row of a slice
+	struct Slice
+	{
+		float z_near, z_far;
+		float x_min[CLUSTERS_X], x_max[CLUSTERS_X];
+		float y_min[CLUSTERS_Y], y_max[CLUSTERS_Y];
+	};
+
+	Slice m_slices[CLUSTERS_Z];
+	float m_near, m_far;
+	std::vector<ViewLight> m_lights;
+
+	std::vector<Cluster> m_clusters;
+	std::vector<uint16_t> m_indices;
+	// the (offset, count) lists of every slice, filled by its own job
+	std::vector<uint16_t> m_slice_indices[CLUSTERS_Z];
+	uint32_t m_slice_counts[CLUSTERS_Z][CLUSTERS_X * CLUSTERS_Y];
+
+	GLuint m_cluster_buffer, m_cluster_texture;
+	GLuint m_index_buffer, m_index_texture;
+
+	void setup(const glm::mat4& view, const glm::mat4& projection, const std::vector<Light>& lights);
+	bool reaches(const ViewLight& light, int x, int y, int z) const;
+	void bin_slice(int z);
+
+public:
+	LightClusters();
+	~LightClusters();
+
+	// bin the lights into the froxels of the projection, which has to be a symmetric perspective
+	void Build(const glm::mat4& view, const glm::mat4& projection, const std::vector<Light>& lights);
+	// the same lists by testing every light against every cluster on the calling thread
+	void BuildReference(const glm::mat4& view, const glm::mat4& projection, const std::vector<Light>& lights);
+
+	const std::vector<Cluster>& GetClusters() const { return m_clusters; }
+	const std::vector<uint16_t>& GetIndices() const { return m_indices; }
+	float GetNear() const { return m_near; }
+	float GetFar() const { return m_far; }
+
+	// the buffer textures need a context, the binning does not
+	bool InitTextures();
+	void Upload();
+	void Bind(GLenum cluster_unit, GLenum index_unit);
+};
+
+#endif
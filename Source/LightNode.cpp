@@ -2,11 +2,15 @@
 #include "glm\gtc\matrix_transform.hpp"
 #include "Tools.h"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 // Spot Light
 LightNode::LightNode()
 {
 	m_name = "defaultSpotLight1";
+	m_static_shadow_map_version = 0;
 
 	m_light_direction = glm::normalize(glm::vec3(-1, -1, 0));
 	m_light_position = glm::vec3(5, 3, 0);
@@ -15,52 +19,17 @@ LightNode::LightNode()
 	SetConeSize(60, 60);
 
 	m_cast_shadow = false;
-	m_shadow_map_resolution = 8192;
 	m_shadow_map_bias = 0.001;
-	m_shadow_map_texture = 0;
-	m_shadow_map_fbo = 0;
 }
 
 LightNode::~LightNode()
 {
-	glDeleteFramebuffers(1, &m_shadow_map_fbo);
-	glDeleteTextures(1, &m_shadow_map_texture);
 }
 
 void LightNode::CastShadow(bool cast)
 {
 	m_cast_shadow = cast;
-
-	if (cast)
-	{
-		if (m_shadow_map_texture == 0)
-			glGenTextures(1, &m_shadow_map_texture);
-		// Depth buffer
-		glBindTexture(GL_TEXTURE_2D, m_shadow_map_texture);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, m_shadow_map_resolution, m_shadow_map_resolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		if (m_shadow_map_fbo == 0)
-			glGenFramebuffers(1, &m_shadow_map_fbo);
-		glBindFramebuffer(GL_FRAMEBUFFER, m_shadow_map_fbo);
-		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_shadow_map_texture, 0);
-		glDrawBuffer(GL_NONE);
-		//glReadBuffer(GL_NONE);
-
-		GLenum status = Tools::CheckFramebufferStatus(m_shadow_map_fbo);
-		if (status != GL_FRAMEBUFFER_COMPLETE)
-		{
-			printf("Error in Spotlight shadow FB generation.\n");
-			return;
-		}
-
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	}
+	m_static_shadow_map_version = 0;
 }
 
 
@@ -71,6 +40,7 @@ void LightNode::SetColor(const glm::vec3 & color)
 
 void LightNode::SetPosition(const glm::vec3 & pos)
 {
+	m_static_shadow_map_version = 0;
 	m_light_position = pos;
 	m_light_direction = glm::normalize(m_light_target - m_light_position);
 	m_view_matrix = glm::lookAt(m_light_position, m_light_target, glm::vec3(0, 1, 0));
@@ -79,6 +49,7 @@ void LightNode::SetPosition(const glm::vec3 & pos)
 
 void LightNode::SetTarget(const glm::vec3 & target)
 {
+	m_static_shadow_map_version = 0;
 	m_light_target = target;
 	m_light_direction = glm::normalize(m_light_target - m_light_position);
 	m_view_matrix = glm::lookAt(m_light_position, m_light_target, glm::vec3(0, 1, 0));
@@ -88,6 +59,7 @@ void LightNode::SetTarget(const glm::vec3 & target)
 void LightNode::SetConeSize(float umbra, float penumbra)
 {
 	m_umbra = umbra;
+	m_static_shadow_map_version = 0;
 	m_penumbra = penumbra;
 
 	float near_clipping_range = 0.1f;
@@ -128,27 +100,70 @@ bool LightNode::GetCastShadowsStatus()
 	return m_cast_shadow;
 }
 
-GLuint LightNode::GetShadowMapFBO()
+glm::mat4 LightNode::GetProjectionMatrix()
 {
-	return m_shadow_map_fbo;
+	return m_projection_matrix;
 }
 
-GLuint LightNode::GetShadowMapDepthTexture()
+glm::mat4 LightNode::GetViewMatrix()
 {
-	return m_shadow_map_texture;
+	return m_view_matrix;
 }
 
-int LightNode::GetShadowMapResolution()
+bool LightNode::GetScreenBounds(const glm::mat4& view, const glm::mat4& projection, float range, int width, int height,
+	glm::ivec4& scissor, glm::vec2& depth_range)
 {
-	return m_shadow_map_resolution;;
-}
+	// the shader lights the cone of the smaller cosine
+	float cos_cone = std::min(cos(glm::radians(0.5f * m_umbra)), cos(glm::radians(0.5f * m_penumbra)));
+	float radius = (cos_cone > 0.f) ? range * sqrtf(1.f - cos_cone * cos_cone) / cos_cone : range;
 
-glm::mat4 LightNode::GetProjectionMatrix()
-{
-	return m_projection_matrix;
-}
+	// a pyramid around the cone while its cap is narrower than the sphere of the range, otherwise the box of the sphere
+	std::vector<glm::vec3> points;
+	if (radius < range)
+	{
+		glm::vec3 direction = glm::normalize(m_light_direction);
+		glm::vec3 side = glm::normalize(glm::cross(direction, fabs(direction.y) < 0.99f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0)));
+		glm::vec3 up = glm::cross(side, direction);
+		glm::vec3 cap = m_light_position + direction * range;
+		points = { m_light_position, cap + (side + up) * radius, cap + (side - up) * radius, cap - (side + up) * radius, cap - (side - up) * radius };
+	}
+	else
+	{
+		for (int i = 0; i < 8; i++)
+			points.push_back(m_light_position + range * glm::vec3((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f));
+	}
 
-glm::mat4 LightNode::GetViewMatrix()
-{
-	return m_view_matrix;
-}
\ No newline at end of file
+	glm::vec2 ndc_min(1.f), ndc_max(-1.f);
+	depth_range = glm::vec2(1e30f, 0.f);
+	bool behind = false;
+	for (auto& point : points)
+	{
+		glm::vec4 view_point = view * glm::vec4(point, 1.f);
+		depth_range.x = std::min(depth_range.x, -view_point.z);
+		depth_range.y = std::max(depth_range.y, -view_point.z);
+
+		glm::vec4 clip = projection * view_point;
+		if (clip.w <= 1e-4f)
+		{
+			// a corner behind the eye, keep the whole width and height
+			behind = true;
+			continue;
+		}
+		ndc_min = glm::min(ndc_min, glm::vec2(clip) / clip.w);
+		ndc_max = glm::max(ndc_max, glm::vec2(clip) / clip.w);
+	}
+	if (behind)
+	{
+		ndc_min = glm::vec2(-1.f);
+		ndc_max = glm::vec2(1.f);
+	}
+	depth_range.x = std::max(depth_range.x, 0.f);
+
+	int x0 = std::max(0, (int)floor((0.5f * ndc_min.x + 0.5f) * width));
+	int y0 = std::max(0, (int)floor((0.5f * ndc_min.y + 0.5f) * height));
+	int x1 = std::min(width, (int)ceil((0.5f * ndc_max.x + 0.5f) * width));
+	int y1 = std::min(height, (int)ceil((0.5f * ndc_max.y + 0.5f) * height));
+	scissor = glm::ivec4(x0, y0, x1 - x0, y1 - y0);
+
+	return x1 > x0 && y1 > y0 && depth_range.y > 0.f;
+}
@@ -18,10 +18,9 @@ class LightNode
 	float m_penumbra;
 
 	bool m_cast_shadow;
-	int m_shadow_map_resolution;
 	float m_shadow_map_bias;
-	GLuint m_shadow_map_texture;
-	GLuint m_shadow_map_fbo;
+	// the static geometry the cache of its tile in the shadow atlas holds, 0 once the light has moved
+	unsigned int m_static_shadow_map_version;
 
 	glm::mat4 m_projection_matrix;
 	glm::mat4 m_projection_inverse_matrix;
@@ -44,14 +43,19 @@ public:
 	float GetUmbra();
 	float GetPenumbra();
 
+	// the shadow map is a tile of the shadow atlas of the renderer
 	void CastShadow(bool enable);
 	bool GetCastShadowsStatus();
-	GLuint GetShadowMapFBO();
-	GLuint GetShadowMapDepthTexture();
-	int GetShadowMapResolution();
+	unsigned int GetStaticShadowMapVersion() const { return m_static_shadow_map_version; }
+	void SetStaticShadowMapVersion(unsigned int version) { m_static_shadow_map_version = version; }
 
 	glm::mat4 GetProjectionMatrix();
 	glm::mat4 GetViewMatrix();
+
+	// the pixels (x, y, width, height) and the view depths of the camera the cone can reach up to range,
+	// false if it cannot reach any pixel
+	bool GetScreenBounds(const glm::mat4& view, const glm::mat4& projection, float range, int width, int height,
+		glm::ivec4& scissor, glm::vec2& depth_range);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// Queue of many producer threads and a single consumer thread
+// the producers push on a lock free stack, the consumer takes the whole stack at once
+// and reverses it, so the items come out in the order they were pushed
+// taking everything at once also means a node is never popped while another thread
+// looks at it, which is what makes the simple compare and swap push safe
+template<typename T>
+class LockFreeQueue
+{
+public:
+	LockFreeQueue() : m_pushed(nullptr), m_pending(nullptr) {}
+
+	~LockFreeQueue()
+	{
+		T value;
+		while (Pop(value)) {}
+	}
+
+	// any thread
+	void Push(T value)
+	{
+		Node* node = new Node(std::move(value));
+		node->next = m_pushed.load(std::memory_order_relaxed);
+		while (!m_pushed.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {}
+	}
+
+	// only the consumer thread
+	bool Pop(T& value)
+	{
+		if (m_pending == nullptr)
+		{
+			Node* pushed = m_pushed.exchange(nullptr, std::memory_order_acquire);
+			while (pushed != nullptr)
+			{
+				Node* next = pushed->next;
+				pushed->next = m_pending;
+				m_pending = pushed;
+				pushed = next;
+			}
+			if (m_pending == nullptr)
+				return false;
+		}
+
+		Node* node = m_pending;
+		m_pending = node->next;
+		value = std::move(node->value);
+		delete node;
+		return true;
+	}
+
+	// only the consumer thread
+	bool Empty() const
+	{
+		return m_pending == nullptr && m_pushed.load(std::memory_order_acquire) == nullptr;
+	}
+
+private:
+	struct Node
+	{
+		explicit Node(T&& item) : value(std::move(item)), next(nullptr) {}
+		T value;
+		Node* next;
+	};
+
+	// newest first
+	std::atomic<Node*> m_pushed;
+	// oldest first, only touched by the consumer
+	Node* m_pending;
+
+	LockFreeQueue(const LockFreeQueue&);
+	void operator=(const LockFreeQueue&);
+};
+
+#endif
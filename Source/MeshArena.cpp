@@ -0,0 +1,255 @@
+#include "MeshArena.h"
+#include "GeometricMesh.h"
+#include "Tools.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+
+MeshArena::FreeList::FreeList()
+{
+	m_capacity = 0;
+}
+
+void MeshArena::FreeList::Reset(size_t capacity)
+{
+	m_blocks.clear();
+	m_capacity = capacity;
+	if (capacity > 0)
+		m_blocks.push_back({ 0, capacity });
+}
+
+void MeshArena::FreeList::Grow(size_t capacity)
+{
+	if (capacity <= m_capacity)
+		return;
+
+	size_t added = capacity - m_capacity;
+	if (!m_blocks.empty() && m_blocks.back().offset + m_blocks.back().size == m_capacity)
+		m_blocks.back().size += added;
+	else
+		m_blocks.push_back({ m_capacity, added });
+	m_capacity = capacity;
+}
+
+bool MeshArena::FreeList::Allocate(size_t size, size_t& offset)
+{
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		Block& block = m_blocks[i];
+		if (block.size < size)
+			continue;
+
+		offset = block.offset;
+		block.offset += size;
+		block.size -= size;
+		if (block.size == 0)
+			m_blocks.erase(m_blocks.begin() + i);
+		return true;
+	}
+	return false;
+}
+
+void MeshArena::FreeList::Free(size_t offset, size_t size)
+{
+	if (size == 0)
+		return;
+
+	auto next = std::lower_bound(m_blocks.begin(), m_blocks.end(), offset, [](const Block& block, size_t value) { return block.offset < value; });
+	next = m_blocks.insert(next, { offset, size });
+
+	// merge with the following block, then with the previous one
+	if (next + 1 != m_blocks.end() && next->offset + next->size == (next + 1)->offset)
+	{
+		next->size += (next + 1)->size;
+		m_blocks.erase(next + 1);
+	}
+	if (next != m_blocks.begin() && (next - 1)->offset + (next - 1)->size == next->offset)
+	{
+		(next - 1)->size += next->size;
+		m_blocks.erase(next);
+	}
+}
+
+size_t MeshArena::FreeList::GetFree() const
+{
+	size_t free = 0;
+	for (auto& block : m_blocks)
+		free += block.size;
+	return free;
+}
+
+size_t MeshArena::FreeList::GetLargestFree() const
+{
+	size_t largest = 0;
+	for (auto& block : m_blocks)
+		largest = std::max(largest, block.size);
+	return largest;
+}
+
+float MeshArena::FreeList::GetOccupancy() const
+{
+	return m_capacity > 0 ? 1.f - (float)GetFree() / m_capacity : 0.f;
+}
+
+float MeshArena::FreeList::GetFragmentation() const
+{
+	size_t free = GetFree();
+	return free > 0 ? 1.f - (float)GetLargestFree() / free : 0.f;
+}
+
+MeshArena::MeshArena()
+{
+	m_vao = 0;
+	m_vertex_buffer = 0;
+	m_index_buffer = 0;
+}
+
+MeshArena::~MeshArena()
+{
+	destroy();
+}
+
+void MeshArena::destroy()
+{
+	glDeleteVertexArrays(1, &m_vao);
+	glDeleteBuffers(1, &m_vertex_buffer);
+	glDeleteBuffers(1, &m_index_buffer);
+	m_vao = m_vertex_buffer = m_index_buffer = 0;
+	m_vertices.Reset(0);
+	m_indices.Reset(0);
+}
+
+bool MeshArena::Init(size_t vertices, size_t indices)
+{
+	destroy();
+
+	glGenBuffers(1, &m_vertex_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_vertex_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertices * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+	glGenBuffers(1, &m_index_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_index_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, indices * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glGenVertexArrays(1, &m_vao);
+	bind_attributes();
+
+	m_vertices.Reset(vertices);
+	m_indices.Reset(indices);
+	return m_vao != 0 && m_vertex_buffer != 0 && m_index_buffer != 0;
+}
+
+bool MeshArena::grow(GLuint& buffer, FreeList& elements, size_t element_size, size_t count, size_t& offset)
+{
+	size_t capacity = std::max(2 * elements.GetCapacity(), elements.GetCapacity() + count);
+	GLuint grown = Tools::GrowBuffer(buffer, elements.GetCapacity() * element_size, capacity * element_size, GL_STATIC_DRAW);
+	if (grown == 0)
+	{
+		printf("MeshArena: could not grow to %zu elements of %zu bytes\n", capacity, element_size);
+		return false;
+	}
+
+	buffer = grown;
+	elements.Grow(capacity);
+	bind_attributes();
+	return elements.Allocate(count, offset);
+}
+
+void MeshArena::bind_attributes()
+{
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer);
+
+	const GLint sizes[] = { 3, 3, 2, 3, 3 };
+	const size_t offsets[] = { offsetof(Vertex, position), offsetof(Vertex, normal), offsetof(Vertex, texcoord), offsetof(Vertex, tangent), offsetof(Vertex, bitangent) };
+	for (GLuint attribute = 0; attribute < 5; attribute++)
+	{
+		glEnableVertexAttribArray(attribute);
+		glVertexAttribPointer(attribute, sizes[attribute], GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<const void*>(offsets[attribute]));
+	}
+
+	// the element buffer binding is part of the vao state
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool MeshArena::Allocate(const GeometricMesh* mesh, Range& range)
+{
+	const size_t vertex_count = mesh->vertices.size();
+	const size_t index_count = mesh->indices.empty() ? vertex_count : mesh->indices.size();
+	if (m_vao == 0 || vertex_count == 0)
+		return false;
+
+	size_t base_vertex, first_index;
+	if (!m_vertices.Allocate(vertex_count, base_vertex) &&
+		!grow(m_vertex_buffer, m_vertices, sizeof(Vertex), vertex_count, base_vertex))
+		return false;
+	if (!m_indices.Allocate(index_count, first_index) &&
+		!grow(m_index_buffer, m_indices, sizeof(GLuint), index_count, first_index))
+	{
+		m_vertices.Free(base_vertex, vertex_count);
+		return false;
+	}
+
+	std::vector<Vertex> vertices(vertex_count);
+	const bool texcoords = mesh->textureCoord.size() == vertex_count;
+	const bool tangents = mesh->tangents.size() == vertex_count && mesh->bitangents.size() == vertex_count;
+	for (size_t i = 0; i < vertex_count; i++)
+	{
+		Vertex& vertex = vertices[i];
+		vertex.position = mesh->vertices[i];
+		vertex.normal = mesh->normals[i];
+		vertex.texcoord = texcoords ? mesh->textureCoord[i] : glm::vec2(0.f);
+		vertex.tangent = tangents ? mesh->tangents[i] : glm::vec3(0.f);
+		vertex.bitangent = tangents ? mesh->bitangents[i] : glm::vec3(0.f);
+	}
+
+	std::vector<GLuint> sequence;
+	const GLuint* indices = mesh->indices.data();
+	if (mesh->indices.empty())
+	{
+		sequence.resize(vertex_count);
+		for (size_t i = 0; i < vertex_count; i++)
+			sequence[i] = (GLuint)i;
+		indices = sequence.data();
+	}
+
+	// the copy targets leave the vao and the element buffer of the caller alone
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_vertex_buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, base_vertex * sizeof(Vertex), vertex_count * sizeof(Vertex), vertices.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_index_buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, first_index * sizeof(GLuint), index_count * sizeof(GLuint), indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	range.base_vertex = (GLint)base_vertex;
+	range.vertex_count = (GLuint)vertex_count;
+	range.first_index = (GLuint)first_index;
+	range.index_count = (GLuint)index_count;
+	return true;
+}
+
+void MeshArena::Free(const Range& range)
+{
+	m_vertices.Free(range.base_vertex, range.vertex_count);
+	m_indices.Free(range.first_index, range.index_count);
+}
+
+MeshArena::Statistics MeshArena::GetStatistics() const
+{
+	Statistics statistics;
+	statistics.vertex_capacity = m_vertices.GetCapacity();
+	statistics.vertices_used = m_vertices.GetCapacity() - m_vertices.GetFree();
+	statistics.vertex_free_blocks = m_vertices.GetBlockCount();
+	statistics.largest_free_vertices = m_vertices.GetLargestFree();
+	statistics.index_capacity = m_indices.GetCapacity();
+	statistics.indices_used = m_indices.GetCapacity() - m_indices.GetFree();
+	statistics.index_free_blocks = m_indices.GetBlockCount();
+	statistics.largest_free_indices = m_indices.GetLargestFree();
+	statistics.vertex_occupancy = m_vertices.GetOccupancy();
+	statistics.index_occupancy = m_indices.GetOccupancy();
+	statistics.vertex_fragmentation = m_vertices.GetFragmentation();
+	statistics.index_fragmentation = m_indices.GetFragmentation();
+	statistics.bytes = m_vertices.GetCapacity() * sizeof(Vertex) + m_indices.GetCapacity() * sizeof(GLuint);
+	return statistics;
+}
@@ -0,0 +1,113 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include "GLEW\glew.h"
+#include "glm\glm.hpp"
+#include <vector>
+
+class GeometricMesh;
+
+// One interleaved vertex buffer and one index buffer shared by the meshes, with a single vao
+// every mesh gets a range of vertices and a range of indices from a first fit free list, its
+// indices stay relative to its first vertex (the base vertex of the draws). The meshes without
+// indices get the sequence of their vertices, so every mesh draws with glDrawElements*.
+// The buffers double when a mesh does not fit and the vao is pointed at the new ones
+class MeshArena
+{
+public:
+	struct Vertex
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 texcoord;
+		glm::vec3 tangent;
+		glm::vec3 bitangent;
+	};
+
+	struct Range
+	{
+		GLint base_vertex;
+		GLuint vertex_count;
+		GLuint first_index;
+		GLuint index_count;
+	};
+
+	// free ranges of elements sorted by offset, neighbours are merged when freed
+	class FreeList
+	{
+		struct Block
+		{
+			size_t offset;
+			size_t size;
+		};
+		std::vector<Block> m_blocks;
+		size_t m_capacity;
+
+	public:
+		FreeList();
+		void Reset(size_t capacity);
+		// the free elements at the end grow with the capacity
+		void Grow(size_t capacity);
+		bool Allocate(size_t size, size_t& offset);
+		void Free(size_t offset, size_t size);
+
+		size_t GetCapacity() const { return m_capacity; }
+		size_t GetFree() const;
+		size_t GetLargestFree() const;
+		size_t GetBlockCount() const { return m_blocks.size(); }
+		float GetOccupancy() const;
+		float GetFragmentation() const;
+	};
+
+	// the occupancy of the buffers and how scattered their free space is
+	struct Statistics
+	{
+		size_t vertex_capacity;
+		size_t vertices_used;
+		size_t vertex_free_blocks;
+		size_t largest_free_vertices;
+		size_t index_capacity;
+		size_t indices_used;
+		size_t index_free_blocks;
+		size_t largest_free_indices;
+		// the used elements over the capacity
+		float vertex_occupancy;
+		float index_occupancy;
+		// 1 - the largest free block over all the free elements, 0 while the free space is one block
+		float vertex_fragmentation;
+		float index_fragmentation;
+		// the size of both buffers in bytes
+		size_t bytes;
+	};
+
+	MeshArena();
+	~MeshArena();
+
+	bool Init(size_t vertices, size_t indices);
+	// uploads the vertices and indices of a mesh, false if the buffers could not grow
+	bool Allocate(const GeometricMesh* mesh, Range& range);
+	void Free(const Range& range);
+
+	// the vertex attributes 0-4 of every mesh and the index buffer
+	GLuint GetVAO() const { return m_vao; }
+	bool IsInitialized() const { return m_vao != 0; }
+
+	const FreeList& GetVertices() const { return m_vertices; }
+	const FreeList& GetIndices() const { return m_indices; }
+	Statistics GetStatistics() const;
+
+private:
+	GLuint m_vao;
+	GLuint m_vertex_buffer;
+	GLuint m_index_buffer;
+	FreeList m_vertices;
+	FreeList m_indices;
+
+	void destroy();
+	// doubles buffer, or more for count elements, and allocates them, false with buffer and elements untouched
+	// when the driver is out of memory
+	bool grow(GLuint& buffer, FreeList& elements, size_t element_size, size_t count, size_t& offset);
+	void bind_attributes();
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include "MeshCache.h"
+#include "Tools.h"
+#include "VirtualFileSystem.h"
+#include <algorithm>
+
+MeshCache::MeshCache()
+{
+	statistics = Statistics();
+}
+
+MeshCache::~MeshCache()
+{
+	this->Clear();
+}
+
+void MeshCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+	paths.clear();
+	contents.clear();
+}
+
+std::string MeshCache::normalize_path(const std::string& filename)
+{
+	// "a\b.obj" and "a/b.obj" are the same file
+	std::string path = filename;
+	std::replace(path.begin(), path.end(), '\\', '/');
+	return path;
+}
+
+bool MeshCache::hash_source(const std::string& path, VirtualFile& file, LoadedMesh& loaded)
+{
+	// an up to date .meshbin knows the content hash, the OBJ is only read when there is none
+	loaded.binary = OBJLoader::binaryContentHash(path.c_str(), loaded.hash);
+	if (loaded.binary)
+		return true;
+
+	if (!VirtualFileSystem::GetInstance().Open(path.c_str(), file))
+	{
+		printf("MeshCache: Error opening file %s \n", path.c_str());
+		return false;
+	}
+	loaded.bytes_read += file.Size();
+	loaded.hash = OBJLoader::contentHash(path.c_str(), file.Data(), file.Size());
+	return true;
+}
+
+bool MeshCache::load_source(const std::string& path, OBJLoader& loader, VirtualFile& file, LoadedMesh& loaded)
+{
+	loaded.mesh = loaded.binary ? OBJLoader::loadBinary(path.c_str()) : nullptr;
+	if (loaded.mesh != nullptr)
+		return true;
+
+	// no binary cache or a damaged one
+	loaded.binary = false;
+	if (!file.IsOpen())
+	{
+		if (!VirtualFileSystem::GetInstance().Open(path.c_str(), file))
+		{
+			printf("MeshCache: Error opening file %s \n", path.c_str());
+			return false;
+		}
+		loaded.bytes_read += file.Size();
+		loaded.hash = OBJLoader::contentHash(path.c_str(), file.Data(), file.Size());
+	}
+
+	loaded.mesh = loader.load(path.c_str(), file.Data(), file.Size(), loaded.hash);
+	loaded.bytes_parsed = file.Size();
+	file.Close();
+	return loaded.mesh != nullptr;
+}
+
+const MeshCache::MeshEntry& MeshCache::add_entry(const std::string& path, LoadedMesh& loaded)
+{
+	statistics.bytes_read += loaded.bytes_read;
+
+	// a file with the same content (or the same file) may have been loaded by another thread meanwhile
+	auto content_entry = contents.find(loaded.hash);
+	if (content_entry != contents.end())
+	{
+		statistics.content_hits++;
+		delete loaded.mesh;
+		paths[path] = content_entry->second;
+		return entries[content_entry->second];
+	}
+
+	if (loaded.binary)
+	{
+		statistics.binary_loads++;
+	}
+	else
+	{
+		statistics.parsed++;
+		statistics.bytes_parsed += loaded.bytes_parsed;
+	}
+
+	MeshEntry entry;
+	entry.mesh = std::shared_ptr<const GeometricMesh>(loaded.mesh);
+	entry.assetName = path;
+
+	paths[path] = entries.size();
+	contents[loaded.hash] = entries.size();
+	entries.push_back(entry);
+	return entries.back();
+}
+
+std::shared_ptr<const GeometricMesh> MeshCache::RequestMesh(const std::string& filename, std::string* assetName)
+{
+	std::string path = normalize_path(filename);
+
+	// first check if this path was already requested
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		statistics.requests++;
+
+		auto path_entry = paths.find(path);
+		if (path_entry != paths.end())
+		{
+			statistics.path_hits++;
+			const MeshEntry& entry = entries[path_entry->second];
+			if (assetName) *assetName = entry.assetName;
+			return entry.mesh;
+		}
+	}
+
+	// the files are read and parsed without holding the lock, so jobs load in parallel
+	VirtualFile file;
+	LoadedMesh loaded = LoadedMesh();
+	if (!hash_source(path, file, loaded))
+		return nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto content_entry = contents.find(loaded.hash);
+		if (content_entry != contents.end())
+		{
+			statistics.bytes_read += loaded.bytes_read;
+			statistics.content_hits++;
+			paths[path] = content_entry->second;
+			const MeshEntry& entry = entries[content_entry->second];
+			if (assetName) *assetName = entry.assetName;
+			return entry.mesh;
+		}
+	}
+
+	OBJLoader loader;
+	if (!load_source(path, loader, file, loaded))
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	const MeshEntry& entry = add_entry(path, loaded);
+	if (assetName) *assetName = entry.assetName;
+	return entry.mesh;
+}
+
+MeshCache::Statistics MeshCache::GetStatistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return statistics;
+}
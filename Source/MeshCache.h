@@ -0,0 +1,89 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+#include <mutex>
+#include "OBJLoader.h"
+#include "GeometricMesh.h"
+
+// Singleton Class of the parsed meshes
+// every OBJ file is parsed once, later requests of the same path are answered without
+// touching the disk and a file with the same content as an already parsed one is shared
+// the parsed meshes are also kept in .meshbin files, so later runs skip the parsing
+class MeshCache
+{
+public:
+	struct Statistics
+	{
+		unsigned int requests;
+		unsigned int path_hits;
+		unsigned int content_hits;
+		unsigned int parsed;
+		unsigned int binary_loads;
+		size_t bytes_read;
+		size_t bytes_parsed;
+	};
+
+protected:
+	struct MeshEntry
+	{
+		std::shared_ptr<const GeometricMesh> mesh;
+		// name of the GPU asset, the first path that was parsed for this content
+		std::string assetName;
+	};
+	std::vector<MeshEntry> entries;
+
+	// path -> entry and content hash -> entry
+	std::unordered_map<std::string, size_t> paths;
+	std::unordered_map<uint64_t, size_t> contents;
+
+	Statistics statistics;
+	// guards the maps and the statistics, the loading itself runs unlocked
+	std::mutex mutex;
+
+	// a mesh that was read or parsed but is not in the maps yet
+	struct LoadedMesh
+	{
+		GeometricMesh* mesh;
+		uint64_t hash;
+		bool binary;
+		size_t bytes_read;
+		size_t bytes_parsed;
+	};
+
+	static std::string normalize_path(const std::string& filename);
+	// these two only touch their arguments, so they run without the lock
+	static bool hash_source(const std::string& path, class VirtualFile& file, LoadedMesh& loaded);
+	static bool load_source(const std::string& path, OBJLoader& loader, class VirtualFile& file, LoadedMesh& loaded);
+	// called with the lock held
+	const MeshEntry& add_entry(const std::string& path, LoadedMesh& loaded);
+
+public:
+	// get the static instance of Mesh Cache
+	static MeshCache& GetInstance()
+	{
+		static MeshCache cache;
+		return cache;
+	}
+	~MeshCache();
+
+	// release the meshes, the ones still referenced stay alive with their owners
+	void Clear();
+
+	// Request the immutable mesh of an OBJ file, nullptr if it could not be loaded
+	// assetName receives the name to use with AssetManager so that copies share one VAO
+	// it can be called from any thread, e.g. from the jobs of the AssetLoader
+	std::shared_ptr<const GeometricMesh> RequestMesh(const std::string& filename, std::string* assetName = nullptr);
+
+	Statistics GetStatistics();
+
+protected:
+	MeshCache();
+	void operator=(MeshCache const&);
+};
+
+#endif
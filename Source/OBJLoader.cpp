@@ -5,12 +5,22 @@
 #include <fstream>
 #include <iostream>
 #include "Tools.h"
+#include "VirtualFileSystem.h"
+#include "JobSystem.h"
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <limits>
 
 using namespace std;
 
 OBJLoader::OBJLoader(void)
 {
 	mesh = nullptr;
+	indexedOutput = true;
+	binaryCache = true;
+	setParallelism(0);
 }
 
 
@@ -18,25 +28,235 @@ OBJLoader::~OBJLoader(void)
 {
 }
 
+namespace
+{
+	// powers of ten that are exactly representable by a double
+	const double exact_powers_of_ten[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+	inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+	inline const char* skip_blanks(const char* p, const char* end)
+	{
+		while (p < end && is_blank(*p)) p++;
+		return p;
+	}
+
+	// returns the first character of the next line
+	inline const char* skip_line(const char* p, const char* end)
+	{
+		const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+		return eol ? eol + 1 : end;
+	}
+
+	// a whitespace separated word, the OBJ names never contain spaces
+	inline const char* read_token(const char* p, const char* end, std::string& token)
+	{
+		p = skip_blanks(p, end);
+		const char* first = p;
+		while (p < end && !is_blank(*p) && *p != '\n') p++;
+		token.assign(first, p);
+		return p;
+	}
+
+	// keyword followed by a blank or the end of the line
+	inline bool match_keyword(const char* p, const char* end, const char* keyword, size_t length)
+	{
+		return (size_t)(end - p) >= length && memcmp(p, keyword, length) == 0 &&
+			(p + length == end || is_blank(p[length]) || p[length] == '\n');
+	}
+
+	// returns nullptr if there is no integer at p
+	inline const char* parse_int(const char* p, const char* end, int& value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = (*p == '-');
+			p++;
+		}
+		if (p >= end || !is_digit(*p)) return nullptr;
+
+		int result = 0;
+		while (p < end && is_digit(*p))
+			result = result * 10 + (*p++ - '0');
+		value = negative ? -result : result;
+		return p;
+	}
+
+	// returns nullptr if there is no number at p
+	inline const char* parse_float(const char* p, const char* end, float& value)
+	{
+		const char* first = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = (*p == '-');
+			p++;
+		}
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool any_digit = false;
+
+		while (p < end && is_digit(*p))
+		{
+			// leading zeros do not count as significant digits
+			if (mantissa != 0 || *p != '0') digits++;
+			mantissa = mantissa * 10 + (*p++ - '0');
+			any_digit = true;
+		}
+		if (p < end && *p == '.')
+		{
+			p++;
+			while (p < end && is_digit(*p))
+			{
+				if (mantissa != 0 || *p != '0') digits++;
+				mantissa = mantissa * 10 + (*p++ - '0');
+				exponent--;
+				any_digit = true;
+			}
+		}
+		if (p < end && (*p == 'e' || *p == 'E') && any_digit)
+		{
+			int e;
+			const char* after = parse_int(p + 1, end, e);
+			if (after)
+			{
+				exponent += e;
+				p = after;
+			}
+		}
+
+		// the fast path is exact only for short mantissas and small exponents,
+		// everything else (nan, inf, long numbers) goes through strtof
+		if (!any_digit || digits > 15 || exponent < -22 || exponent > 22)
+		{
+			char buffer[64];
+			size_t length = 0;
+			while (first + length < end && length < sizeof(buffer) - 1 &&
+				!is_blank(first[length]) && first[length] != '\n' && first[length] != '/')
+				length++;
+			if (length == 0) return nullptr;
+			memcpy(buffer, first, length);
+			buffer[length] = '\0';
+			char* pEnd;
+			value = strtof(buffer, &pEnd);
+			if (pEnd == buffer) return nullptr;
+			return first + (pEnd - buffer);
+		}
+
+		double result = (double)mantissa;
+		result = (exponent < 0) ? result / exact_powers_of_ten[-exponent] : result * exact_powers_of_ten[exponent];
+		value = (float)(negative ? -result : result);
+		return p;
+	}
+
+	// reads up to count floats, the missing ones are left untouched
+	inline const char* parse_floats(const char* p, const char* end, float* values, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			p = skip_blanks(p, end);
+			const char* next = parse_float(p, end, values[i]);
+			if (next == nullptr) break;
+			p = next;
+		}
+		return p;
+	}
+}
+
 /*
 Because sometimes there are faces that point to not yet defined vertices we will do a 2-pass scan
 */
 GeometricMesh* OBJLoader::load(const char* filename)
 {
+	if (binaryCache)
+	{
+		GeometricMesh* cached = loadBinary(filename);
+		if (cached != nullptr)
+			return cached;
+	}
+
 	printf("Start ObjReading MeshNext reading\n");
 
-	shared_vertices.clear();
-	shared_normals.clear();
-	shared_textcoord.clear();
-	elements.clear();
-	shared_faces.clear();
-	hasTextures = hasNormals = false;
+	VirtualFile file;
+	if (!VirtualFileSystem::GetInstance().Open(filename, file))
+	{
+		printf("ObjLoaderMeshNext: Error opening file %s \n", filename);
+		return nullptr;
+	}
+
+	uint64_t hash = binaryCache ? contentHash(filename, file.Data(), file.Size()) : 0;
+	GeometricMesh* result = load(filename, file.Data(), file.Size(), hash);
+	file.Close();
+	return result;
+}
+
+GeometricMesh* OBJLoader::load(const char* filename, const char* data, size_t size, uint64_t hash)
+{
+	begin_mesh(filename);
+
+	const char* begin = data;
+	const char* end = begin + size;
+
+	size_t chunk_count = std::max<size_t>(1, std::min<size_t>(threadCount, size / minimumChunkSize));
+	std::vector<Chunk> chunks(chunk_count);
+
+	if (chunk_count == 1)
+	{
+		parse_chunk(begin, end, chunks[0]);
+	}
+	else
+	{
+		// split at the first new line after every equal slice
+		std::vector<const char*> bounds(chunk_count + 1, end);
+		bounds[0] = begin;
+		for (size_t i = 1; i < chunk_count; i++)
+		{
+			const char* split = std::max(bounds[i - 1], begin + size * i / chunk_count);
+			const char* eol = static_cast<const char*>(memchr(split, '\n', end - split));
+			bounds[i] = eol ? eol + 1 : end;
+		}
+
+		JobSystem& jobs = JobSystem::GetInstance();
+		JobCounter parsed;
+		for (size_t i = 1; i < chunk_count; i++)
+		{
+			Chunk* chunk = &chunks[i];
+			const char* chunk_begin = bounds[i];
+			const char* chunk_end = bounds[i + 1];
+			jobs.Run(parsed, [chunk, chunk_begin, chunk_end]() { parse_chunk(chunk_begin, chunk_end, *chunk); });
+		}
+		parse_chunk(bounds[0], bounds[1], chunks[0]);
+		jobs.Wait(parsed);
+	}
+
+	stitch_chunks(chunks);
+
+	GeometricMesh* result = finish_mesh();
+	if (binaryCache)
+		saveBinary(filename, size, hash, result);
+	return result;
+}
+
+void OBJLoader::setParallelism(unsigned int threads, size_t minimum_chunk_bytes)
+{
+	threadCount = (threads == 0) ? JobSystem::GetInstance().GetThreadCount() : threads;
+	minimumChunkSize = std::max<size_t>(1, minimum_chunk_bytes);
+}
+
+GeometricMesh* OBJLoader::loadStdio(const char* filename)
+{
+	printf("Start ObjReading MeshNext reading\n");
 
 	char buff[1024];
 	char str[1024];
 
 	FILE* pFile;
-	folderPath = Tools::GetFolderPath(filename);
 	pFile = fopen(filename, "r");
 	if (pFile == NULL)
 	{
@@ -44,18 +264,9 @@ GeometricMesh* OBJLoader::load(const char* filename)
 		return nullptr;
 	}
 
-	mesh = new GeometricMesh();
+	begin_mesh(filename);
 
 	int str_pos;
-
-	// add a default material
-	mesh->materials.push_back(OBJMaterial());
-
-	//add a default meshObject
-	GeometricMesh::MeshObject defaultOb;
-	defaultOb.start = 0;
-	defaultOb.material_id = 0;
-	mesh->objects.push_back(defaultOb);
 	int currentMaterialID = 0;
 
 	//read the file
@@ -67,25 +278,244 @@ GeometricMesh* OBJLoader::load(const char* filename)
 			else if (strcmp(str, "vt") == 0) read_texcoord(buff + str_pos);
 			else if (strcmp(str, "vn") == 0) read_normal(buff + str_pos);
 			else if (strcmp(str, "f") == 0) read_faceLimited(buff + str_pos);
-			else if (strcmp(str, "usemtl") == 0) read_usemtl(buff + str_pos, currentMaterialID);
-			else if (strcmp(str, "mtllib") == 0) read_mtllib(buff + str_pos, filename);
-			else if (strcmp(str, "g") == 0 || strcmp(str, "o") == 0) add_new_group(buff + str_pos, currentMaterialID);
+			else if (strcmp(str, "usemtl") == 0 && sscanf(buff + str_pos, "%s", str) == 1) read_usemtl(str, (unsigned int)shared_faces.size(), currentMaterialID);
+			else if (strcmp(str, "mtllib") == 0 && sscanf(buff + str_pos, "%s", str) == 1) read_mtllib(str);
+			else if (strcmp(str, "g") == 0 || strcmp(str, "o") == 0) add_new_group(sscanf(buff + str_pos, "%s", str) == 1 ? str : "", (unsigned int)shared_faces.size(), currentMaterialID);
 			else if (strcmp(str, "#") == 0) { /* ignoring this line */ }
 			else { /* ignoring this line */ }
 		}
 	}
 	fclose(pFile);
 
+	return finish_mesh();
+}
+
+void OBJLoader::begin_mesh(const char* filename)
+{
+	shared_vertices.clear();
+	shared_normals.clear();
+	shared_textcoord.clear();
+	elements.clear();
+	shared_faces.clear();
+	materialFiles.clear();
+	hasTextures = hasNormals = false;
+
+	folderPath = Tools::GetFolderPath(filename);
+
+	mesh = new GeometricMesh();
+
+	// add a default material
+	mesh->materials.push_back(OBJMaterial());
+
+	//add a default meshObject
+	GeometricMesh::MeshObject defaultOb;
+	defaultOb.start = 0;
+	defaultOb.material_id = 0;
+	mesh->objects.push_back(defaultOb);
+}
+
+// single pass over the mapped text, numbers are read in place without copying lines
+void OBJLoader::parse_chunk(const char* p, const char* end, Chunk& chunk)
+{
+	std::string token;
+
+	// negative indices are relative to what was read so far, inside the chunk they can
+	// point before its first element so they are fixed up when the chunks are stitched
+	auto resolve = [&chunk](int index, int count, unsigned int slot)
+	{
+		if (index >= 0) return index - 1;
+		chunk.relative_slots.push_back(slot);
+		return count + index;
+	};
+
+	while (p < end)
+	{
+		p = skip_blanks(p, end);
+		if (p >= end) break;
+
+		const char* args = p + 1;
+		switch (*p)
+		{
+		case 'v':
+			if (args < end && is_blank(*args))
+			{
+				glm::vec3 v(0.f);
+				p = parse_floats(args, end, &v.x, 3);
+				chunk.vertices.push_back(v);
+			}
+			else if (args + 1 < end && args[0] == 't' && is_blank(args[1]))
+			{
+				glm::vec2 vt(0.f);
+				p = parse_floats(args + 1, end, &vt.x, 2);
+				chunk.texcoords.push_back(vt);
+			}
+			else if (args + 1 < end && args[0] == 'n' && is_blank(args[1]))
+			{
+				glm::vec3 n(0.f);
+				p = parse_floats(args + 1, end, &n.x, 3);
+				chunk.normals.push_back(n);
+			}
+			break;
+		case 'f':
+			if (args < end && is_blank(*args))
+			{
+				// v, v/vt, v//vn or v/vt/vn corners, missing indices are 0
+				glm::ivec3 corners[32];
+				int count = 0;
+				p = args;
+				while (count < 32)
+				{
+					p = skip_blanks(p, end);
+					int v, vt = 0, vn = 0;
+					const char* next = parse_int(p, end, v);
+					if (next == nullptr) break;
+					p = next;
+					if (p < end && *p == '/')
+					{
+						p++;
+						if ((next = parse_int(p, end, vt)) != nullptr) p = next;
+						if (p < end && *p == '/')
+						{
+							p++;
+							if ((next = parse_int(p, end, vn)) != nullptr) p = next;
+						}
+					}
+					corners[count++] = glm::ivec3(v, vn, vt);
+				}
+
+				// triangles and quads are split the same way as read_faceLimited,
+				// larger polygons continue as a fan around the first corner
+				for (int i = 2; i < count; i++)
+				{
+					const glm::ivec3* triangle[3] = {
+						(i == 3) ? &corners[2] : &corners[0],
+						(i == 3) ? &corners[3] : &corners[i - 1],
+						(i == 3) ? &corners[0] : &corners[i] };
+
+					unsigned int slot = 9 * (unsigned int)chunk.faces.size();
+					Face face;
+					for (int c = 0; c < 3; c++)
+					{
+						const glm::ivec3& corner = *triangle[c];
+						face.vertices[c] = resolve(corner.x, (int)chunk.vertices.size(), slot + c);
+						face.normals[c] = corner.y == 0 ? -1 : resolve(corner.y, (int)chunk.normals.size(), slot + 3 + c);
+						face.texcoords[c] = corner.z == 0 ? -1 : resolve(corner.z, (int)chunk.texcoords.size(), slot + 6 + c);
+					}
+					chunk.faces.push_back(face);
+				}
+			}
+			break;
+		case 'u':
+			if (match_keyword(p, end, "usemtl", 6))
+			{
+				p = read_token(p + 6, end, token);
+				chunk.statements.push_back({ Chunk::USEMTL, (unsigned int)chunk.faces.size(), token });
+			}
+			break;
+		case 'm':
+			if (match_keyword(p, end, "mtllib", 6))
+			{
+				p = read_token(p + 6, end, token);
+				chunk.statements.push_back({ Chunk::MTLLIB, (unsigned int)chunk.faces.size(), token });
+			}
+			break;
+		case 'g':
+		case 'o':
+			if (args >= end || is_blank(*args) || *args == '\n')
+			{
+				p = read_token(args, end, token);
+				chunk.statements.push_back({ Chunk::GROUP, (unsigned int)chunk.faces.size(), token });
+			}
+			break;
+		default: /* comments and unsupported statements are ignored */
+			break;
+		}
+
+		p = skip_line(p, end);
+	}
+}
+
+// append the chunks in file order, the result is the same as parsing the file as a single chunk
+void OBJLoader::stitch_chunks(std::vector<Chunk>& chunks)
+{
+	size_t vertex_count = 0, normal_count = 0, texcoord_count = 0, face_count = 0;
+	for (auto& chunk : chunks)
+	{
+		vertex_count += chunk.vertices.size();
+		normal_count += chunk.normals.size();
+		texcoord_count += chunk.texcoords.size();
+		face_count += chunk.faces.size();
+	}
+	shared_vertices.reserve(vertex_count);
+	shared_normals.reserve(normal_count);
+	shared_textcoord.reserve(texcoord_count);
+	shared_faces.reserve(face_count);
+	elements.reserve(face_count * 3);
+
+	int currentMaterialID = 0;
+
+	for (auto& chunk : chunks)
+	{
+		const int bases[3] = { (int)shared_vertices.size(), (int)shared_normals.size(), (int)shared_textcoord.size() };
+		const unsigned int first_face = (unsigned int)shared_faces.size();
+
+		for (unsigned int slot : chunk.relative_slots)
+		{
+			Face& face = chunk.faces[slot / 9];
+			glm::ivec3& component = (slot % 9 < 3) ? face.vertices : (slot % 9 < 6) ? face.normals : face.texcoords;
+			component[slot % 3] += bases[(slot % 9) / 3];
+		}
+
+		shared_vertices.insert(shared_vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+		shared_normals.insert(shared_normals.end(), chunk.normals.begin(), chunk.normals.end());
+		shared_textcoord.insert(shared_textcoord.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+		shared_faces.insert(shared_faces.end(), chunk.faces.begin(), chunk.faces.end());
+
+		for (auto& face : chunk.faces)
+		{
+			elements.push_back(face.vertices.x);
+			elements.push_back(face.vertices.y);
+			elements.push_back(face.vertices.z);
+		}
+
+		for (auto& statement : chunk.statements)
+		{
+			unsigned int face = first_face + statement.face;
+			if (statement.type == Chunk::USEMTL) read_usemtl(statement.name, face, currentMaterialID);
+			else if (statement.type == Chunk::MTLLIB) read_mtllib(statement.name);
+			else add_new_group(statement.name, face, currentMaterialID);
+		}
+
+		// release the chunk as soon as it is copied
+		chunk = Chunk();
+	}
+}
+
+GeometricMesh* OBJLoader::finish_mesh()
+{
 	// Generate vertices and other data from faces
-	generateDataFromFaces();
+	if (indexedOutput) generateIndexedDataFromFaces();
+	else generateDataFromFaces();
 
 	// close the last object
-	mesh->objects.back().end = (unsigned int)mesh->vertices.size();
+	mesh->objects.back().end = (unsigned int)(indexedOutput ? mesh->indices.size() : mesh->vertices.size());
 
 	printf("Done reading OBJ file \n");
 
+	// bounds of the vertices
+	if (!mesh->vertices.empty())
+	{
+		mesh->aabb_min = glm::vec3(std::numeric_limits<float>::max());
+		mesh->aabb_max = glm::vec3(-std::numeric_limits<float>::max());
+		for (auto& v : mesh->vertices)
+		{
+			mesh->aabb_min = glm::min(mesh->aabb_min, v);
+			mesh->aabb_max = glm::max(mesh->aabb_max, v);
+		}
+	}
+
 	// remove empty objects
-	mesh->objects.erase(std::remove_if(mesh->objects.begin(), mesh->objects.end(), [](GeometricMesh::MeshObject ob) { return ob.start == ob.end; }), mesh->objects.end());
+	mesh->objects.erase(std::remove_if(mesh->objects.begin(), mesh->objects.end(), [](const GeometricMesh::MeshObject& ob) { return ob.start == ob.end; }), mesh->objects.end());
 
 	// if normals doesn't exist create them
 	if (mesh->normals.empty())
@@ -98,14 +528,16 @@ GeometricMesh* OBJLoader::load(const char* filename)
 	}
 
 	// check if we loaded an normal map
-	if (std::find_if(mesh->materials.begin(), mesh->materials.end(), [](OBJMaterial mat) { return mat.textureBump.length() > 0; }) != mesh->materials.end() ||
-		std::find_if(mesh->materials.begin(), mesh->materials.end(), [](OBJMaterial mat) { return mat.textureNormal.length() > 0; }) != mesh->materials.end())
+	if (std::find_if(mesh->materials.begin(), mesh->materials.end(), [](const OBJMaterial& mat) { return mat.textureBump.length() > 0; }) != mesh->materials.end() ||
+		std::find_if(mesh->materials.begin(), mesh->materials.end(), [](const OBJMaterial& mat) { return mat.textureNormal.length() > 0; }) != mesh->materials.end())
 	{
 		calculate_tangents();
 		hasNormals = true;
 	}
 
-	return mesh;
+	GeometricMesh* result = mesh;
+	mesh = nullptr;
+	return result;
 }
 
 // read vertices x,y,z
@@ -299,6 +731,70 @@ void OBJLoader::generateDataFromFaces()
 	}
 }
 
+// the corners with the same (v, vt, vn) become a single vertex
+void OBJLoader::generateIndexedDataFromFaces()
+{
+	hasTextures = !shared_textcoord.empty();
+
+	// the unique corners of each position are chained, so only the few that share it are compared
+	std::vector<int> first_corner(shared_vertices.size(), -1);
+	std::vector<int> next_corner;
+	std::vector<glm::ivec3> corners;
+
+	mesh->indices.reserve(shared_faces.size() * 3);
+
+	for (auto& face : shared_faces)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			glm::ivec3 corner(face.vertices[c], face.normals[c], face.texcoords[c]);
+
+			int index = first_corner[corner.x];
+			while (index != -1 && corners[index] != corner)
+				index = next_corner[index];
+
+			if (index == -1)
+			{
+				index = (int)corners.size();
+				corners.push_back(corner);
+				next_corner.push_back(first_corner[corner.x]);
+				first_corner[corner.x] = index;
+			}
+			mesh->indices.push_back(index);
+		}
+	}
+
+	mesh->vertices.reserve(corners.size());
+	mesh->normals.reserve(corners.size());
+	if (hasTextures)
+		mesh->textureCoord.reserve(corners.size());
+
+	bool missingNormals = false;
+	for (auto& corner : corners)
+	{
+		mesh->vertices.push_back(shared_vertices[corner.x]);
+		mesh->normals.push_back(corner.y >= 0 ? shared_normals[corner.y] : glm::vec3(0.f));
+		missingNormals |= corner.y < 0;
+		if (hasTextures)
+			mesh->textureCoord.push_back(corner.z >= 0 ? shared_textcoord[corner.z] : glm::vec2(0.f));
+	}
+
+	// the corners without a normal get the average of the faces around their position
+	if (missingNormals)
+	{
+		printf("normals not found\n");
+
+		std::vector<glm::vec3> corner_normals;
+		calculate_avg_normals(shared_vertices, corner_normals, elements);
+		for (size_t i = 0; i < mesh->indices.size(); i++)
+		{
+			unsigned int index = mesh->indices[i];
+			if (corners[index].y < 0)
+				mesh->normals[index] = corner_normals[i];
+		}
+	}
+}
+
 void OBJLoader::calculate_flat_normals()
 {
 	for (unsigned int i = 0; i < mesh->vertices.size(); i++)
@@ -359,17 +855,26 @@ void OBJLoader::calculate_avg_normals(std::vector<glm::vec3>& shared_vertices, s
 
 void OBJLoader::calculate_tangents()
 {
-	mesh->tangents.clear();
+	// the triangle tangents are summed on the vertices they share
+	const bool indexed = !mesh->indices.empty();
+	const size_t corner_count = indexed ? mesh->indices.size() : mesh->vertices.size();
 
-	for (unsigned int i = 0; i < mesh->vertices.size(); i += 3)
+	mesh->tangents.assign(mesh->vertices.size(), glm::vec3(0.f));
+	mesh->bitangents.assign(mesh->vertices.size(), glm::vec3(0.f));
+
+	for (size_t i = 0; i + 2 < corner_count; i += 3)
 	{
-		glm::vec3& v0 = mesh->vertices[i + 0];
-		glm::vec3& v1 = mesh->vertices[i + 1];
-		glm::vec3& v2 = mesh->vertices[i + 2];
+		unsigned int i0 = indexed ? mesh->indices[i + 0] : (unsigned int)i + 0;
+		unsigned int i1 = indexed ? mesh->indices[i + 1] : (unsigned int)i + 1;
+		unsigned int i2 = indexed ? mesh->indices[i + 2] : (unsigned int)i + 2;
+
+		glm::vec3& v0 = mesh->vertices[i0];
+		glm::vec3& v1 = mesh->vertices[i1];
+		glm::vec3& v2 = mesh->vertices[i2];
 
-		glm::vec2& uv0 = mesh->textureCoord[i + 0];
-		glm::vec2& uv1 = mesh->textureCoord[i + 1];
-		glm::vec2& uv2 = mesh->textureCoord[i + 2];
+		glm::vec2& uv0 = mesh->textureCoord[i0];
+		glm::vec2& uv1 = mesh->textureCoord[i1];
+		glm::vec2& uv2 = mesh->textureCoord[i2];
 
 		// edges of the triangle : position delta
 		glm::vec3 deltaPos1 = v1 - v0;
@@ -379,20 +884,22 @@ void OBJLoader::calculate_tangents()
 		glm::vec2 deltaUV1 = uv1 - uv0;
 		glm::vec2 deltaUV2 = uv2 - uv0;
 
-		float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+		// triangles without a uv area have no tangent
+		float determinant = deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x;
+		if (determinant == 0.0f)
+			continue;
+
+		float r = 1.0f / determinant;
 		glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
 		glm::vec3 b = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
 
-		// set the same tangent for all the three vertices of the triangle.
-		// they will be merged later
+		mesh->tangents[i0] += tangent;
+		mesh->tangents[i1] += tangent;
+		mesh->tangents[i2] += tangent;
 
-		mesh->tangents.push_back(tangent);
-		mesh->tangents.push_back(tangent);
-		mesh->tangents.push_back(tangent);
-
-		mesh->bitangents.push_back(b);
-		mesh->bitangents.push_back(b);
-		mesh->bitangents.push_back(b);
+		mesh->bitangents[i0] += b;
+		mesh->bitangents[i1] += b;
+		mesh->bitangents[i2] += b;
 	}
 
 	for (unsigned int i = 0; i < mesh->vertices.size(); i += 1)
@@ -402,7 +909,14 @@ void OBJLoader::calculate_tangents()
 		glm::vec3& b = mesh->bitangents[i];
 
 		// Gram-Schmidt orthogonalize
-		t = glm::normalize(t - n * glm::dot(n, t));
+		t = t - n * glm::dot(n, t);
+
+		// any direction on the surface when the tangents cancelled out
+		if (glm::dot(t, t) < 1e-20f)
+			t = glm::cross(n, std::abs(n.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f));
+		t = glm::normalize(t);
+		if (glm::dot(b, b) < 1e-20f)
+			b = glm::cross(n, t);
 
 		// Calculate handedness
 		if (glm::dot(glm::cross(n, t), b) < 0.0f) {
@@ -411,23 +925,18 @@ void OBJLoader::calculate_tangents()
 	}
 }
 
-void OBJLoader::read_usemtl(const char* buff, int& currentMaterialID)
+void OBJLoader::read_usemtl(const std::string& str, unsigned int face, int& currentMaterialID)
 {
-	char temp[1024];
-	sscanf(buff, "%s", temp);
-	// read the material
-	std::string str(temp);
-
 	//check if we have already defined a material
 	if (mesh->objects.back().material_id > 0)
 	{
 		// set where the current object ends
-		mesh->objects.back().end = 3 * (unsigned int)shared_faces.size();
+		mesh->objects.back().end = 3 * face;
 		//create a new MeshObject
 		GeometricMesh::MeshObject mo;
 		mo.name = mesh->objects.back().name;
 		mo.material_id = mesh->findMaterialID(str);
-		mo.start = 3 * (unsigned int)shared_faces.size();
+		mo.start = 3 * face;
 		mesh->objects.push_back(mo);
 	}
 	else
@@ -436,28 +945,19 @@ void OBJLoader::read_usemtl(const char* buff, int& currentMaterialID)
 	}
 	currentMaterialID = mesh->objects.back().material_id;
 }
-void OBJLoader::read_mtllib(const char* buff, const char* filename)
+void OBJLoader::read_mtllib(const std::string& str)
 {
-	char temp[1024];
-	sscanf(buff, "%s", temp);
-
-	std::string str(temp);
-	std::string folder(filename);
-	folder = folderPath;
-	str = folder + str;
-	parseMTL(str.c_str());
+	materialFiles.push_back(folderPath + str);
+	parseMTL(materialFiles.back().c_str());
 }
-void OBJLoader::add_new_group(const char* buff, int& currentMaterialID)
+void OBJLoader::add_new_group(const std::string& name, unsigned int face, int& currentMaterialID)
 {
-	char name[1024];
-	sscanf(buff, "%s", name);
-
 	// end the previous MeshObject
-	mesh->objects.back().end = 3 * (unsigned int)shared_faces.size();
+	mesh->objects.back().end = 3 * face;
 
 	// create a new object
 	GeometricMesh::MeshObject mo;
-	mo.start = 3 * (unsigned int)shared_faces.size();
+	mo.start = 3 * face;
 	mo.material_id = currentMaterialID;
 	mo.name = name;
 	mesh->objects.push_back(mo);
@@ -465,13 +965,15 @@ void OBJLoader::add_new_group(const char* buff, int& currentMaterialID)
 
 void OBJLoader::parseMTL(const char* filename)
 {
-	std::ifstream in(filename, std::ios::in);
-	if (!in)
+	VirtualFile file;
+	if (!VirtualFileSystem::GetInstance().Open(filename, file))
 	{
 		std::cerr << "Cannot open material " << filename << std::endl;
 		exit(1);
 	}
 	printf("Opened %s\n", filename);
+	std::istringstream in(std::string(file.Data(), file.Size()));
+	file.Close();
 
 	std::string folder(filename);
 	folder = Tools::GetFolderPath(folder.c_str());
@@ -488,6 +990,8 @@ void OBJLoader::parseMTL(const char* filename)
 	std::string line;
 	while (getline(in, line))
 	{
+		// the text is not read in text mode, so windows line endings are still there
+		if (!line.empty() && line.back() == '\r') line.pop_back();
 		if (line.size() == 0) continue;
 
 		{
@@ -612,5 +1116,330 @@ void OBJLoader::parseMTL(const char* filename)
 		else if (line[0] == '#') { /* ignoring this line */ }
 		else { /* ignoring this line */ }
 	}
-	in.close();
-}
\ No newline at end of file
+}
+
+// Binary cache
+// a .meshbin holds the finished mesh, so it is copied out of the mapped file without parsing.
+// It records the size and write time of the OBJ and of its mtllib files and is ignored
+// as soon as one of them changes or the format version differs.
+namespace
+{
+	const char meshbin_magic[8] = { 'M', 'E', 'S', 'H', 'B', 'I', 'N', 0 };
+	const uint32_t meshbin_version = 1;
+
+	struct MeshBinHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t header_size;
+		uint64_t file_size;
+
+		uint64_t source_size;
+		int64_t source_modified;
+		uint64_t source_hash;
+
+		uint32_t dependency_count;
+		uint32_t object_count;
+		uint32_t material_count;
+		uint32_t vertex_count;
+		uint32_t normal_count;
+		uint32_t texcoord_count;
+		uint32_t tangent_count;
+		uint32_t index_count;
+
+		float aabb_min[3];
+		float aabb_max[3];
+	};
+
+	struct BinaryWriter
+	{
+		std::vector<char> data;
+
+		void write(const void* source, size_t size)
+		{
+			const char* bytes = static_cast<const char*>(source);
+			data.insert(data.end(), bytes, bytes + size);
+		}
+		template<typename T> void write(const T& value) { write(&value, sizeof(T)); }
+		void write(const std::string& str)
+		{
+			write((uint32_t)str.size());
+			write(str.data(), str.size());
+		}
+		template<typename T> void write(const std::vector<T>& values)
+		{
+			if (!values.empty()) write(values.data(), values.size() * sizeof(T));
+		}
+	};
+
+	// reads stop at the end of the file and clear ok
+	struct BinaryReader
+	{
+		const char* p;
+		const char* end;
+		bool ok;
+
+		void read(void* destination, size_t size)
+		{
+			if (!ok || (size_t)(end - p) < size) { ok = false; return; }
+			memcpy(destination, p, size);
+			p += size;
+		}
+		template<typename T> void read(T& value) { read(&value, sizeof(T)); }
+		void read(std::string& str)
+		{
+			uint32_t size = 0;
+			read(size);
+			if (!ok || (size_t)(end - p) < size) { ok = false; return; }
+			str.assign(p, size);
+			p += size;
+		}
+		template<typename T> void read(std::vector<T>& values, size_t count)
+		{
+			if (!ok || (size_t)(end - p) / sizeof(T) < count) { ok = false; return; }
+			values.resize(count);
+			read(values.data(), count * sizeof(T));
+		}
+	};
+
+	bool same_file(const char* filename, uint64_t size, int64_t modified)
+	{
+		Tools::FileInfo info;
+		return Tools::GetFileInfo(filename, info) && info.size == size && info.modified == modified;
+	}
+
+	// opens the .meshbin of filename and checks it against the current sources, the reader is left after the dependencies
+	// the ones in archives are cooked together with their sources and are not checked
+	bool open_meshbin(const char* filename, VirtualFile& file, MeshBinHeader& header, BinaryReader& reader)
+	{
+		if (!VirtualFileSystem::GetInstance().Open(OBJLoader::binaryFilename(filename).c_str(), file))
+			return false;
+
+		reader.p = file.Data();
+		reader.end = file.Data() + file.Size();
+		reader.ok = true;
+		reader.read(header);
+
+		if (!reader.ok || memcmp(header.magic, meshbin_magic, sizeof(meshbin_magic)) != 0 ||
+			header.version != meshbin_version || header.header_size != sizeof(MeshBinHeader) ||
+			header.file_size != file.Size() || (!file.IsPacked() && !same_file(filename, header.source_size, header.source_modified)))
+			return false;
+
+		for (uint32_t i = 0; i < header.dependency_count; i++)
+		{
+			uint64_t size = 0;
+			int64_t modified = 0;
+			std::string dependency;
+			reader.read(size);
+			reader.read(modified);
+			reader.read(dependency);
+			if (!reader.ok || (!file.IsPacked() && !same_file(dependency.c_str(), size, modified)))
+				return false;
+		}
+		return true;
+	}
+}
+
+std::string OBJLoader::binaryFilename(const char* filename)
+{
+	std::string path(filename);
+	size_t extension = path.find_last_of('.');
+	if (extension != std::string::npos && path.find_first_of("/\\", extension) == std::string::npos)
+		path.erase(extension);
+	return path + ".meshbin";
+}
+
+uint64_t OBJLoader::contentHash(const char* filename, const char* data, size_t size)
+{
+	std::string folder = Tools::GetFolderPath(filename);
+	return Tools::HashBytes(data, size, Tools::HashBytes(folder.data(), folder.size()));
+}
+
+bool OBJLoader::binaryContentHash(const char* filename, uint64_t& hash)
+{
+	VirtualFile file;
+	MeshBinHeader header;
+	BinaryReader reader;
+	if (!open_meshbin(filename, file, header, reader))
+		return false;
+
+	hash = header.source_hash;
+	return true;
+}
+
+bool OBJLoader::binaryCounts(const char* filename, size_t& vertices, size_t& indices)
+{
+	VirtualFile file;
+	MeshBinHeader header;
+	BinaryReader reader;
+	if (!open_meshbin(filename, file, header, reader))
+		return false;
+
+	vertices = header.vertex_count;
+	indices = header.index_count > 0 ? header.index_count : header.vertex_count;
+	return true;
+}
+
+GeometricMesh* OBJLoader::loadBinary(const char* filename)
+{
+	VirtualFile file;
+	MeshBinHeader header;
+	BinaryReader reader;
+	if (!open_meshbin(filename, file, header, reader))
+		return nullptr;
+
+	GeometricMesh* mesh = new GeometricMesh();
+
+	mesh->objects.resize(header.object_count);
+	for (auto& object : mesh->objects)
+	{
+		int32_t material_id = 0;
+		reader.read(material_id);
+		reader.read(object.start);
+		reader.read(object.end);
+		reader.read(object.name);
+		object.material_id = material_id;
+	}
+
+	mesh->materials.resize(header.material_count);
+	for (auto& material : mesh->materials)
+	{
+		int32_t illumination_model = 0;
+		reader.read(material.name);
+		reader.read(material.ambient);
+		reader.read(material.diffuse);
+		reader.read(material.specular);
+		reader.read(material.alpha);
+		reader.read(material.shininess);
+		reader.read(material.metallic);
+		reader.read(illumination_model);
+		reader.read(material.textureDiffuse);
+		reader.read(material.textureSpecular);
+		reader.read(material.textureAmbient);
+		reader.read(material.textureBump);
+		reader.read(material.textureNormal);
+		reader.read(material.textureSpecularity);
+		reader.read(material.textureOpacity);
+		material.illumination_model = illumination_model;
+	}
+
+	reader.read(mesh->vertices, header.vertex_count);
+	reader.read(mesh->normals, header.normal_count);
+	reader.read(mesh->textureCoord, header.texcoord_count);
+	reader.read(mesh->tangents, header.tangent_count);
+	reader.read(mesh->bitangents, header.tangent_count);
+	reader.read(mesh->indices, header.index_count);
+
+	mesh->aabb_min = glm::vec3(header.aabb_min[0], header.aabb_min[1], header.aabb_min[2]);
+	mesh->aabb_max = glm::vec3(header.aabb_max[0], header.aabb_max[1], header.aabb_max[2]);
+
+	if (!reader.ok || reader.p != reader.end)
+	{
+		printf("ObjLoader: %s is damaged, it will be rebuilt\n", binaryFilename(filename).c_str());
+		delete mesh;
+		return nullptr;
+	}
+
+	printf("Read %s\n", binaryFilename(filename).c_str());
+	return mesh;
+}
+
+bool OBJLoader::saveBinary(const char* filename, size_t size, uint64_t hash, const GeometricMesh* mesh)
+{
+	// only describe the text that was parsed
+	Tools::FileInfo source;
+	if (mesh == nullptr || !Tools::GetFileInfo(filename, source) || source.size != size)
+		return false;
+
+	std::vector<char> data;
+	if (!serializeBinary(filename, hash, mesh, true, data))
+		return false;
+
+	std::string binary = binaryFilename(filename);
+	if (!Tools::WriteFileAtomic(binary.c_str(), data.data(), data.size()))
+	{
+		printf("ObjLoader: could not write %s\n", binary.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool OBJLoader::serializeBinary(const char* filename, uint64_t hash, const GeometricMesh* mesh, bool stamped, std::vector<char>& data)
+{
+	// archives have no write times, their .meshbin files are trusted instead
+	Tools::FileInfo source = {};
+	if (mesh == nullptr || (stamped && !Tools::GetFileInfo(filename, source)))
+		return false;
+
+	MeshBinHeader header = {};
+	memcpy(header.magic, meshbin_magic, sizeof(meshbin_magic));
+	header.version = meshbin_version;
+	header.header_size = sizeof(MeshBinHeader);
+	header.source_size = source.size;
+	header.source_modified = source.modified;
+	header.source_hash = hash;
+	header.dependency_count = (uint32_t)materialFiles.size();
+	header.object_count = (uint32_t)mesh->objects.size();
+	header.material_count = (uint32_t)mesh->materials.size();
+	header.vertex_count = (uint32_t)mesh->vertices.size();
+	header.normal_count = (uint32_t)mesh->normals.size();
+	header.texcoord_count = (uint32_t)mesh->textureCoord.size();
+	header.tangent_count = (uint32_t)mesh->tangents.size();
+	header.index_count = (uint32_t)mesh->indices.size();
+	memcpy(header.aabb_min, &mesh->aabb_min.x, sizeof(header.aabb_min));
+	memcpy(header.aabb_max, &mesh->aabb_max.x, sizeof(header.aabb_max));
+
+	BinaryWriter writer;
+	writer.write(header);
+
+	for (auto& dependency : materialFiles)
+	{
+		Tools::FileInfo info = {};
+		if (stamped && !Tools::GetFileInfo(dependency.c_str(), info))
+			return false;
+		writer.write(info.size);
+		writer.write(info.modified);
+		writer.write(dependency);
+	}
+
+	for (auto& object : mesh->objects)
+	{
+		writer.write((int32_t)object.material_id);
+		writer.write(object.start);
+		writer.write(object.end);
+		writer.write(object.name);
+	}
+
+	for (auto& material : mesh->materials)
+	{
+		writer.write(material.name);
+		writer.write(material.ambient);
+		writer.write(material.diffuse);
+		writer.write(material.specular);
+		writer.write(material.alpha);
+		writer.write(material.shininess);
+		writer.write(material.metallic);
+		writer.write((int32_t)material.illumination_model);
+		writer.write(material.textureDiffuse);
+		writer.write(material.textureSpecular);
+		writer.write(material.textureAmbient);
+		writer.write(material.textureBump);
+		writer.write(material.textureNormal);
+		writer.write(material.textureSpecularity);
+		writer.write(material.textureOpacity);
+	}
+
+	writer.write(mesh->vertices);
+	writer.write(mesh->normals);
+	writer.write(mesh->textureCoord);
+	writer.write(mesh->tangents);
+	writer.write(mesh->bitangents);
+	writer.write(mesh->indices);
+
+	// the total size is only known now
+	uint64_t file_size = writer.data.size();
+	memcpy(writer.data.data() + offsetof(MeshBinHeader, file_size), &file_size, sizeof(file_size));
+
+	data.swap(writer.data);
+	return true;
+}
@@ -2,8 +2,9 @@
 
 #include "glm/glm.hpp"
 #include <vector>
+#include <string>
+#include <cstdint>
 #include <unordered_map>
-#include <future>
 #include "GeometricMesh.h"
 
 struct OBJMaterial
@@ -77,29 +78,99 @@ class OBJLoader
 	bool hasTextures;
 	bool hasNormals;
 
+	// what is read from one line aligned slice of the file
+	// the statements that depend on the previous lines (usemtl, mtllib, g, o)
+	// are only recorded with their face position and replayed in file order
+	struct Chunk
+	{
+		enum StatementType { USEMTL, MTLLIB, GROUP };
+		struct Statement
+		{
+			StatementType type;
+			unsigned int face;
+			std::string name;
+		};
+
+		std::vector<glm::vec3> vertices;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> texcoords;
+		std::vector<Face> faces;
+		std::vector<Statement> statements;
+		// negative indices are resolved against the chunk, these face slots
+		// (face * 9 + component * 3 + corner) still need the previous chunks counts
+		std::vector<unsigned int> relative_slots;
+	};
+
 	std::string folderPath;
 
 	class GeometricMesh* mesh;
 
+	unsigned int threadCount;
+	size_t minimumChunkSize;
+	bool indexedOutput;
+	bool binaryCache;
+	// the mtllib files of the current mesh, the binary cache depends on them too
+	std::vector<std::string> materialFiles;
+
 public:
 	OBJLoader(void);
 	~OBJLoader(void);
 
+	// reads the binary cache of the file when it is up to date, otherwise
+	// memory maps the file, scans it in place and writes the binary cache
 	class GeometricMesh* load(const char* filename);
+	// parses text that is already in memory, filename is only used to find the mtllib files
+	// and hash is its contentHash, which is stored in the binary cache
+	class GeometricMesh* load(const char* filename, const char* data, size_t size, uint64_t hash);
+	// the original fgets/sscanf reader, kept as a reference for comparisons
+	class GeometricMesh* loadStdio(const char* filename);
+
+	// files larger than two chunks are split in line aligned chunks that are parsed
+	// as jobs of the JobSystem (0 makes one chunk per job thread, 1 keeps it serial)
+	void setParallelism(unsigned int threads, size_t minimum_chunk_bytes = 1 << 20);
+
+	// weld the identical (v, vt, vn) corners and output an index buffer (default),
+	// or output three separate vertices for each triangle
+	void setIndexedOutput(bool indexed) { indexedOutput = indexed; }
+
+	// keep a .meshbin next to every parsed OBJ (default on)
+	void setBinaryCache(bool enabled) { binaryCache = enabled; }
+
+	// the .meshbin that belongs to an OBJ file
+	static std::string binaryFilename(const char* filename);
+	// hash of the OBJ text, the folder is included because the mtllib paths are relative to it
+	static uint64_t contentHash(const char* filename, const char* data, size_t size);
+	// the content hash recorded in an up to date .meshbin, without reading the OBJ
+	static bool binaryContentHash(const char* filename, uint64_t& hash);
+	// the vertex and index counts of an up to date .meshbin, without reading the mesh; the
+	// meshes without indices count one index per vertex, as they are drawn
+	static bool binaryCounts(const char* filename, size_t& vertices, size_t& indices);
+	// the mesh of an up to date .meshbin, nullptr if it is missing or stale
+	static class GeometricMesh* loadBinary(const char* filename);
+	// the .meshbin contents of the mesh returned by the last load, without the
+	// write times of the sources when stamped is false (for archives)
+	bool serializeBinary(const char* filename, uint64_t hash, const class GeometricMesh* mesh, bool stamped, std::vector<char>& data);
 
 private:
+	void begin_mesh(const char* filename);
+	static void parse_chunk(const char* begin, const char* end, Chunk& chunk);
+	void stitch_chunks(std::vector<Chunk>& chunks);
+	class GeometricMesh* finish_mesh();
+	bool saveBinary(const char* filename, size_t size, uint64_t hash, const class GeometricMesh* mesh);
+
 	void read_vertex(const char* buff);
 	void read_texcoord(const char* buff);
 	void read_normal(const char* buff);
 	void read_face(const char* buff);
 	void read_faceLimited(const char* buff);
 	glm::ivec3 read_face_component(const char* buff, int& offset);
-	void read_usemtl(const char* buff, int& currentMaterialID);
-	void read_mtllib(const char* buff, const char* filename);
-	void add_new_group(const char* buff, int& currentMaterialID);
+	void read_usemtl(const std::string& name, unsigned int face, int& currentMaterialID);
+	void read_mtllib(const std::string& name);
+	void add_new_group(const std::string& name, unsigned int face, int& currentMaterialID);
 	void parseMTL(const char* filename);
 
 	void generateDataFromFaces();
+	void generateIndexedDataFromFaces();
 
 	void calculate_flat_normals();
 	void calculate_avg_normals(std::vector<glm::vec3>& shared_vertices, std::vector<glm::vec3>& normals, std::vector<unsigned int>& elements);
@@ -0,0 +1,56 @@
+#ifndef PACK_FILE_H
+#define PACK_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <algorithm>
+
+// Layout of the .pak archives written by the AssetCooker
+// [header][payloads, each one 64 byte aligned][table of contents][names]
+// the table of contents is sorted by name, names are stored without a terminating zero
+namespace PackFile
+{
+	const char Magic[8] = { 'D', 'G', 'N', 'P', 'A', 'K', 0, 0 };
+	const uint32_t Version = 1;
+	const uint64_t Alignment = 64;
+
+	enum EntryFlags
+	{
+		COMPRESSED_LZ4 = 1
+	};
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t entry_count;
+		uint64_t toc_offset;
+		uint64_t names_offset;
+		uint64_t names_size;
+		uint8_t padding[24];
+	};
+
+	struct Entry
+	{
+		uint64_t offset;
+		uint64_t stored_size;
+		uint64_t size;
+		// FNV-1a of the uncompressed data
+		uint64_t hash;
+		uint32_t name_offset;
+		uint32_t name_length;
+		uint32_t flags;
+		uint32_t padding;
+	};
+
+	// the names are kept with forward slashes and in lower case, like the windows file system
+	// looks them up, so "Assets\Dungeon\maps\X.png" and "assets/dungeon/maps/x.png" are one entry
+	inline std::string NormalizeName(std::string name)
+	{
+		std::replace(name.begin(), name.end(), '\\', '/');
+		std::transform(name.begin(), name.end(), name.begin(), [](char c) { return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c; });
+		return name;
+	}
+};
+
+#endif
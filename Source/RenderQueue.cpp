@@ -0,0 +1,259 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	const GLuint UNBOUND = ~0u;
+	const size_t NO_INSTANCE = ~(size_t)0;
+
+	bool same_textures(const GeometryNode::Objects& a, const GeometryNode::Objects& b)
+	{
+		return a.diffuse_textureID == b.diffuse_textureID && a.mask_textureID == b.mask_textureID && a.bump_textureID == b.bump_textureID &&
+			a.normal_textureID == b.normal_textureID && a.emissive_textureID == b.emissive_textureID;
+	}
+}
+
+uint64_t RenderQueue::MakeKey(unsigned int pass, unsigned int program, unsigned int material, unsigned int mesh, float depth)
+{
+	const uint64_t depth_bits = (uint64_t)(std::min(std::max(depth, 0.f), 1.f) * ((1 << DEPTH_BITS) - 1));
+	return ((uint64_t)(pass & 0xf) << 60) |
+		((uint64_t)(program & 0xf) << 56) |
+		((uint64_t)(material & ((1 << MATERIAL_BITS) - 1)) << (MESH_BITS + DEPTH_BITS)) |
+		((uint64_t)(mesh & ((1 << MESH_BITS) - 1)) << DEPTH_BITS) |
+		depth_bits;
+}
+
+bool RenderQueue::MaterialKey::operator==(const MaterialKey& other) const
+{
+	return memcmp(this, &other, sizeof(MaterialKey)) == 0;
+}
+
+size_t RenderQueue::MaterialHash::operator()(const MaterialKey& key) const
+{
+	// FNV-1a over the bytes of the key
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&key);
+	size_t hash = 2166136261u;
+	for (size_t i = 0; i < sizeof(MaterialKey); i++)
+		hash = (hash ^ bytes[i]) * 16777619u;
+	return hash;
+}
+
+RenderQueue::RenderQueue()
+{
+	m_sorting = true;
+	m_instance_count = 0;
+	m_statistics = {};
+}
+
+void RenderQueue::Clear()
+{
+	m_items.clear();
+	m_materials.clear();
+	m_material_indices.clear();
+	m_mesh_indices.clear();
+	m_instance_count = 0;
+	m_statistics = {};
+}
+
+unsigned int RenderQueue::AddMaterial(const GeometryNode::Objects& part)
+{
+	if (m_sorting)
+	{
+		MaterialKey key;
+		const float values[11] = { part.diffuse.x, part.diffuse.y, part.diffuse.z, part.ambient.x, part.ambient.y, part.ambient.z,
+			part.specular.x, part.specular.y, part.specular.z, part.shininess, part.metallic };
+		memcpy(key.values, values, sizeof(values));
+		key.textures[0] = part.diffuse_textureID;
+		key.textures[1] = part.mask_textureID;
+		key.textures[2] = part.bump_textureID;
+		key.textures[3] = part.normal_textureID;
+		key.textures[4] = part.emissive_textureID;
+
+		auto found = m_material_indices.emplace(key, (unsigned int)m_materials.size());
+		if (!found.second)
+		{
+			m_statistics.material_uploads_skipped++;
+			return found.first->second;
+		}
+	}
+
+	m_statistics.material_uploads++;
+	m_materials.push_back(&part);
+	return (unsigned int)(m_materials.size() - 1);
+}
+
+void RenderQueue::Add(Pass pass, Program program, GeometryNode* node, unsigned int part, unsigned int material, size_t first, GLsizei instances, float depth)
+{
+	unsigned int mesh = m_mesh_indices.emplace(node->m_arena_range.first_index, (unsigned int)m_mesh_indices.size()).first->second;
+
+	Item item;
+	item.key = MakeKey(pass, program, material, mesh, depth);
+	item.node = node;
+	item.part = part;
+	item.material = material;
+	item.first = first;
+	item.instances = instances;
+	m_items.push_back(item);
+	m_instance_count += instances;
+}
+
+void RenderQueue::Sort()
+{
+	// equal keys keep the order they were added in
+	if (m_sorting)
+		std::stable_sort(m_items.begin(), m_items.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+}
+
+void RenderQueue::Execute(InstanceBuffer& instance_buffer, size_t first_instance, const std::function<void(unsigned int)>& bind_material)
+{
+	// the instance attributes are part of the vao, the other passes point them elsewhere
+	unsigned int material = UNBOUND;
+	GLuint vao = UNBOUND;
+	size_t bound_first = NO_INSTANCE;
+	GLuint textures[4] = { UNBOUND, UNBOUND, UNBOUND, UNBOUND };
+
+	auto bind_texture = [&](int unit, GLuint texture)
+	{
+		if (m_sorting && textures[unit] == texture)
+		{
+			m_statistics.texture_binds_skipped++;
+			return;
+		}
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		textures[unit] = texture;
+		m_statistics.texture_binds++;
+	};
+
+	for (const Item& item : m_items)
+	{
+		const GeometryNode::Objects& part = item.node->parts[item.part];
+
+		if (!m_sorting || item.material != material)
+		{
+			bind_material(item.material);
+			material = item.material;
+			m_statistics.material_binds++;
+		}
+		else
+		{
+			m_statistics.material_binds_skipped++;
+		}
+
+		// the units of the missing textures keep what they had, the material block tells the shader
+		bind_texture(0, part.diffuse_textureID);
+		if (part.mask_textureID > 0)
+			bind_texture(1, part.mask_textureID);
+		if (part.bump_textureID > 0 || part.normal_textureID > 0)
+			bind_texture(2, part.bump_textureID > 0 ? part.bump_textureID : part.normal_textureID);
+		if (part.emissive_textureID > 0)
+			bind_texture(3, part.emissive_textureID);
+
+		if (!m_sorting || item.node->m_vao != vao)
+		{
+			glBindVertexArray(item.node->m_vao);
+			vao = item.node->m_vao;
+			bound_first = NO_INSTANCE;
+			m_statistics.vao_binds++;
+		}
+		else
+		{
+			m_statistics.vao_binds_skipped++;
+		}
+
+		if (!m_sorting || bound_first != first_instance + item.first)
+		{
+			instance_buffer.Bind(first_instance + item.first);
+			bound_first = first_instance + item.first;
+			m_statistics.instance_binds++;
+		}
+		else
+		{
+			m_statistics.instance_binds_skipped++;
+		}
+
+		item.node->DrawPart(part, item.instances);
+		m_statistics.draws++;
+	}
+
+	glBindVertexArray(0);
+}
+
+void RenderQueue::ExecuteIndirect(InstanceBuffer& instance_buffer, IndirectBuffer& indirect_buffer, GLuint vao, const std::vector<InstanceData>& instances)
+{
+	m_commands.clear();
+	m_command_instances.clear();
+	m_command_materials.clear();
+	m_runs.clear();
+
+	// the base instances are relative to the first instance until the instances are written
+	for (size_t i = 0; i < m_items.size(); i++)
+	{
+		const Item& item = m_items[i];
+		const GeometryNode::Objects& part = item.node->parts[item.part];
+		if (m_runs.empty() || !same_textures(part, m_items[i - 1].node->parts[m_items[i - 1].part]))
+			m_runs.push_back(m_commands.size());
+
+		DrawElementsIndirectCommand command;
+		command.count = part.count;
+		command.instance_count = (GLuint)item.instances;
+		command.first_index = item.node->m_arena_range.first_index + part.start_offset;
+		command.base_vertex = item.node->m_arena_range.base_vertex;
+		command.base_instance = (GLuint)m_command_instances.size();
+		m_commands.push_back(command);
+
+		m_command_instances.insert(m_command_instances.end(), instances.begin() + item.first, instances.begin() + item.first + item.instances);
+		m_command_materials.insert(m_command_materials.end(), item.instances, (GLint)item.material);
+	}
+	m_runs.push_back(m_commands.size());
+
+	// nothing is drawn when a buffer could not grow
+	size_t first_instance = instance_buffer.Write(m_command_instances);
+	if (first_instance == InstanceBuffer::WRITE_FAILED || !indirect_buffer.WriteMaterials(first_instance, m_command_materials))
+		return;
+	for (auto& command : m_commands)
+		command.base_instance += (GLuint)first_instance;
+	size_t first_command = indirect_buffer.Write(m_commands);
+	if (first_command == IndirectBuffer::WRITE_FAILED)
+		return;
+
+	glBindVertexArray(vao);
+	instance_buffer.Bind(0);
+	indirect_buffer.BindMaterials();
+	m_statistics.vao_binds++;
+	m_statistics.instance_binds++;
+
+	GLuint textures[4] = { UNBOUND, UNBOUND, UNBOUND, UNBOUND };
+	auto bind_texture = [&](int unit, GLuint texture)
+	{
+		if (textures[unit] == texture)
+		{
+			m_statistics.texture_binds_skipped++;
+			return;
+		}
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		textures[unit] = texture;
+		m_statistics.texture_binds++;
+	};
+
+	for (size_t run = 0; run + 1 < m_runs.size(); run++)
+	{
+		const Item& item = m_items[m_runs[run]];
+		const GeometryNode::Objects& part = item.node->parts[item.part];
+		bind_texture(0, part.diffuse_textureID);
+		if (part.mask_textureID > 0)
+			bind_texture(1, part.mask_textureID);
+		if (part.bump_textureID > 0 || part.normal_textureID > 0)
+			bind_texture(2, part.bump_textureID > 0 ? part.bump_textureID : part.normal_textureID);
+		if (part.emissive_textureID > 0)
+			bind_texture(3, part.emissive_textureID);
+
+		indirect_buffer.Draw(first_command + m_runs[run], m_runs[run + 1] - m_runs[run]);
+		m_statistics.multi_draws++;
+	}
+	m_statistics.draws += (unsigned int)m_commands.size();
+
+	glBindVertexArray(0);
+}
@@ -0,0 +1,123 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include "GLEW\glew.h"
+#include "GeometryNode.h"
+#include "InstanceBuffer.h"
+#include "IndirectBuffer.h"
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// The draws of a frame sorted by a 64 bit key and executed with a cache of the bound state
+// from the high bits down the key holds the pass, the program, the material with its
+// textures, the mesh and the depth, so the draws of a material follow each other, the
+// meshes of a material are drawn together and front to back. Execute only binds the
+// material block, the textures, the vao and the instance attributes that changed.
+// Without sorting the draws keep their order and every draw binds all of its state.
+// ExecuteIndirect turns the queue into draw commands over the mesh arena instead, one
+// multi-draw per run of parts with the same textures
+class RenderQueue
+{
+public:
+	enum Pass
+	{
+		PASS_SHADOW = 0,
+		PASS_GEOMETRY
+	};
+
+	enum Program
+	{
+		PROGRAM_SHADOW = 0,
+		PROGRAM_GEOMETRY
+	};
+
+	// the binds issued and skipped by the last Execute, the uploads of the material blocks of the frame
+	struct Statistics
+	{
+		unsigned int draws;
+		unsigned int material_binds;
+		unsigned int material_binds_skipped;
+		unsigned int texture_binds;
+		unsigned int texture_binds_skipped;
+		unsigned int vao_binds;
+		unsigned int vao_binds_skipped;
+		unsigned int instance_binds;
+		unsigned int instance_binds_skipped;
+		unsigned int material_uploads;
+		unsigned int material_uploads_skipped;
+		// the calls of ExecuteIndirect that drew the commands
+		unsigned int multi_draws;
+	};
+
+	static const int MATERIAL_BITS = 20;
+	static const int MESH_BITS = 20;
+	static const int DEPTH_BITS = 16;
+	// depth in [0, 1], the nearest first
+	static uint64_t MakeKey(unsigned int pass, unsigned int program, unsigned int material, unsigned int mesh, float depth);
+
+	RenderQueue();
+
+	void Clear();
+	// the index of the material of a part, equal materials and textures share one while sorting
+	unsigned int AddMaterial(const GeometryNode::Objects& part);
+	// instances of a part of a node, first is relative to the first instance given to Execute
+	void Add(Pass pass, Program program, GeometryNode* node, unsigned int part, unsigned int material, size_t first, GLsizei instances, float depth);
+	void Sort();
+	// draws the queue with the program of its pass bound, bind_material binds the block of a material
+	void Execute(InstanceBuffer& instance_buffer, size_t first_instance, const std::function<void(unsigned int)>& bind_material);
+	// the nodes need their mesh in the arena with the vao given, every command gets a copy of the
+	// instances of its part from instances, so the material of the instance is the one of the part
+	void ExecuteIndirect(InstanceBuffer& instance_buffer, IndirectBuffer& indirect_buffer, GLuint vao, const std::vector<InstanceData>& instances);
+
+	// one part per material, in the order of their indices
+	const std::vector<const GeometryNode::Objects*>& GetMaterials() const { return m_materials; }
+	// the instances of all the draws, the ones ExecuteIndirect writes
+	size_t GetInstanceCount() const { return m_instance_count; }
+	size_t GetDrawCount() const { return m_items.size(); }
+	void SetSorting(bool enable) { m_sorting = enable; }
+	bool GetSorting() const { return m_sorting; }
+	const Statistics& GetStatistics() const { return m_statistics; }
+
+private:
+	struct Item
+	{
+		uint64_t key;
+		GeometryNode* node;
+		unsigned int part;
+		unsigned int material;
+		size_t first;
+		GLsizei instances;
+	};
+
+	// the material fields and texture handles of a part, compared as bytes
+	struct MaterialKey
+	{
+		float values[11];
+		GLuint textures[5];
+
+		bool operator==(const MaterialKey& other) const;
+	};
+	struct MaterialHash
+	{
+		size_t operator()(const MaterialKey& key) const;
+	};
+
+	bool m_sorting;
+	std::vector<Item> m_items;
+	std::vector<const GeometryNode::Objects*> m_materials;
+	std::unordered_map<MaterialKey, unsigned int, MaterialHash> m_material_indices;
+	// the meshes by the first index of their range in the arena
+	std::unordered_map<GLuint, unsigned int> m_mesh_indices;
+	size_t m_instance_count;
+	Statistics m_statistics;
+
+	// the commands of ExecuteIndirect, the runs start at the commands whose textures change
+	std::vector<DrawElementsIndirectCommand> m_commands;
+	std::vector<InstanceData> m_command_instances;
+	std::vector<GLint> m_command_materials;
+	std::vector<size_t> m_runs;
+};
+
+#endif
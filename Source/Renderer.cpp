@@ -4,11 +4,15 @@
 #include "ShaderProgram.h"
 #include "glm/gtc/type_ptr.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "AssetLoader.h"
 #include "OBJLoader.h"
 #include <cmath>
 #include <algorithm>
 #include <array>
+#include <unordered_map>
+#include <unordered_set>
 #include <iostream>
+#include <chrono>
 
 // RENDERER
 Renderer::Renderer()
@@ -30,6 +34,10 @@ Renderer::~Renderer()
 	glDeleteTextures(1, &m_fbo_mask_texture);
 
 	glDeleteFramebuffers(1, &m_fbo);
+	glDeleteQueries(1, &m_lighting_query);
+	glDeleteQueries(1, &m_shadow_query);
+	if (!m_coverage_queries.empty())
+		glDeleteQueries((GLsizei)m_coverage_queries.size(), m_coverage_queries.data());
 
 	glDeleteVertexArrays(1, &m_vao_fbo);
 	glDeleteBuffers(1, &m_vbo_fbo_vertices);
@@ -168,6 +176,10 @@ void Renderer::BuildWorld()
 	arrowOPP.app_model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(-6.f, 0.f, -12.f)) * glm::rotate(glm::mat4(1.f), glm::radians(180.f), glm::vec3(0, 1.f, 0.f));
 	door1.app_model_matrix = glm::translate(glm::mat4(1.f), glm::vec3(9.5f, 0.f, -7.39f)) * glm::rotate(glm::mat4(1.f), glm::radians(-90.f), glm::vec3(0, 1.f, 0.f));
 
+	// the nodes Update moves
+	for (GeometryNode* node : { &hero, &totem, &dragon1, &dragon2, &spikes1, &spikes2, &spikes3, &arrow, &arrowOPP, &door1 })
+		node->m_dynamic = true;
+
 
 	// Initialize m_border_map with 1000 values (1000) means the hero is not free to move
 	int sum = 0;
@@ -275,26 +287,26 @@ bool Renderer::InitLights()
 	this->m_spotlight.SetPosition(m_camera_position);
 	this->m_spotlight.SetTarget(hero_pos);
 	this->m_spotlight.SetConeSize(30, 30);
-	this->m_light.CastShadow(false);
+	this->m_spotlight.CastShadow(true);
 
 
 	this->m_room_light.SetColor(glm::vec3(20.f));
 	this->m_room_light.SetPosition(glm::vec3(12.f, 5.f, -6.8f));
 	this->m_room_light.SetTarget(glm::vec3(12.f, 0.f, -6.9f));
 	this->m_room_light.SetConeSize(100, 100);
-	this->m_room_light.CastShadow(false);
+	this->m_room_light.CastShadow(true);
 
 	this->m_dragon_light1.SetColor(glm::vec3(50.f));
 	this->m_dragon_light1.SetPosition(glm::vec3(4.f, 5.f, -16.f));
 	this->m_dragon_light1.SetTarget(glm::vec3(4.f, 0.f, -15.9f));
 	this->m_dragon_light1.SetConeSize(20, 20);
-	this->m_dragon_light1.CastShadow(false);
+	this->m_dragon_light1.CastShadow(true);
 
 	this->m_dragon_light2.SetColor(glm::vec3(50.f));
 	this->m_dragon_light2.SetPosition(glm::vec3(0.f, 5.f, -26.f));
 	this->m_dragon_light2.SetTarget(glm::vec3(0.f, 0.f, -25.9f));
 	this->m_dragon_light2.SetConeSize(20, 20);
-	this->m_dragon_light2.CastShadow(false);
+	this->m_dragon_light2.CastShadow(true);
 
 
 	this->m_light.SetColor(glm::vec3(250.f));
@@ -302,6 +314,8 @@ bool Renderer::InitLights()
 	this->m_light.SetTarget(glm::vec3(2.f, 0.f, -13.f));
 	this->m_light.SetConeSize(1000, 1000);
 	this->m_light.CastShadow(true);
+
+	this->m_lights = { &m_spotlight, &m_room_light, &m_dragon_light1, &m_dragon_light2, &m_light };
 	return true;
 }
 
@@ -337,7 +351,30 @@ bool Renderer::InitShaders()
 	m_spot_light_shadow_map_program.LoadFragmentShaderFromFile(fragment_shader_path.c_str());
 	m_spot_light_shadow_map_program.CreateProgram();
 
-	return true;
+	// the texture units never change, the programs keep them across reloads
+	m_geometry_program.SetSampler(UNIFORM_TEX_DIFFUSE, 0);
+	m_geometry_program.SetSampler(UNIFORM_TEX_MASK, 1);
+	m_geometry_program.SetSampler(UNIFORM_TEX_NORMAL, 2);
+	m_geometry_program.SetSampler(UNIFORM_TEX_EMISSIVE, 3);
+
+	m_deferred_program.SetSampler(UNIFORM_TEX_POS, 0);
+	m_deferred_program.SetSampler(UNIFORM_TEX_NORMAL, 1);
+	m_deferred_program.SetSampler(UNIFORM_TEX_ALBEDO, 2);
+	m_deferred_program.SetSampler(UNIFORM_TEX_MASK, 3);
+	m_deferred_program.SetSampler(UNIFORM_TEX_DEPTH, 4);
+	m_deferred_program.SetSampler(UNIFORM_CLUSTER_GRID, 5);
+	m_deferred_program.SetSampler(UNIFORM_CLUSTER_LIGHTS, 6);
+	m_deferred_program.SetSampler(UNIFORM_SHADOW_ATLAS, 8);
+
+	m_post_program.SetSampler(UNIFORM_TEXTURE, 0);
+	m_post_program.SetSampler(UNIFORM_SHADOW_MAP, 1);
+	m_post_program.SetSampler(UNIFORM_TEX_POS, 2);
+	m_post_program.SetSampler(UNIFORM_TEX_NORMAL, 3);
+	m_post_program.SetSampler(UNIFORM_TEX_ALBEDO, 4);
+	m_post_program.SetSampler(UNIFORM_TEX_MASK, 5);
+	m_post_program.SetSampler(UNIFORM_TEX_DEPTH, 6);
+
+	return m_uniform_buffer.Init();
 }
 
 bool Renderer::InitIntermediateBuffers()
@@ -350,6 +387,20 @@ bool Renderer::InitIntermediateBuffers()
 	glGenTextures(1, &m_fbo_texture);
 
 	glGenFramebuffers(1, &m_fbo);
+	glGenQueries(1, &m_lighting_query);
+	glGenQueries(1, &m_shadow_query);
+
+	if (!m_light_clusters.InitTextures())
+		return false;
+
+	if (!m_shadow_atlas.Init(m_shadow_budget))
+		return false;
+
+	if (!m_instance_buffer.Init())
+		return false;
+
+	// without the multi-draws the draws stay per part
+	m_indirect_supported = IndirectBuffer::Supported() && m_indirect_buffer.Init();
 
 	return ResizeBuffers(m_screen_width, m_screen_height);
 }
@@ -359,52 +410,38 @@ bool Renderer::ResizeBuffers(int width, int height)
 	m_screen_width = width;
 	m_screen_height = height;
 
-	// texture
-	glBindTexture(GL_TEXTURE_2D, m_fbo_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_screen_width, m_screen_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-	glBindTexture(GL_TEXTURE_2D, m_fbo_pos_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_screen_width, m_screen_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-	glBindTexture(GL_TEXTURE_2D, m_fbo_normal_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_screen_width, m_screen_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-	glBindTexture(GL_TEXTURE_2D, m_fbo_albedo_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_screen_width, m_screen_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-	glBindTexture(GL_TEXTURE_2D, m_fbo_mask_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_screen_width, m_screen_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	auto allocate = [](GLuint texture, GLenum filter, GLint internal_format, GLsizei width, GLsizei height, GLenum format, GLenum type)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+	};
 
-	glBindTexture(GL_TEXTURE_2D, m_fbo_depth_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, m_screen_width, m_screen_height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	if (m_gbuffer_layout == GBUFFER_FULL)
+	{
+		allocate(m_fbo_texture, GL_LINEAR, GL_RGBA32F, m_screen_width, m_screen_height, GL_RGBA, GL_UNSIGNED_BYTE);
+		allocate(m_fbo_pos_texture, GL_LINEAR, GL_RGBA32F, m_screen_width, m_screen_height, GL_RGBA, GL_UNSIGNED_BYTE);
+		allocate(m_fbo_normal_texture, GL_LINEAR, GL_RGBA32F, m_screen_width, m_screen_height, GL_RGBA, GL_UNSIGNED_BYTE);
+		allocate(m_fbo_albedo_texture, GL_LINEAR, GL_RGBA32F, m_screen_width, m_screen_height, GL_RGBA, GL_UNSIGNED_BYTE);
+		allocate(m_fbo_mask_texture, GL_LINEAR, GL_RGBA32F, m_screen_width, m_screen_height, GL_RGBA, GL_UNSIGNED_BYTE);
+	}
+	else
+	{
+		// the position comes from the depth, its texture only keeps a texel
+		allocate(m_fbo_texture, GL_LINEAR, GL_R11F_G11F_B10F, m_screen_width, m_screen_height, GL_RGB, GL_FLOAT);
+		allocate(m_fbo_pos_texture, GL_NEAREST, GL_RGBA32F, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+		allocate(m_fbo_normal_texture, GL_NEAREST, GL_RG16, m_screen_width, m_screen_height, GL_RG, GL_UNSIGNED_SHORT);
+		allocate(m_fbo_albedo_texture, GL_NEAREST, GL_RGBA8, m_screen_width, m_screen_height, GL_RGBA, GL_UNSIGNED_BYTE);
+		allocate(m_fbo_mask_texture, GL_NEAREST, GL_RGBA8, m_screen_width, m_screen_height, GL_RGBA, GL_UNSIGNED_BYTE);
+	}
+	allocate(m_fbo_depth_texture, GL_NEAREST, GL_DEPTH_COMPONENT24, m_screen_width, m_screen_height, GL_DEPTH_COMPONENT, GL_FLOAT);
 
 	// framebuffer to link to everything together
 	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_fbo_pos_texture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_gbuffer_layout == GBUFFER_FULL ? m_fbo_pos_texture : m_fbo_texture, 0);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_fbo_normal_texture, 0);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_fbo_albedo_texture, 0);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, m_fbo_mask_texture, 0);
@@ -491,27 +528,33 @@ bool Renderer::InitGeometricMeshes()
 		"Assets/Dungeon/Door1.obj"
 	};
 
-	bool initialized = true;
-	OBJLoader loader;
-
+	// the arena holds every mesh once and the static batch about one more copy per node, sized
+	// from the .meshbin headers so that the loading does not grow it. On the first run there are
+	// none yet and it starts at its default size
+	size_t arena_vertices = 0, arena_indices = 0;
+	std::unordered_set<std::string> counted;
 	for (auto& asset : assets)
 	{
-		GeometricMesh* mesh = loader.load(asset);
+		size_t vertices, indices;
+		if (!OBJLoader::binaryCounts(asset, vertices, indices))
+			continue;
+		const size_t copies = counted.insert(asset).second ? 2 : 1;
+		arena_vertices += copies * vertices;
+		arena_indices += copies * indices;
+	}
+	AssetManager::GetInstance().InitArena(std::max(arena_vertices, (size_t)AssetManager::DEFAULT_ARENA_VERTICES),
+		std::max(arena_indices, (size_t)AssetManager::DEFAULT_ARENA_INDICES));
 
-		if (mesh != nullptr)
-		{
-			GeometryNode* node = new GeometryNode();
-			node->Init(asset, mesh);
-			this->m_nodes.push_back(node);
-		}
-		else
-		{
-			initialized = false;
-			break;
-		}
+	// the nodes exist at once so the world can be built, their meshes and textures
+	// are loaded by jobs and uploaded a few at a time by Render
+	for (auto& asset : assets)
+	{
+		GeometryNode* node = new GeometryNode();
+		AssetLoader::GetInstance().RequestMesh(asset, node);
+		this->m_nodes.push_back(node);
 	}
 
-	return initialized;
+	return true;
 }
 
 void Renderer::Update(float dt)
@@ -789,6 +832,22 @@ void::Renderer::UpdateHero(float dt) {
 	this->m_nodes[0]->app_model_matrix = glm::translate(glm::mat4(1.f), m_hero_position) * glm::rotate(glm::mat4(1.f), m_hero_rotation, glm::vec3(0.f, 1.f, 0.f));
 	//this->m_nodes[0]->app_model_matrix = glm::translate(glm::mat4(1.f), m_hero_position) * glm::rotate(glm::mat4(1.f), m_hero_rotation, glm::vec3(0.f, 1.f, 0.f));
 }
+bool Renderer::SetGBufferLayout(GBufferLayout layout)
+{
+	if (layout == m_gbuffer_layout)
+		return true;
+
+	m_gbuffer_layout = layout;
+	return ResizeBuffers(m_screen_width, m_screen_height);
+}
+
+size_t Renderer::GetGBufferBytes() const
+{
+	// the 24 bit depth takes 32 bits
+	size_t bytes_per_pixel = (m_gbuffer_layout == GBUFFER_FULL) ? 4 * 16 + 16 + 4 : 4 + 4 + 4 + 4 + 4;
+	return bytes_per_pixel * m_screen_width * m_screen_height;
+}
+
 bool Renderer::ReloadShaders()
 {
 	m_geometry_program.ReloadProgram();
@@ -798,13 +857,81 @@ bool Renderer::ReloadShaders()
 	return true;
 }
 
+LightNode& Renderer::AddLight()
+{
+	m_added_lights.emplace_back(new LightNode());
+	m_lights.push_back(m_added_lights.back().get());
+	return *m_added_lights.back();
+}
+
+void Renderer::RemoveAddedLights()
+{
+	m_lights.resize(m_lights.size() - m_added_lights.size());
+	m_added_lights.clear();
+}
+
+double Renderer::GetLightingTime()
+{
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(m_lighting_query, GL_QUERY_RESULT, &nanoseconds);
+	return nanoseconds / 1e6;
+}
+
+bool Renderer::SetShadowBudget(size_t bytes)
+{
+	m_shadow_budget = bytes;
+	InvalidateStaticShadows();
+	m_previous_shadow_lights.clear();
+	return m_shadow_atlas.Init(bytes);
+}
+
+double Renderer::GetShadowTime()
+{
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(m_shadow_query, GL_QUERY_RESULT, &nanoseconds);
+	return nanoseconds / 1e6;
+}
+
+const std::vector<Renderer::LightCoverage>& Renderer::GetLightCoverage()
+{
+	for (size_t i = 0; i < m_light_coverage.size(); i++)
+	{
+		if (m_coverage_queried[i])
+		{
+			glGetQueryObjectuiv(m_coverage_queries[i], GL_QUERY_RESULT, &m_light_coverage[i].shaded);
+			m_coverage_queried[i] = false;
+		}
+	}
+	return m_light_coverage;
+}
+
 void Renderer::Render()
 {
+	// upload the assets that finished loading, without stalling the frame for long
+	AssetLoader::GetInstance().Update(m_upload_budget_ms);
+
+	UpdateStaticBatch();
+	CullNodes();
+	WriteUniformBlocks();
+	// the camera and at most every resident node once per shadow map, the multi-draws copy the instances of every part
+	size_t instances = m_resident_nodes.size() * (1 + m_shadow_lights.size()) + (m_indirect_frame ? m_render_queue.GetInstanceCount() : 0);
+	m_instance_buffer.Begin(instances);
+	if (m_indirect_frame)
+	{
+		size_t parts = 0;
+		for (GeometryNode* node : m_resident_nodes)
+			parts += node->parts.size();
+		m_indirect_buffer.Begin(parts * (1 + m_shadow_lights.size()), instances);
+	}
+
 	RenderShadowMaps();
 	RenderGeometry();
 	RenderDeferredShading();
 	RenderPostProcess();
 
+	// the region of this frame is reused once the GPU is done with it
+	m_uniform_buffer.Fence();
+
 	GLenum error = Tools::CheckGLError();
 
 	if (error != GL_NO_ERROR)
@@ -814,362 +941,547 @@ void Renderer::Render()
 	}
 }
 
-void Renderer::RenderPostProcess()
+void Renderer::SetStaticBatching(bool enable)
 {
+	if (enable == m_static_batching)
+		return;
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glClearColor(0.f, 0.f, 0.f, 0.f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glDisable(GL_DEPTH_TEST);
-
-	m_post_program.Bind();
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_texture);
-	m_post_program.loadInt("uniform_texture", 0);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, m_light.GetShadowMapDepthTexture());
-	m_post_program.loadInt("uniform_shadow_map", 1);
-
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_pos_texture);
-	m_post_program.loadInt("uniform_tex_pos", 2);
-
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_normal_texture);
-	m_post_program.loadInt("uniform_tex_normal", 3);
-
-	glActiveTexture(GL_TEXTURE4);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_albedo_texture);
-	m_post_program.loadInt("uniform_tex_albedo", 4);
-
-	glActiveTexture(GL_TEXTURE5);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_mask_texture);
-	m_post_program.loadInt("uniform_tex_mask", 5);
-
-	glActiveTexture(GL_TEXTURE6);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_depth_texture);
-	m_post_program.loadInt("uniform_tex_depth", 6);
+	m_static_batching = enable;
+	m_static_batch.Clear();
+	m_static_batch_sources = 0;
+	InvalidateStaticShadows();
+}
 
-	glBindVertexArray(m_vao_fbo);
+void Renderer::UpdateStaticBatch()
+{
+	// a batch per streamed node would be rebuilt over and over, wait for the level to finish
+	if (!m_static_batching || AssetLoader::GetInstance().IsLoading())
+		return;
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	size_t resident_static_nodes = 0;
+	for (auto& node : this->m_nodes)
+		resident_static_nodes += (node && node->IsResident() && !node->m_dynamic) ? 1 : 0;
+	if (resident_static_nodes == m_static_batch_sources)
+		return;
 
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	m_post_program.Unbind();
+	auto start = std::chrono::steady_clock::now();
+	std::vector<GeometryNode*> nodes;
+	for (auto& node : this->m_nodes)
+	{
+		if (node && node->IsResident() && !node->m_dynamic)
+			nodes.push_back(node);
+	}
+	m_static_batch.Merge(nodes);
+	m_static_batch.Upload();
+	m_static_batch_sources = resident_static_nodes;
+	m_static_batch_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	InvalidateStaticShadows();
 }
-void Renderer::RenderStaticGeometry()
-{
-	glm::mat4 proj = m_projection_matrix * m_view_matrix * m_world_matrix;
 
+void Renderer::CullNodes()
+{
+	m_culler.Clear();
+	m_resident_nodes.clear();
+	size_t resident_static_nodes = 0;
+	if (m_static_batch.IsUploaded())
+	{
+		GeometryNode* batch = m_static_batch.GetNode();
+		m_culler.AddBox(batch->m_aabb.min, batch->m_aabb.max, m_world_matrix * batch->app_model_matrix);
+		m_resident_nodes.push_back(batch);
+	}
 	for (auto& node : this->m_nodes)
 	{
-		if (node) {
-
-			glBindVertexArray(node->m_vao);
+		if (node && node->IsResident())
+		{
+			resident_static_nodes += node->m_dynamic ? 0 : 1;
+			if (node->m_batched)
+				continue;
+			m_culler.AddBox(node->m_aabb.min, node->m_aabb.max, m_world_matrix * node->app_model_matrix);
+			m_resident_nodes.push_back(node);
+		}
+	}
 
-			m_geometry_program.loadMat4("uniform_projection_matrix", proj * node->app_model_matrix);
-			m_geometry_program.loadMat4("uniform_normal_matrix", glm::transpose(glm::inverse(m_world_matrix * node->app_model_matrix)));
-			m_geometry_program.loadMat4("uniform_world_matrix", m_world_matrix * node->app_model_matrix);
+	// a static node has been streamed in since the caches were rendered
+	if (resident_static_nodes != m_resident_static_nodes)
+	{
+		m_resident_static_nodes = resident_static_nodes;
+		InvalidateStaticShadows();
+	}
 
-			for (int j = 0; j < node->parts.size(); ++j)
-			{
-				m_geometry_program.loadVec3("uniform_diffuse", node->parts[j].diffuse);
-				m_geometry_program.loadVec3("uniform_ambient", node->parts[j].ambient);
-				m_geometry_program.loadVec3("uniform_specular", node->parts[j].specular);
-				m_geometry_program.loadFloat("uniform_shininess", node->parts[j].shininess);
-				m_geometry_program.loadFloat("uniform_metallic", node->parts[j].metallic);
-				m_geometry_program.loadInt("uniform_has_tex_diffuse", (node->parts[j].diffuse_textureID > 0) ? 1 : 0);
-				m_geometry_program.loadInt("uniform_has_tex_emissive", (node->parts[j].emissive_textureID > 0) ? 1 : 0);
-				m_geometry_program.loadInt("uniform_has_tex_mask", (node->parts[j].mask_textureID > 0) ? 1 : 0);
-				m_geometry_program.loadInt("uniform_has_tex_normal", (node->parts[j].bump_textureID > 0 || node->parts[j].normal_textureID > 0) ? 1 : 0);
-				m_geometry_program.loadInt("uniform_is_tex_bumb", (node->parts[j].bump_textureID > 0) ? 1 : 0);
-
-				glActiveTexture(GL_TEXTURE0);
-				m_geometry_program.loadInt("uniform_tex_diffuse", 0);
-				glBindTexture(GL_TEXTURE_2D, node->parts[j].diffuse_textureID);
-
-				if (node->parts[j].mask_textureID > 0)
-				{
-					glActiveTexture(GL_TEXTURE1);
-					m_geometry_program.loadInt("uniform_tex_mask", 1);
-					glBindTexture(GL_TEXTURE_2D, node->parts[j].mask_textureID);
-				}
+	if (m_frustum_culling)
+		m_culler.Cull(m_projection_matrix * m_view_matrix, m_node_visible);
+	else
+		m_node_visible.assign(m_resident_nodes.size(), 1);
 
-				if ((node->parts[j].bump_textureID > 0 || node->parts[j].normal_textureID > 0))
-				{
-					glActiveTexture(GL_TEXTURE2);
-					m_geometry_program.loadInt("uniform_tex_normal", 2);
-					glBindTexture(GL_TEXTURE_2D, node->parts[j].bump_textureID > 0 ?
-						node->parts[j].bump_textureID : node->parts[j].normal_textureID);
-				}
+	CullStatistics& statistics = m_cull_statistics[CULL_PASS_CAMERA];
+	statistics = {};
+	m_visible_nodes.clear();
+	for (size_t i = 0; i < m_resident_nodes.size(); i++)
+	{
+		if (m_node_visible[i])
+			m_visible_nodes.push_back(m_resident_nodes[i]);
+	}
 
-				if (node->parts[j].emissive_textureID > 0)
-				{
-					glActiveTexture(GL_TEXTURE3);
-					m_geometry_program.loadInt("uniform_tex_emissive", 3);
-					glBindTexture(GL_TEXTURE_2D, node->parts[j].emissive_textureID);
-				}
+	GroupInstances(m_visible_nodes, true, m_camera_groups, m_camera_instances);
 
-				glDrawArrays(GL_TRIANGLES, node->parts[j].start_offset, node->parts[j].count);
-			}
+	// the depth of a group is the one of the center of its first node
+	const glm::mat4 projection_view = m_projection_matrix * m_view_matrix;
+	m_render_queue.Clear();
+	for (auto& group : m_camera_groups)
+	{
+		GeometryNode* node = group.node;
+		glm::vec4 center = projection_view * m_world_matrix * node->app_model_matrix * glm::vec4(node->m_aabb.center, 1.f);
+		float depth = (center.w > 0.f) ? 0.5f * center.z / center.w + 0.5f : 0.f;
 
-			glBindVertexArray(0);
+		for (unsigned int part = 0; part < node->parts.size(); part++)
+		{
+			unsigned int material = m_render_queue.AddMaterial(node->parts[part]);
+			m_render_queue.Add(RenderQueue::PASS_GEOMETRY, RenderQueue::PROGRAM_GEOMETRY, node, part, material, group.first, (GLsizei)group.count, depth);
 		}
+		statistics.draws += (unsigned int)node->parts.size();
 	}
-}
+	m_render_queue.Sort();
 
+	m_indirect_frame = m_indirect_drawing && m_indirect_supported && m_render_queue.GetMaterials().size() <= MAX_DRAW_MATERIALS;
 
-void Renderer::RenderDeferredShading()
-{
-	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_fbo_texture, 0);
+	statistics.visible = (unsigned int)m_visible_nodes.size();
+	statistics.culled = (unsigned int)(m_resident_nodes.size() - m_visible_nodes.size());
+}
 
-	GLenum drawbuffers[1] = { GL_COLOR_ATTACHMENT0 };
+void Renderer::GroupInstances(const std::vector<GeometryNode*>& nodes, bool normals, std::vector<InstanceGroup>& groups, std::vector<InstanceData>& instances)
+{
+	// the nodes of a mesh share its range of the arena, a stable sort keeps the order of the first of them
+	std::unordered_map<GLuint, size_t> first_of_mesh;
+	std::vector<size_t> order(nodes.size());
+	std::vector<size_t> mesh(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		order[i] = i;
+		mesh[i] = m_instancing ? first_of_mesh.emplace(nodes[i]->m_arena_range.first_index, i).first->second : i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&mesh](size_t a, size_t b) { return mesh[a] < mesh[b]; });
 
-	glDrawBuffers(1, drawbuffers);
+	groups.clear();
+	instances.resize(nodes.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		GeometryNode* node = nodes[order[i]];
+		if (groups.empty() || mesh[order[i]] != mesh[order[i - 1]])
+			groups.push_back({ node, i, 0 });
+		groups.back().count++;
+
+		InstanceData& instance = instances[i];
+		instance.world = m_world_matrix * node->app_model_matrix;
+		instance.normal = normals ? glm::transpose(glm::inverse(instance.world)) : glm::mat4(1.f);
+	}
+}
 
-	glViewport(0, 0, m_screen_width, m_screen_height);
+void Renderer::CullShadowCasters(LightNode& light, CasterSet set, std::vector<GeometryNode*>& casters, CullStatistics& statistics)
+{
+	auto in_set = [set](GeometryNode* node) { return set == CASTERS_ALL || node->m_dynamic == (set == CASTERS_DYNAMIC); };
 
-	glDisable(GL_DEPTH_TEST);
-	glDepthMask(GL_FALSE);
+	casters.clear();
+	if (!m_frustum_culling)
+	{
+		for (GeometryNode* node : m_resident_nodes)
+		{
+			if (in_set(node))
+				casters.push_back(node);
+		}
+		statistics.visible += (unsigned int)casters.size();
+		return;
+	}
 
-	glClear(GL_COLOR_BUFFER_BIT);
+	const glm::mat4 light_projection_view = light.GetProjectionMatrix() * light.GetViewMatrix();
+	m_culler.Cull(light_projection_view, m_caster_visible);
 
-	m_deferred_program.Bind();
+	// in the clip space of the light its rays are parallel to z, so a caster shadows the
+	// receivers behind its own rectangle. the receivers are the nodes both frustums contain,
+	// their rectangles and depths are merged, any box behind the light covers everything.
+	// the cache outlives the camera, its static casters only need the frustum of the light
+	const bool receivers = (set != CASTERS_STATIC);
+	glm::vec3 receivers_min(1e30f), receivers_max(-1e30f);
+	for (size_t i = 0; receivers && i < m_resident_nodes.size(); i++)
+	{
+		if (!m_node_visible[i] || !m_caster_visible[i])
+			continue;
 
+		GeometryNode* node = m_resident_nodes[i];
+		glm::vec3 ndc_min, ndc_max;
+		if (!FrustumCuller::ProjectBox(node->m_aabb.min, node->m_aabb.max, light_projection_view * m_world_matrix * node->app_model_matrix, ndc_min, ndc_max))
+		{
+			ndc_min = glm::vec3(-1.f);
+			ndc_max = glm::vec3(1.f);
+		}
+		receivers_min = glm::min(receivers_min, ndc_min);
+		receivers_max = glm::max(receivers_max, ndc_max);
+	}
 
-	m_deferred_program.loadVec3("uniform_light_color", m_spotlight.GetColor());
-	m_deferred_program.loadVec3("uniform_light_dir", m_spotlight.GetDirection());
-	m_deferred_program.loadVec3("uniform_light_pos", m_spotlight.GetPosition());
+	for (size_t i = 0; i < m_resident_nodes.size(); i++)
+	{
+		GeometryNode* node = m_resident_nodes[i];
+		if (!in_set(node))
+			continue;
 
-	m_deferred_program.loadFloat("uniform_light_umbra", m_spotlight.GetUmbra());
-	m_deferred_program.loadFloat("uniform_light_penumbra", m_spotlight.GetPenumbra());
+		if (!m_caster_visible[i])
+		{
+			statistics.culled++;
+			continue;
+		}
 
-	m_deferred_program.loadVec3("uniform_camera_pos", m_camera_position);
-	m_deferred_program.loadVec3("uniform_camera_dir", normalize(m_camera_target_position - m_camera_position));
+		glm::vec3 ndc_min, ndc_max;
+		if (receivers && FrustumCuller::ProjectBox(node->m_aabb.min, node->m_aabb.max, light_projection_view * m_world_matrix * node->app_model_matrix, ndc_min, ndc_max) &&
+			(ndc_max.x < receivers_min.x || ndc_min.x > receivers_max.x || ndc_max.y < receivers_min.y || ndc_min.y > receivers_max.y || ndc_min.z > receivers_max.z))
+		{
+			statistics.culled++;
+			statistics.no_receiver++;
+			continue;
+		}
 
-	m_deferred_program.loadMat4("uniform_light_projection_view", m_spotlight.GetProjectionMatrix() * m_spotlight.GetViewMatrix());
-	m_deferred_program.loadInt("uniform_cast_shadows", m_spotlight.GetCastShadowsStatus() ? 1 : 0);
+		casters.push_back(node);
+		statistics.visible++;
+	}
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_pos_texture);
-	m_deferred_program.loadInt("uniform_tex_pos", 0);
+void Renderer::AllocateShadowTiles(int count)
+{
+	// the screen the light can reach is the importance of its shadow map
+	m_shadow_lights.clear();
+	m_shadow_importance.clear();
+	for (int i = 0; i < count && m_shadow_lights.size() < MAX_SHADOW_LIGHTS; i++)
+	{
+		LightNode& light = *m_lights[i];
+		if (!light.GetCastShadowsStatus())
+			continue;
+
+		glm::ivec4 scissor;
+		glm::vec2 depth;
+		float importance = 0.f;
+		if (light.GetScreenBounds(m_view_matrix, m_projection_matrix, LightClusters::Range(light.GetColor()), m_screen_width, m_screen_height, scissor, depth))
+			importance = scissor.z * (float)scissor.w / (m_screen_width * (float)m_screen_height);
+		m_shadow_lights.push_back(&light);
+		m_shadow_importance.push_back(importance);
+	}
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_normal_texture);
-	m_deferred_program.loadInt("uniform_tex_normal", 1);
+	ShadowAtlas::Allocate(m_shadow_atlas.GetSize(), m_shadow_importance, m_shadow_tiles);
 
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_albedo_texture);
-	m_deferred_program.loadInt("uniform_tex_albedo", 2);
+	// the lights without a tile are not shadowed this frame
+	size_t kept = 0;
+	for (size_t i = 0; i < m_shadow_lights.size(); i++)
+	{
+		if (m_shadow_tiles[i].size == 0)
+			continue;
+		m_shadow_lights[kept] = m_shadow_lights[i];
+		m_shadow_tiles[kept] = m_shadow_tiles[i];
+		kept++;
+	}
+	m_shadow_lights.resize(kept);
+	m_shadow_tiles.resize(kept);
 
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_mask_texture);
-	m_deferred_program.loadInt("uniform_tex_mask", 3);
+	// the cache of a tile that moved or changed its size is rendered again
+	for (size_t i = 0; i < m_shadow_lights.size(); i++)
+	{
+		auto previous = std::find(m_previous_shadow_lights.begin(), m_previous_shadow_lights.end(), m_shadow_lights[i]);
+		if (previous == m_previous_shadow_lights.end() || !(m_previous_shadow_tiles[previous - m_previous_shadow_lights.begin()] == m_shadow_tiles[i]))
+			m_shadow_lights[i]->SetStaticShadowMapVersion(0);
+	}
+	m_previous_shadow_lights = m_shadow_lights;
+	m_previous_shadow_tiles = m_shadow_tiles;
+}
 
-	glActiveTexture(GL_TEXTURE4);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_depth_texture);
-	m_deferred_program.loadInt("uniform_tex_depth", 4);
+void Renderer::WriteUniformBlocks()
+{
+	const std::vector<const GeometryNode::Objects*>& materials = m_render_queue.GetMaterials();
+
+	m_material_block_offsets.clear();
+	m_materials_written = false;
+	if (!m_uniform_buffer.Begin(m_uniform_buffer.Aligned(sizeof(FrameBlock)) + m_uniform_buffer.Aligned(sizeof(LightsBlock)) +
+		m_uniform_buffer.Aligned(sizeof(ShadowsBlock)) +
+		(m_indirect_frame ? m_uniform_buffer.Aligned(sizeof(DrawMaterialsBlock)) : materials.size() * m_uniform_buffer.Aligned(sizeof(MaterialBlock)))))
+		return;
+
+	const int count = (int)std::min(m_lights.size(), (size_t)MAX_LIGHTS);
+
+	m_cluster_lights.clear();
+	m_light_bounds.resize(count);
+	GLintptr offset;
+	ShadowsBlock* shadows = static_cast<ShadowsBlock*>(m_uniform_buffer.Allocate(sizeof(ShadowsBlock), offset));
+	m_shadows_block_offset = offset;
+	LightBlock* lights = static_cast<LightBlock*>(m_uniform_buffer.Allocate(sizeof(LightsBlock), offset));
+	m_lights_block_offset = offset;
+	if (!shadows || !lights)
+	{
+		m_uniform_buffer.End();
+		return;
+	}
 
-	glActiveTexture(GL_TEXTURE10);
-	glBindTexture(GL_TEXTURE_2D, m_spotlight.GetShadowMapDepthTexture());
-	m_deferred_program.loadInt("uniform_shadow_map", 10);
+	AllocateShadowTiles(count);
+	const float atlas_size = (float)m_shadow_atlas.GetSize();
+	for (size_t i = 0; i < m_shadow_lights.size(); i++)
+	{
+		const ShadowAtlas::Tile& tile = m_shadow_tiles[i];
+		shadows->projection_view[i] = m_shadow_lights[i]->GetProjectionMatrix() * m_shadow_lights[i]->GetViewMatrix();
+		shadows->atlas_rect[i] = glm::vec4(tile.x, tile.y, tile.size, tile.size) / atlas_size;
+	}
 
-	glBindVertexArray(m_vao_fbo);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
+	// only the used lights are written, the shader does not read past the count
+	for (int i = 0; i < count; i++)
+	{
+		LightNode& light = *m_lights[i];
+		auto shadow_light = std::find(m_shadow_lights.begin(), m_shadow_lights.end(), &light);
+		float shadow_map = (shadow_light != m_shadow_lights.end()) ? (float)(shadow_light - m_shadow_lights.begin()) : -1.f;
+
+		lights[i].color = glm::vec4(light.GetColor(), 0.f);
+		lights[i].position = glm::vec4(light.GetPosition(), 1.f);
+		lights[i].direction = glm::vec4(light.GetDirection(), 0.f);
+		float cos_umbra = cos(glm::radians(0.5f * light.GetUmbra()));
+		float cos_penumbra = cos(glm::radians(0.5f * light.GetPenumbra()));
+		float range = LightClusters::Range(light.GetColor());
+		lights[i].cone = glm::vec4(cos_umbra, cos_penumbra, shadow_map, range);
+
+		if (m_lighting_mode == LIGHTING_CLUSTERED)
+		{
+			LightClusters::Light cluster_light;
+			cluster_light.position = light.GetPosition();
+			cluster_light.range = range;
+			cluster_light.direction = light.GetDirection();
+			// the shader lights the cone of the smaller cosine
+			cluster_light.cos_cone = std::min(cos_umbra, cos_penumbra);
+			m_cluster_lights.push_back(cluster_light);
+		}
+		else if (m_lighting_mode == LIGHTING_MULTI_PASS && m_bound_lights)
+		{
+			LightBounds& bounds = m_light_bounds[i];
+			bounds.visible = light.GetScreenBounds(m_view_matrix, m_projection_matrix, range, m_screen_width, m_screen_height, bounds.scissor, bounds.depth);
+		}
+	}
 
-	m_deferred_program.Unbind();
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE, GL_ONE);
+	FrameBlock frame;
+	frame.camera_pos = glm::vec4(m_camera_position, 1.f);
+	frame.camera_dir = glm::vec4(normalize(m_camera_target_position - m_camera_position), 0.f);
+	frame.light_count = glm::ivec4(count, (int)m_shadow_lights.size(), 0, 0);
+	frame.view = m_view_matrix;
+	frame.inverse_projection_view = glm::inverse(m_projection_matrix * m_view_matrix);
+	frame.clusters = glm::vec4(CLUSTERS_X / (float)m_screen_width, CLUSTERS_Y / (float)m_screen_height, 0.f, 0.f);
+	if (m_lighting_mode == LIGHTING_CLUSTERED)
+	{
+		// the froxels of this frame's camera, the slices are found from the log of the view depth
+		m_light_clusters.Build(m_view_matrix, m_projection_matrix, m_cluster_lights);
+		frame.clusters.z = CLUSTERS_Z / log(m_light_clusters.GetFar() / m_light_clusters.GetNear());
+		frame.clusters.w = m_light_clusters.GetNear();
+	}
+	m_frame_block_offset = m_uniform_buffer.Write(frame);
 
-	m_deferred_program.Bind();
+	// the materials of the render queue, in the order of their indices. the multi-draws read
+	// them from one block, the draws per part bind a block each. Begin only reserved the layout
+	// of this frame, without room for the block the geometry pass skips the frame
+	DrawMaterialsBlock* draw_materials = nullptr;
+	if (m_indirect_frame)
+	{
+		draw_materials = static_cast<DrawMaterialsBlock*>(m_uniform_buffer.Allocate(sizeof(DrawMaterialsBlock), offset));
+		m_draw_materials_block_offset = offset;
+	}
+	m_materials_written = !m_indirect_frame || draw_materials != nullptr;
+	for (size_t i = 0; m_materials_written && i < materials.size(); i++)
+	{
+		const GeometryNode::Objects* part = materials[i];
+		MaterialBlock material;
+		material.diffuse = glm::vec4(part->diffuse, 0.f);
+		material.ambient = glm::vec4(part->ambient, 0.f);
+		material.specular = glm::vec4(part->specular, 0.f);
+		material.params = glm::vec4(part->shininess, part->metallic, 0.f, 0.f);
+		material.textures = glm::ivec4(
+			part->diffuse_textureID > 0 ? 1 : 0,
+			part->emissive_textureID > 0 ? 1 : 0,
+			part->mask_textureID > 0 ? 1 : 0,
+			(part->bump_textureID > 0 || part->normal_textureID > 0) ? 1 : 0);
+		if (draw_materials)
+			draw_materials->materials[i] = material;
+		else
+			m_material_block_offsets.push_back(m_uniform_buffer.Write(material));
+	}
 
+	m_uniform_buffer.End();
 
-	m_deferred_program.loadVec3("uniform_light_color", m_room_light.GetColor());
-	m_deferred_program.loadVec3("uniform_light_dir", m_room_light.GetDirection());
-	m_deferred_program.loadVec3("uniform_light_pos", m_room_light.GetPosition());
+	if (m_lighting_mode == LIGHTING_CLUSTERED)
+		m_light_clusters.Upload();
+}
 
-	m_deferred_program.loadFloat("uniform_light_umbra", m_room_light.GetUmbra());
-	m_deferred_program.loadFloat("uniform_light_penumbra", m_room_light.GetPenumbra());
+void Renderer::RenderPostProcess()
+{
 
-	m_deferred_program.loadVec3("uniform_camera_pos", m_camera_position);
-	m_deferred_program.loadVec3("uniform_camera_dir", normalize(m_camera_target_position - m_camera_position));
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glClearColor(0.f, 0.f, 0.f, 0.f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_DEPTH_TEST);
 
-	m_deferred_program.loadMat4("uniform_light_projection_view", m_room_light.GetProjectionMatrix() * m_room_light.GetViewMatrix());
-	m_deferred_program.loadInt("uniform_cast_shadows", m_room_light.GetCastShadowsStatus() ? 1 : 0);
+	m_post_program.Bind();
 
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_pos_texture);
-	m_deferred_program.loadInt("uniform_tex_pos", 0);
+	glBindTexture(GL_TEXTURE_2D, m_fbo_texture);
 
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_normal_texture);
-	m_deferred_program.loadInt("uniform_tex_normal", 1);
+	glBindTexture(GL_TEXTURE_2D, m_shadow_atlas.GetTexture());
 
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_albedo_texture);
-	m_deferred_program.loadInt("uniform_tex_albedo", 2);
+	glBindTexture(GL_TEXTURE_2D, m_fbo_pos_texture);
 
 	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_mask_texture);
-	m_deferred_program.loadInt("uniform_tex_mask", 3);
+	glBindTexture(GL_TEXTURE_2D, m_fbo_normal_texture);
 
 	glActiveTexture(GL_TEXTURE4);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_depth_texture);
-	m_deferred_program.loadInt("uniform_tex_depth", 4);
-
-	glActiveTexture(GL_TEXTURE10);
-	glBindTexture(GL_TEXTURE_2D, m_room_light.GetShadowMapDepthTexture());
-	m_deferred_program.loadInt("uniform_shadow_map", 10);
-
-	glBindVertexArray(m_vao_fbo);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, m_fbo_albedo_texture);
 
-	m_deferred_program.Unbind();
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_2D, m_fbo_mask_texture);
 
-	m_deferred_program.Bind();
+	glActiveTexture(GL_TEXTURE6);
+	glBindTexture(GL_TEXTURE_2D, m_fbo_depth_texture);
 
+	glBindVertexArray(m_vao_fbo);
 
-	m_deferred_program.loadVec3("uniform_light_color", m_dragon_light1.GetColor());
-	m_deferred_program.loadVec3("uniform_light_dir", m_dragon_light1.GetDirection());
-	m_deferred_program.loadVec3("uniform_light_pos", m_dragon_light1.GetPosition());
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-	m_deferred_program.loadFloat("uniform_light_umbra", m_dragon_light1.GetUmbra());
-	m_deferred_program.loadFloat("uniform_light_penumbra", m_dragon_light1.GetPenumbra());
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	m_post_program.Unbind();
+}
+void Renderer::RenderStaticGeometry()
+{
+	if (!m_materials_written)
+		return;
 
-	m_deferred_program.loadVec3("uniform_camera_pos", m_camera_position);
-	m_deferred_program.loadVec3("uniform_camera_dir", normalize(m_camera_target_position - m_camera_position));
+	m_geometry_program.loadMat4(UNIFORM_PROJECTION_MATRIX, m_projection_matrix * m_view_matrix);
+	// the draws per part leave the block of the multi-draws alone, the shader does not read it on their frames
+	if (m_indirect_frame)
+	{
+		m_uniform_buffer.BindRange(UNIFORM_BLOCK_DRAW_MATERIALS, m_draw_materials_block_offset, sizeof(DrawMaterialsBlock));
+		m_render_queue.ExecuteIndirect(m_instance_buffer, m_indirect_buffer, AssetManager::GetInstance().GetArena().GetVAO(), m_camera_instances);
+		return;
+	}
 
-	m_deferred_program.loadMat4("uniform_light_projection_view", m_dragon_light1.GetProjectionMatrix() * m_dragon_light1.GetViewMatrix());
-	m_deferred_program.loadInt("uniform_cast_shadows", m_dragon_light1.GetCastShadowsStatus() ? 1 : 0);
+	m_camera_first_instance = m_instance_buffer.Write(m_camera_instances);
+	if (m_camera_first_instance == InstanceBuffer::WRITE_FAILED)
+		return;
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_pos_texture);
-	m_deferred_program.loadInt("uniform_tex_pos", 0);
+	// the parts the camera sees, CullNodes queued them and WriteUniformBlocks wrote their materials
+	m_render_queue.Execute(m_instance_buffer, m_camera_first_instance, [this](unsigned int material)
+	{
+		if (material < m_material_block_offsets.size())
+			m_uniform_buffer.BindRange(UNIFORM_BLOCK_MATERIAL, m_material_block_offsets[material], sizeof(MaterialBlock));
+	});
+}
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_normal_texture);
-	m_deferred_program.loadInt("uniform_tex_normal", 1);
 
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_albedo_texture);
-	m_deferred_program.loadInt("uniform_tex_albedo", 2);
+void Renderer::RenderDeferredShading()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_fbo_texture, 0);
 
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_mask_texture);
-	m_deferred_program.loadInt("uniform_tex_mask", 3);
+	GLenum drawbuffers[1] = { GL_COLOR_ATTACHMENT0 };
 
-	glActiveTexture(GL_TEXTURE4);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_depth_texture);
-	m_deferred_program.loadInt("uniform_tex_depth", 4);
+	glDrawBuffers(1, drawbuffers);
 
-	glActiveTexture(GL_TEXTURE10);
-	glBindTexture(GL_TEXTURE_2D, m_dragon_light1.GetShadowMapDepthTexture());
-	m_deferred_program.loadInt("uniform_shadow_map", 10);
+	glViewport(0, 0, m_screen_width, m_screen_height);
 
-	glBindVertexArray(m_vao_fbo);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
 
-	m_deferred_program.Unbind();
+	glClear(GL_COLOR_BUFFER_BIT);
 
+	glBeginQuery(GL_TIME_ELAPSED, m_lighting_query);
 
 	m_deferred_program.Bind();
+	m_deferred_program.loadInt(UNIFORM_COMPACT_GBUFFER, m_gbuffer_layout == GBUFFER_COMPACT ? 1 : 0);
 
-
-	m_deferred_program.loadVec3("uniform_light_color", m_dragon_light2.GetColor());
-	m_deferred_program.loadVec3("uniform_light_dir", m_dragon_light2.GetDirection());
-	m_deferred_program.loadVec3("uniform_light_pos", m_dragon_light2.GetPosition());
-
-	m_deferred_program.loadFloat("uniform_light_umbra", m_dragon_light2.GetUmbra());
-	m_deferred_program.loadFloat("uniform_light_penumbra", m_dragon_light2.GetPenumbra());
-
-	m_deferred_program.loadVec3("uniform_camera_pos", m_camera_position);
-	m_deferred_program.loadVec3("uniform_camera_dir", normalize(m_camera_target_position - m_camera_position));
-
-	m_deferred_program.loadMat4("uniform_light_projection_view", m_dragon_light2.GetProjectionMatrix() * m_dragon_light2.GetViewMatrix());
-	m_deferred_program.loadInt("uniform_cast_shadows", m_dragon_light2.GetCastShadowsStatus() ? 1 : 0);
+	m_uniform_buffer.BindRange(UNIFORM_BLOCK_FRAME, m_frame_block_offset, sizeof(FrameBlock));
+	m_uniform_buffer.BindRange(UNIFORM_BLOCK_LIGHTS, m_lights_block_offset, sizeof(LightsBlock));
+	m_uniform_buffer.BindRange(UNIFORM_BLOCK_SHADOWS, m_shadows_block_offset, sizeof(ShadowsBlock));
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, m_fbo_pos_texture);
-	m_deferred_program.loadInt("uniform_tex_pos", 0);
 
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, m_fbo_normal_texture);
-	m_deferred_program.loadInt("uniform_tex_normal", 1);
 
 	glActiveTexture(GL_TEXTURE2);
 	glBindTexture(GL_TEXTURE_2D, m_fbo_albedo_texture);
-	m_deferred_program.loadInt("uniform_tex_albedo", 2);
 
 	glActiveTexture(GL_TEXTURE3);
 	glBindTexture(GL_TEXTURE_2D, m_fbo_mask_texture);
-	m_deferred_program.loadInt("uniform_tex_mask", 3);
 
 	glActiveTexture(GL_TEXTURE4);
 	glBindTexture(GL_TEXTURE_2D, m_fbo_depth_texture);
-	m_deferred_program.loadInt("uniform_tex_depth", 4);
 
-	glActiveTexture(GL_TEXTURE10);
-	glBindTexture(GL_TEXTURE_2D, m_dragon_light2.GetShadowMapDepthTexture());
-	m_deferred_program.loadInt("uniform_shadow_map", 10);
+	glActiveTexture(GL_TEXTURE8);
+	glBindTexture(GL_TEXTURE_2D, m_shadow_atlas.GetTexture());
 
 	glBindVertexArray(m_vao_fbo);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
-
-	m_deferred_program.Unbind();
-
-
-	m_deferred_program.Bind();
-
-	m_deferred_program.loadVec3("uniform_light_color", m_light.GetColor());
-	m_deferred_program.loadVec3("uniform_light_dir", m_light.GetDirection());
-	m_deferred_program.loadVec3("uniform_light_pos", m_light.GetPosition());
-
-	m_deferred_program.loadFloat("uniform_light_umbra", m_light.GetUmbra());
-	m_deferred_program.loadFloat("uniform_light_penumbra", m_light.GetPenumbra());
-
-	m_deferred_program.loadVec3("uniform_camera_pos", m_camera_position);
-	m_deferred_program.loadVec3("uniform_camera_dir", normalize(m_camera_target_position - m_camera_position));
 
-	m_deferred_program.loadMat4("uniform_light_projection_view", m_light.GetProjectionMatrix() * m_light.GetViewMatrix());
-	m_deferred_program.loadInt("uniform_cast_shadows", m_light.GetCastShadowsStatus() ? 1 : 0);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_pos_texture);
-	m_deferred_program.loadInt("uniform_tex_pos", 0);
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_normal_texture);
-	m_deferred_program.loadInt("uniform_tex_normal", 1);
-
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_albedo_texture);
-	m_deferred_program.loadInt("uniform_tex_albedo", 2);
+	if (m_lighting_mode == LIGHTING_SINGLE_PASS)
+	{
+		// the shader loops over the light block
+		m_deferred_program.loadInt(UNIFORM_LIGHT_INDEX, -1);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+	else if (m_lighting_mode == LIGHTING_CLUSTERED)
+	{
+		// the shader loops over the light list of its froxel
+		m_light_clusters.Bind(GL_TEXTURE5, GL_TEXTURE6);
+		m_deferred_program.loadInt(UNIFORM_LIGHT_INDEX, -2);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+	else
+	{
+		// one additive pass per light, the shader reads the light from the light block
+		// the passes add to the cleared target, a light that reaches no pixel is skipped
+		glBlendFunc(GL_ONE, GL_ONE);
+		glEnable(GL_BLEND);
+		if (m_bound_lights)
+			glEnable(GL_SCISSOR_TEST);
+
+		size_t count = std::min(m_lights.size(), (size_t)MAX_LIGHTS);
+		if (m_coverage_queries.size() < count)
+		{
+			size_t first = m_coverage_queries.size();
+			m_coverage_queries.resize(count);
+			glGenQueries((GLsizei)(count - first), &m_coverage_queries[first]);
+		}
+		m_coverage_queried.assign(count, false);
+		m_light_coverage.assign(count, LightCoverage{ 0, 0 });
 
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_mask_texture);
-	m_deferred_program.loadInt("uniform_tex_mask", 3);
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::vec2 depth(0.f, 1e30f);
+			if (m_bound_lights)
+			{
+				const LightBounds& bounds = m_light_bounds[i];
+				if (!bounds.visible)
+					continue;
+				glScissor(bounds.scissor.x, bounds.scissor.y, bounds.scissor.z, bounds.scissor.w);
+				depth = bounds.depth;
+				m_light_coverage[i].bounded = bounds.scissor.z * bounds.scissor.w;
+			}
+			else
+			{
+				m_light_coverage[i].bounded = m_screen_width * m_screen_height;
+			}
 
-	glActiveTexture(GL_TEXTURE4);
-	glBindTexture(GL_TEXTURE_2D, m_fbo_depth_texture);
-	m_deferred_program.loadInt("uniform_tex_depth", 4);
+			m_deferred_program.loadInt(UNIFORM_LIGHT_INDEX, (int)i);
+			m_deferred_program.loadVec2(UNIFORM_LIGHT_DEPTH_RANGE, depth);
+			glBeginQuery(GL_SAMPLES_PASSED, m_coverage_queries[i]);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+			glEndQuery(GL_SAMPLES_PASSED);
+			m_coverage_queried[i] = true;
+		}
 
-	glActiveTexture(GL_TEXTURE10);
-	glBindTexture(GL_TEXTURE_2D, m_light.GetShadowMapDepthTexture());
-	m_deferred_program.loadInt("uniform_shadow_map", 10);
+		glDisable(GL_SCISSOR_TEST);
+	}
 
-	glBindVertexArray(m_vao_fbo);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 	glBindVertexArray(0);
 
 	m_deferred_program.Unbind();
+	glEndQuery(GL_TIME_ELAPSED);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glDepthMask(GL_TRUE);
 
@@ -1179,11 +1491,14 @@ void Renderer::RenderDeferredShading()
 
 void Renderer::RenderGeometry()
 {
+	const bool compact = (m_gbuffer_layout == GBUFFER_COMPACT);
+
+	// the compact layout has no position target, the lighting target stays attached without being drawn
 	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_fbo_pos_texture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compact ? m_fbo_texture : m_fbo_pos_texture, 0);
 
 	GLenum drawbuffers[4] = {
-		GL_COLOR_ATTACHMENT0,
+		compact ? (GLenum)GL_NONE : GL_COLOR_ATTACHMENT0,
 		GL_COLOR_ATTACHMENT1,
 		GL_COLOR_ATTACHMENT2,
 		GL_COLOR_ATTACHMENT3 };
@@ -1200,6 +1515,8 @@ void Renderer::RenderGeometry()
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	m_geometry_program.Bind();
+	m_geometry_program.loadInt(UNIFORM_COMPACT_GBUFFER, compact ? 1 : 0);
+	m_geometry_program.loadInt(UNIFORM_DRAW_MATERIALS, m_indirect_frame ? 1 : 0);
 	RenderStaticGeometry();
 	auto e = glGetError();
 
@@ -1211,47 +1528,119 @@ void Renderer::RenderGeometry()
 
 void Renderer::RenderShadowMaps()
 {
+	CullStatistics& statistics = m_cull_statistics[CULL_PASS_SHADOW];
+	CullStatistics& static_statistics = m_cull_statistics[CULL_PASS_STATIC_SHADOW];
+	statistics = {};
+	static_statistics = {};
 
-	if (m_light.GetCastShadowsStatus())
-	{
-		int m_depth_texture_resolution = m_light.GetShadowMapResolution();
-
-		glBindFramebuffer(GL_FRAMEBUFFER, m_light.GetShadowMapFBO());
-		glViewport(0, 0, m_depth_texture_resolution, m_depth_texture_resolution);
-		glEnable(GL_DEPTH_TEST);
-		glClear(GL_DEPTH_BUFFER_BIT);
+	glBeginQuery(GL_TIME_ELAPSED, m_shadow_query);
+	// the deferred passes leave the depth writes off, the clears and the casters need them
+	glDepthMask(GL_TRUE);
+	// the clears and the copies stay in the tile of the light
+	glEnable(GL_SCISSOR_TEST);
 
-		// Bind the shadow mapping program
-		m_spot_light_shadow_map_program.Bind();
+	// every light the shadow block samples, in its order
+	for (size_t i = 0; i < m_shadow_lights.size(); i++)
+	{
+		LightNode* light = m_shadow_lights[i];
+		const ShadowAtlas::Tile& tile = m_shadow_tiles[i];
+		glScissor(tile.x, tile.y, tile.size, tile.size);
 
-		glm::mat4 proj = m_light.GetProjectionMatrix() * m_light.GetViewMatrix() * m_world_matrix;
+		if (!m_shadow_caching)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, m_shadow_atlas.GetFBO());
+			glClear(GL_DEPTH_BUFFER_BIT);
+			CullShadowCasters(*light, CASTERS_ALL, m_shadow_casters, statistics);
+			DrawShadowCasters(*light, tile, m_shadow_casters, statistics);
+			continue;
+		}
 
-		for (auto& node : this->m_nodes)
+		// the static casters once for every position of the light, tile and version of the level
+		if (light->GetStaticShadowMapVersion() != m_static_geometry_version)
 		{
-			if (node) {
-				
-				glBindVertexArray(node->m_vao);
+			glBindFramebuffer(GL_FRAMEBUFFER, m_shadow_atlas.GetCacheFBO());
+			glClear(GL_DEPTH_BUFFER_BIT);
+			CullShadowCasters(*light, CASTERS_STATIC, m_shadow_casters, static_statistics);
+			DrawShadowCasters(*light, tile, m_shadow_casters, static_statistics);
+			light->SetStaticShadowMapVersion(m_static_geometry_version);
+		}
 
-				m_spot_light_shadow_map_program.loadMat4("uniform_projection_matrix", proj * node->app_model_matrix);
+		// the copy of the cached tile with the dynamic nodes on top
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, m_shadow_atlas.GetCacheFBO());
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_shadow_atlas.GetFBO());
+		glBlitFramebuffer(tile.x, tile.y, tile.x + tile.size, tile.y + tile.size, tile.x, tile.y, tile.x + tile.size, tile.y + tile.size,
+			GL_DEPTH_BUFFER_BIT, GL_NEAREST);
 
-				for (int j = 0; j < node->parts.size(); ++j)
-				{
-					glDrawArrays(GL_TRIANGLES, node->parts[j].start_offset, node->parts[j].count);
-				}
+		glBindFramebuffer(GL_FRAMEBUFFER, m_shadow_atlas.GetFBO());
+		CullShadowCasters(*light, CASTERS_DYNAMIC, m_shadow_casters, statistics);
+		DrawShadowCasters(*light, tile, m_shadow_casters, statistics);
+	}
 
-				glBindVertexArray(0);
-			}
-		}
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDepthMask(GL_FALSE);
+	glEndQuery(GL_TIME_ELAPSED);
+}
 
-		glm::vec3 camera_dir = normalize(m_camera_target_position - m_camera_position);
-		float_t isectT = 0.f;
-		int32_t primID;
+void Renderer::DrawShadowCasters(LightNode& light, const ShadowAtlas::Tile& tile, const std::vector<GeometryNode*>& casters, CullStatistics& statistics)
+{
+	glViewport(tile.x, tile.y, tile.size, tile.size);
+	glEnable(GL_DEPTH_TEST);
 
+	// Bind the shadow mapping program
+	m_spot_light_shadow_map_program.Bind();
+	m_spot_light_shadow_map_program.loadMat4(UNIFORM_PROJECTION_MATRIX, light.GetProjectionMatrix() * light.GetViewMatrix());
 
+	// the depth only needs the world matrices
+	GroupInstances(casters, false, m_shadow_groups, m_shadow_instances);
+	size_t first_instance = m_instance_buffer.Write(m_shadow_instances);
+	if (first_instance == InstanceBuffer::WRITE_FAILED)
+	{
 		m_spot_light_shadow_map_program.Unbind();
 		glDisable(GL_DEPTH_TEST);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return;
+	}
+
+	// one multi-draw for every part of every group
+	if (m_indirect_frame)
+	{
+		m_shadow_commands.clear();
+		for (auto& group : m_shadow_groups)
+		{
+			const MeshArena::Range& range = group.node->m_arena_range;
+			for (auto& part : group.node->parts)
+				m_shadow_commands.push_back({ part.count, (GLuint)group.count, range.first_index + part.start_offset, range.base_vertex, (GLuint)(first_instance + group.first) });
+		}
+		size_t first_command = m_indirect_buffer.Write(m_shadow_commands);
+		if (first_command != IndirectBuffer::WRITE_FAILED)
+		{
+			glBindVertexArray(AssetManager::GetInstance().GetArena().GetVAO());
+			m_instance_buffer.Bind(0);
+			m_indirect_buffer.Draw(first_command, m_shadow_commands.size());
+			glBindVertexArray(0);
+			statistics.draws += (unsigned int)m_shadow_commands.size();
+		}
 	}
+	else
+	{
+		// every mesh is in the arena, only the instances move between the groups
+		glBindVertexArray(AssetManager::GetInstance().GetArena().GetVAO());
+		for (auto& group : m_shadow_groups)
+		{
+			GeometryNode* node = group.node;
+			m_instance_buffer.Bind(first_instance + group.first);
+
+			for (int j = 0; j < node->parts.size(); ++j)
+			{
+				node->DrawPart(node->parts[j], (GLsizei)group.count);
+			}
+			statistics.draws += (unsigned int)node->parts.size();
+		}
+		glBindVertexArray(0);
+	}
+
+	m_spot_light_shadow_map_program.Unbind();
+	glDisable(GL_DEPTH_TEST);
 }
 
 void Renderer::CameraMoveForward(bool enable)
@@ -7,13 +7,124 @@
 #include "ShaderProgram.h"
 #include "GeometryNode.h"
 #include "LightNode.h"
+#include "UniformBuffer.h"
+#include "LightClusters.h"
+#include "FrustumCuller.h"
+#include "ShadowAtlas.h"
+#include "InstanceBuffer.h"
+#include "StaticBatch.h"
+#include "RenderQueue.h"
+#include "IndirectBuffer.h"
 #include <bitset>
+#include <memory>
 
+// the uniform blocks of the shaders in std140 layout, only vec4 and mat4 members
+// so the C++ layout matches without padding
+// 256 lights of 64 bytes fill the 16 KB every implementation has for a block
+#define MAX_LIGHTS 256
+#define MAX_SHADOW_LIGHTS 16
+
+struct FrameBlock
+{
+	glm::vec4 camera_pos;
+	glm::vec4 camera_dir;
+	// lights, shadow maps
+	glm::ivec4 light_count;
+	glm::mat4 view;
+	// the world position of a pixel from its depth in the compact G-buffer
+	glm::mat4 inverse_projection_view;
+	// clusters per pixel in x and y, slices per log of the view depth, near plane
+	glm::vec4 clusters;
+};
+
+struct LightBlock
+{
+	glm::vec4 color;
+	glm::vec4 position;
+	glm::vec4 direction;
+	// cosine of the half umbra and half penumbra, shadow map or -1, range of the clusters
+	glm::vec4 cone;
+};
+
+struct LightsBlock
+{
+	LightBlock lights[MAX_LIGHTS];
+};
+
+struct ShadowsBlock
+{
+	glm::mat4 projection_view[MAX_SHADOW_LIGHTS];
+	// the tile of every shadow map in the atlas, offset and size in texture coordinates
+	glm::vec4 atlas_rect[MAX_SHADOW_LIGHTS];
+};
+
+struct MaterialBlock
+{
+	glm::vec4 diffuse;
+	glm::vec4 ambient;
+	glm::vec4 specular;
+	// shininess, metallic
+	glm::vec4 params;
+	// has diffuse, emissive, mask and normal texture
+	glm::ivec4 textures;
+};
+
+// the materials one multi-draw of the geometry pass can read
+#define MAX_DRAW_MATERIALS 128
+
+struct DrawMaterialsBlock
+{
+	MaterialBlock materials[MAX_DRAW_MATERIALS];
+};
 
 class Renderer
 {
 public:
-	// Empty
+	// pixels of the scissor rectangle of a light's pass and pixels its shader did not reject
+	struct LightCoverage
+	{
+		unsigned int bounded;
+		unsigned int shaded;
+	};
+
+	enum LightingMode
+	{
+		// one full-screen pass per light blended together
+		LIGHTING_MULTI_PASS,
+		// one full-screen pass that reads the G-buffer once and loops over every light
+		LIGHTING_SINGLE_PASS,
+		// one full-screen pass that loops over the lights binned into the froxel of the pixel
+		LIGHTING_CLUSTERED
+	};
+
+	// the passes that cull the nodes against a frustum
+	enum CullPass
+	{
+		CULL_PASS_CAMERA,
+		// the casters of all the shadow maps together, only the dynamic ones while the maps are cached
+		CULL_PASS_SHADOW,
+		// the static casters rendered into the caches of the shadow maps, none while they are valid
+		CULL_PASS_STATIC_SHADOW,
+		CULL_PASS_COUNT
+	};
+
+	struct CullStatistics
+	{
+		unsigned int visible;
+		unsigned int culled;
+		// of the culled casters, the ones in the light frustum whose shadow falls on no visible node
+		unsigned int no_receiver;
+		// the draw calls of the visible nodes, one per part of every mesh they instance
+		unsigned int draws;
+	};
+
+	enum GBufferLayout
+	{
+		// RGBA32F position, normal, albedo and mask, RGBA32F lighting
+		GBUFFER_FULL,
+		// position from the depth, octahedral RG16 normal, RGBA8 albedo and mask, R11G11B10F lighting
+		GBUFFER_COMPACT
+	};
 
 protected:
 	int	m_screen_width, m_screen_height;
@@ -59,6 +170,9 @@ protected:
 
 	int score;
 
+	// time per frame for uploading the assets that finished loading
+	double m_upload_budget_ms = 2.0;
+
 	// Protected Functions
 	bool InitShaders();
 	bool InitGeometricMeshes();
@@ -73,6 +187,31 @@ protected:
 	void RenderStaticGeometry();
 	void RenderShadowMaps();
 	void RenderPostProcess();
+	void WriteUniformBlocks();
+	void CullNodes();
+	// merges the static nodes again once loading has finished and new ones became resident
+	void UpdateStaticBatch();
+	enum CasterSet
+	{
+		CASTERS_ALL,
+		CASTERS_STATIC,
+		CASTERS_DYNAMIC
+	};
+	// the nodes of a set in the frustum of the light, without the ones whose shadow cannot fall
+	// on a node the camera sees unless they are static and go into the cache
+	void CullShadowCasters(LightNode& light, CasterSet set, std::vector<GeometryNode*>& casters, CullStatistics& statistics);
+	// the nodes that share a mesh drawn by one instanced draw per part, the groups keep
+	// the order of the first node of every mesh, first is an index in instances
+	struct InstanceGroup
+	{
+		GeometryNode* node;
+		size_t first;
+		size_t count;
+	};
+	void GroupInstances(const std::vector<GeometryNode*>& nodes, bool normals, std::vector<InstanceGroup>& groups, std::vector<InstanceData>& instances);
+	void DrawShadowCasters(LightNode& light, const ShadowAtlas::Tile& tile, const std::vector<GeometryNode*>& casters, CullStatistics& statistics);
+	// the shadow lights of the frame and their tiles by the fraction of the screen they reach
+	void AllocateShadowTiles(int count);
 
 	enum OBJECTS
 	{
@@ -83,11 +222,96 @@ protected:
 
 	std::vector<GeometryNode*> m_nodes;
 
+	// the world space boxes of the resident nodes and the ones the camera sees, in the order of m_nodes
+	bool m_frustum_culling = true;
+	FrustumCuller m_culler;
+	std::vector<GeometryNode*> m_resident_nodes;
+	std::vector<uint8_t> m_node_visible;
+	std::vector<GeometryNode*> m_visible_nodes;
+	CullStatistics m_cull_statistics[CULL_PASS_COUNT] = {};
+	std::vector<uint8_t> m_caster_visible;
+	// the visible nodes by mesh, their instances go into the buffer at m_camera_first_instance
+	bool m_instancing = true;
+	InstanceBuffer m_instance_buffer;
+	std::vector<InstanceGroup> m_camera_groups;
+	std::vector<InstanceData> m_camera_instances;
+	size_t m_camera_first_instance = 0;
+	// the parts of the camera groups in the order of their material, mesh and depth
+	RenderQueue m_render_queue;
+	// the passes issue their draws as commands of multi-draws over the mesh arena, when the
+	// materials of the frame fit in the draw materials block
+	bool m_indirect_drawing = true;
+	bool m_indirect_supported = false;
+	bool m_indirect_frame = false;
+	IndirectBuffer m_indirect_buffer;
+	std::vector<DrawElementsIndirectCommand> m_shadow_commands;
+	std::vector<InstanceGroup> m_shadow_groups;
+	std::vector<InstanceData> m_shadow_instances;
+	std::vector<GeometryNode*> m_shadow_casters;
+	// the shadow maps of all the lights share one atlas within the budget in bytes,
+	// m_shadow_tiles are the tiles of m_shadow_lights
+	ShadowAtlas m_shadow_atlas;
+	size_t m_shadow_budget = 32 * 1024 * 1024;
+	std::vector<float> m_shadow_importance;
+	std::vector<ShadowAtlas::Tile> m_shadow_tiles;
+	std::vector<LightNode*> m_previous_shadow_lights;
+	std::vector<ShadowAtlas::Tile> m_previous_shadow_tiles;
+	// the shadow maps start from a copy of the static casters rendered for the current version
+	bool m_shadow_caching = true;
+	unsigned int m_static_geometry_version = 1;
+	size_t m_resident_static_nodes = 0;
+	// the resident static nodes merged by material, drawn in place of them
+	bool m_static_batching = true;
+	StaticBatch m_static_batch;
+	size_t m_static_batch_sources = 0;
+	double m_static_batch_ms = 0.0;
+
 	LightNode        m_light;
 	LightNode        m_spotlight;
 	LightNode        m_room_light;
 	LightNode        m_dragon_light1;
 	LightNode        m_dragon_light2;
+	// the lights added at runtime, after the ones of the scene
+	std::vector<std::unique_ptr<LightNode>> m_added_lights;
+	// the lights in the order of the light block
+	std::vector<LightNode*> m_lights;
+	// the lights with a shadow map in the order of the shadow block
+	std::vector<LightNode*> m_shadow_lights;
+
+	LightingMode m_lighting_mode = LIGHTING_SINGLE_PASS;
+	GBufferLayout m_gbuffer_layout = GBUFFER_COMPACT;
+	// the scissor rectangle (x, y, width, height) and view depths of every light, for the multi-pass mode
+	struct LightBounds
+	{
+		bool visible;
+		glm::ivec4 scissor;
+		glm::vec2 depth;
+	};
+	bool m_bound_lights = true;
+	std::vector<LightBounds> m_light_bounds;
+	// samples passed by the pass of every light and the coverage of the last frame
+	std::vector<GLuint> m_coverage_queries;
+	std::vector<bool> m_coverage_queried;
+	std::vector<LightCoverage> m_light_coverage;
+
+	// the light lists of the froxels, built every frame in the clustered mode
+	LightClusters m_light_clusters;
+	std::vector<LightClusters::Light> m_cluster_lights;
+	// GPU time of the deferred shading
+	GLuint m_lighting_query;
+	// GPU time of the shadow maps
+	GLuint m_shadow_query;
+
+	// frame, light, shadow and material blocks of the current frame
+	UniformBuffer	m_uniform_buffer;
+	GLintptr m_frame_block_offset;
+	GLintptr m_lights_block_offset;
+	GLintptr m_shadows_block_offset;
+	// one material block per material of the render queue, or all of them in the draw materials block
+	std::vector<GLintptr> m_material_block_offsets;
+	GLintptr m_draw_materials_block_offset;
+	// false when the uniform buffer had no room for the materials, the geometry pass skips the frame then
+	bool m_materials_written = false;
 
 	ShaderProgram	m_geometry_program;
 	ShaderProgram	m_deferred_program;
@@ -134,6 +358,64 @@ public:
 	bool GetHeroState();
 	int GetScore();
 
+	void SetLightingMode(LightingMode mode) { m_lighting_mode = mode; }
+	LightingMode GetLightingMode() const { return m_lighting_mode; }
+	// a light on top of the ones of the scene, up to MAX_LIGHTS are shaded
+	LightNode& AddLight();
+	void RemoveAddedLights();
+	size_t GetLightCount() const { return m_lights.size(); }
+	// milliseconds of the deferred shading of the last frame, waits for the GPU
+	double GetLightingTime();
+	// milliseconds of the shadow maps of the last frame, waits for the GPU
+	double GetShadowTime();
+	// skip the nodes outside of the frustum of a pass
+	void SetFrustumCulling(bool enable) { m_frustum_culling = enable; }
+	bool GetFrustumCulling() const { return m_frustum_culling; }
+	// copy the static casters from a cache into the shadow maps and draw only the dynamic nodes
+	void SetShadowCaching(bool enable) { m_shadow_caching = enable; }
+	bool GetShadowCaching() const { return m_shadow_caching; }
+	// the static nodes changed, the caches are rendered again
+	void InvalidateStaticShadows() { m_static_geometry_version++; }
+	// reallocates the shadow atlas and its cache within the bytes
+	bool SetShadowBudget(size_t bytes);
+	size_t GetShadowBudget() const { return m_shadow_budget; }
+	const ShadowAtlas& GetShadowAtlas() const { return m_shadow_atlas; }
+	// the tiles of the lights with a shadow map in the last frame
+	const std::vector<ShadowAtlas::Tile>& GetShadowTiles() const { return m_shadow_tiles; }
+	// one draw per part of every mesh for all the nodes that share it, or per node without
+	void SetInstancing(bool enable) { m_instancing = enable; }
+	bool GetInstancing() const { return m_instancing; }
+	// one draw per material for all the static nodes, they are no longer culled one by one
+	void SetStaticBatching(bool enable);
+	bool GetStaticBatching() const { return m_static_batching; }
+	const StaticBatch& GetStaticBatch() const { return m_static_batch; }
+	const std::vector<GeometryNode*>& GetNodes() const { return m_nodes; }
+	// milliseconds of the last merge and upload of the static batch
+	double GetStaticBatchTime() const { return m_static_batch_ms; }
+	// sort the draws of the geometry pass and skip the binds of the state they share, or draw in node order
+	void SetRenderQueueSorting(bool enable) { m_render_queue.SetSorting(enable); }
+	bool GetRenderQueueSorting() const { return m_render_queue.GetSorting(); }
+	// the binds and material uploads of the geometry pass in the last frame
+	const RenderQueue::Statistics& GetRenderQueueStatistics() const { return m_render_queue.GetStatistics(); }
+	// one multi-draw per pass instead of a draw per part, where GL 4.3 or ARB_multi_draw_indirect is there
+	void SetIndirectDrawing(bool enable) { m_indirect_drawing = enable; }
+	bool GetIndirectDrawing() const { return m_indirect_drawing; }
+	bool IsIndirectDrawingSupported() const { return m_indirect_supported; }
+	// the passes of the last frame drew with multi-draws
+	bool IsIndirectFrame() const { return m_indirect_frame; }
+	// the nodes of the last frame a pass drew and skipped
+	const CullStatistics& GetCullStatistics(CullPass pass) const { return m_cull_statistics[pass]; }
+	// reallocates the targets in the new layout
+	bool SetGBufferLayout(GBufferLayout layout);
+	GBufferLayout GetGBufferLayout() const { return m_gbuffer_layout; }
+	// memory of the G-buffer, the depth and the lighting target
+	size_t GetGBufferBytes() const;
+	// limit the passes of the multi-pass mode to the pixels and depths their light can reach
+	void SetLightBounds(bool enable) { m_bound_lights = enable; }
+	bool GetLightBounds() const { return m_bound_lights; }
+	// the pixels of every light in the last multi-pass frame, waits for the GPU
+	const std::vector<LightCoverage>& GetLightCoverage();
+
 };
 
 #endif
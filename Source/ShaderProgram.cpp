@@ -1,10 +1,57 @@
 #include "ShaderProgram.h"
 #include "Tools.h"
+#include "VirtualFileSystem.h"
 #include "SDL2\SDL.h"
+#include <algorithm>
+
+namespace
+{
+	// in the order of UniformID
+	const char* const uniform_names[] =
+	{
+		"uniform_projection_matrix",
+		"uniform_normal_matrix",
+		"uniform_world_matrix",
+		"uniform_tex_diffuse",
+		"uniform_tex_mask",
+		"uniform_tex_normal",
+		"uniform_tex_emissive",
+		"uniform_tex_pos",
+		"uniform_tex_albedo",
+		"uniform_tex_depth",
+		"uniform_shadow_map",
+		"uniform_shadow_atlas",
+		"uniform_texture",
+		"uniform_light_index",
+		"uniform_cluster_grid",
+		"uniform_cluster_lights",
+		"uniform_light_depth_range",
+		"uniform_compact_gbuffer",
+		"uniform_draw_materials"
+	};
+	static_assert(sizeof(uniform_names) / sizeof(uniform_names[0]) == UNIFORM_COUNT, "every UniformID needs a name");
+
+	// in the order of UniformBlockID
+	const char* const uniform_block_names[] =
+	{
+		"FrameData",
+		"LightData",
+		"MaterialData",
+		"ShadowData",
+		"DrawMaterialData"
+	};
+	static_assert(sizeof(uniform_block_names) / sizeof(uniform_block_names[0]) == UNIFORM_BLOCK_COUNT, "every UniformBlockID needs a name");
+}
 
 ShaderProgram::ShaderProgram()
 {
 	program = 0;
+	for (int i = 0; i < UNIFORM_COUNT; i++)
+	{
+		locations[i] = -1;
+		sampler_units[i] = -1;
+		sampler_counts[i] = 0;
+	}
 
 	vertexShaderFilename = NULL;
 	fragmentShaderFilename = NULL;
@@ -82,9 +129,50 @@ bool ShaderProgram::CreateProgramShader()
 		PrintLog(program);
 		return false;
 	}
+	ResolveUniforms();
 	return true;
 }
 
+void ShaderProgram::ResolveUniforms()
+{
+	for (int i = 0; i < UNIFORM_COUNT; i++)
+		locations[i] = glGetUniformLocation(program, uniform_names[i]);
+
+	for (int i = 0; i < UNIFORM_BLOCK_COUNT; i++)
+	{
+		GLuint index = glGetUniformBlockIndex(program, uniform_block_names[i]);
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(program, index, i);
+	}
+
+	// a relinked program lost its sampler values
+	glUseProgram(program);
+	for (int i = 0; i < UNIFORM_COUNT; i++)
+		ApplySampler((UniformID)i);
+	glUseProgram(0);
+}
+
+void ShaderProgram::SetSampler(UniformID pID, GLint unit, GLsizei count)
+{
+	sampler_units[pID] = unit;
+	sampler_counts[pID] = count;
+	glUseProgram(program);
+	ApplySampler(pID);
+	glUseProgram(0);
+}
+
+void ShaderProgram::ApplySampler(UniformID pID)
+{
+	if (sampler_units[pID] < 0)
+		return;
+
+	GLint units[32];
+	GLsizei count = std::min<GLsizei>(sampler_counts[pID], 32);
+	for (GLsizei i = 0; i < count; i++)
+		units[i] = sampler_units[pID] + i;
+	glUniform1iv(locations[pID], count, units);
+}
+
 bool ShaderProgram::CreateProgram()
 {
 	// if fail, show text message and redo
@@ -146,17 +234,18 @@ GLuint ShaderProgram::GenerateShader(const char* filename, GLenum shaderType)
 {
 	if (!filename) return 0;
 
-	const char* source = Tools::LoadWholeStringFile(filename);
-	if (source == NULL) {
+	VirtualFile file;
+	if (!VirtualFileSystem::GetInstance().Open(filename, file)) {
 		printf("Error opening %s: ", filename);
-		delete[] source;
 		return 0;
 	}
 	
 	GLuint res = glCreateShader(shaderType);
 
-	glShaderSource(res, 1, &source, NULL);
-	delete[] source;
+	const GLchar* source = file.Data();
+	GLint length = (GLint)file.Size();
+	glShaderSource(res, 1, &source, &length);
+	file.Close();
 
 	glCompileShader(res);
 	GLint compile_ok = GL_FALSE;
@@ -7,6 +7,45 @@
 #include "GLEW\glew.h"
 #include "glm/gtc/type_ptr.hpp"
 
+// the uniforms the renderer sets every frame, their names are in ShaderProgram.cpp
+// every program resolves the whole table when it is linked, the ones it does not
+// use get the location -1 which OpenGL ignores
+enum UniformID
+{
+	UNIFORM_PROJECTION_MATRIX,
+	UNIFORM_NORMAL_MATRIX,
+	UNIFORM_WORLD_MATRIX,
+	UNIFORM_TEX_DIFFUSE,
+	UNIFORM_TEX_MASK,
+	UNIFORM_TEX_NORMAL,
+	UNIFORM_TEX_EMISSIVE,
+	UNIFORM_TEX_POS,
+	UNIFORM_TEX_ALBEDO,
+	UNIFORM_TEX_DEPTH,
+	UNIFORM_SHADOW_MAP,
+	UNIFORM_SHADOW_ATLAS,
+	UNIFORM_TEXTURE,
+	UNIFORM_LIGHT_INDEX,
+	UNIFORM_CLUSTER_GRID,
+	UNIFORM_CLUSTER_LIGHTS,
+	UNIFORM_LIGHT_DEPTH_RANGE,
+	UNIFORM_COMPACT_GBUFFER,
+	UNIFORM_DRAW_MATERIALS,
+	UNIFORM_COUNT
+};
+
+// the uniform blocks (std140) the renderer fills once per frame, the value is the
+// binding point, every program binds the blocks it declares by name when it is linked
+enum UniformBlockID
+{
+	UNIFORM_BLOCK_FRAME,
+	UNIFORM_BLOCK_LIGHTS,
+	UNIFORM_BLOCK_MATERIAL,
+	UNIFORM_BLOCK_SHADOWS,
+	UNIFORM_BLOCK_DRAW_MATERIALS,
+	UNIFORM_BLOCK_COUNT
+};
+
 class ShaderProgram
 {
 	// filepaths of the shaders
@@ -20,6 +59,12 @@ class ShaderProgram
 
 	// hash map with uniform indices
 	std::unordered_map<std::string, GLint> uniforms;
+	// locations of the uniform table
+	GLint locations[UNIFORM_COUNT];
+	// first texture unit of every sampler of the table, -1 if it is not set,
+	// the elements of a sampler array use the following units
+	GLint sampler_units[UNIFORM_COUNT];
+	GLsizei sampler_counts[UNIFORM_COUNT];
 
 public:
 	ShaderProgram();
@@ -41,6 +86,17 @@ public:
 	void loadMat4(const std::string& pKey, const glm::mat4& pValue);
 	void loadFloat(const std::string& pKey, const float pValue);
 
+	// the uniforms of the table, without a lookup
+	void loadVec2(UniformID pID, const glm::vec2& pValue) { glUniform2f(locations[pID], pValue.x, pValue.y); }
+	void loadVec3(UniformID pID, const glm::vec3& pValue) { glUniform3f(locations[pID], pValue.x, pValue.y, pValue.z); }
+	void loadInt(UniformID pID, const int pValue) { glUniform1i(locations[pID], pValue); }
+	void loadMat4(UniformID pID, const glm::mat4& pValue) { glUniformMatrix4fv(locations[pID], 1, GL_FALSE, glm::value_ptr(pValue)); }
+	void loadFloat(UniformID pID, const float pValue) { glUniform1f(locations[pID], pValue); }
+	GLint GetLocation(UniformID pID) const { return locations[pID]; }
+
+	// the texture unit of a sampler (or units of a sampler array), kept across reloads so it is set only once
+	void SetSampler(UniformID pID, GLint unit, GLsizei count = 1);
+
 	// Bind the program to use
 	void Bind();
 	// Unbind the program
@@ -55,6 +111,11 @@ public:
 private:
 	// Create the shader
 	bool CreateProgramShader();
+	// look up the locations of the uniform table in the linked program,
+	// bind its uniform blocks and set the sampler units
+	void ResolveUniforms();
+	// set the units of a sampler of the table on the bound program
+	void ApplySampler(UniformID pID);
 
 	// Load the shader from the disk
 	GLuint GenerateShader(const char* filename, GLenum shaderType);
@@ -0,0 +1,146 @@
+#include "ShadowAtlas.h"
+#include "Tools.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+int ShadowAtlas::SizeForBudget(size_t budget)
+{
+	int size = 0;
+	for (int side = MIN_TILE; side <= 16384 && 2 * TEXEL_BYTES * side * side <= budget; side *= 2)
+		size = side;
+	return size;
+}
+
+void ShadowAtlas::Allocate(int atlas_size, const std::vector<float>& importance, std::vector<Tile>& tiles)
+{
+	tiles.assign(importance.size(), Tile{ 0, 0, 0 });
+	if (atlas_size < MIN_TILE)
+		return;
+
+	// the side the light would need, rounded up to a power of two
+	std::vector<int> order;
+	for (size_t i = 0; i < importance.size(); i++)
+	{
+		if (importance[i] <= 0.f)
+			continue;
+
+		float side = atlas_size * sqrtf(std::min(importance[i], 1.f));
+		int size = MIN_TILE;
+		while (size < side && size < atlas_size)
+			size *= 2;
+		tiles[i].size = size;
+		order.push_back((int)i);
+	}
+
+	// the most important lights first, their tiles are the last to shrink
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return importance[a] > importance[b]; });
+
+	// halve the largest of the least important tiles until they fit, then drop the least important
+	size_t area = 0;
+	for (int i : order)
+		area += (size_t)tiles[i].size * tiles[i].size;
+	while (area > (size_t)atlas_size * atlas_size)
+	{
+		int largest = -1;
+		for (int i : order)
+		{
+			if (tiles[i].size > MIN_TILE && (largest < 0 || tiles[i].size >= tiles[largest].size))
+				largest = i;
+		}
+
+		if (largest < 0)
+		{
+			largest = order.back();
+			order.pop_back();
+			area -= (size_t)tiles[largest].size * tiles[largest].size;
+			tiles[largest].size = 0;
+			continue;
+		}
+
+		area -= (size_t)tiles[largest].size * tiles[largest].size * 3 / 4;
+		tiles[largest].size /= 2;
+	}
+
+	// in decreasing sizes every tile starts at a multiple of its own area along the Z-order
+	// curve of MIN_TILE cells, so it is aligned to its size and no two tiles overlap
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return tiles[a].size > tiles[b].size; });
+	size_t cell = 0;
+	for (int i : order)
+	{
+		int x = 0, y = 0;
+		for (int bit = 0; bit < 16; bit++)
+		{
+			x |= (int)((cell >> (2 * bit)) & 1) << bit;
+			y |= (int)((cell >> (2 * bit + 1)) & 1) << bit;
+		}
+		tiles[i].x = x * MIN_TILE;
+		tiles[i].y = y * MIN_TILE;
+		cell += (size_t)(tiles[i].size / MIN_TILE) * (tiles[i].size / MIN_TILE);
+	}
+}
+
+ShadowAtlas::ShadowAtlas()
+{
+	m_size = 0;
+	m_texture = 0;
+	m_fbo = 0;
+	m_cache_texture = 0;
+	m_cache_fbo = 0;
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+	destroy();
+}
+
+void ShadowAtlas::destroy()
+{
+	glDeleteFramebuffers(1, &m_fbo);
+	glDeleteTextures(1, &m_texture);
+	glDeleteFramebuffers(1, &m_cache_fbo);
+	glDeleteTextures(1, &m_cache_texture);
+	m_texture = m_fbo = m_cache_texture = m_cache_fbo = 0;
+	m_size = 0;
+}
+
+bool ShadowAtlas::Init(size_t budget)
+{
+	destroy();
+	m_size = SizeForBudget(budget);
+	if (m_size == 0)
+		return false;
+
+	GLuint* textures[] = { &m_texture, &m_cache_texture };
+	GLuint* fbos[] = { &m_fbo, &m_cache_fbo };
+	for (int i = 0; i < 2; i++)
+	{
+		GLuint& texture = *textures[i];
+		GLuint& fbo = *fbos[i];
+
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, m_size, m_size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0);
+		glDrawBuffer(GL_NONE);
+
+		GLenum status = Tools::CheckFramebufferStatus(fbo);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			printf("Error in shadow atlas FB generation.\n");
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return false;
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return true;
+}
@@ -0,0 +1,54 @@
+#ifndef SHADOW_ATLAS_H
+#define SHADOW_ATLAS_H
+
+#include "GLEW\glew.h"
+#include <vector>
+
+// One depth texture shared by the shadow maps of all the lights
+// every shadowed light gets a square tile with a power of two side that follows the fraction
+// of the screen the light reaches, the tiles shrink until they fit and are placed in Z-order.
+// the side of the atlas is the largest power of two for which the atlas and the cache of the
+// static casters, a second atlas with the same tiles, stay within a memory budget
+class ShadowAtlas
+{
+	int m_size;
+	GLuint m_texture, m_fbo;
+	GLuint m_cache_texture, m_cache_fbo;
+
+	void destroy();
+
+public:
+	// size 0 is a light without a tile
+	struct Tile
+	{
+		int x, y;
+		int size;
+
+		bool operator==(const Tile& other) const { return x == other.x && y == other.y && size == other.size; }
+	};
+
+	static const int MIN_TILE = 128;
+	// GL_DEPTH_COMPONENT24 is stored in 32 bits
+	static const size_t TEXEL_BYTES = 4;
+
+	// the side of the atlas for a budget, 0 when it cannot hold MIN_TILE
+	static int SizeForBudget(size_t budget);
+	// the tiles of lights by their importance in [0, 1], the lights of importance 0 and the
+	// least important ones when even MIN_TILE does not fit get none
+	static void Allocate(int atlas_size, const std::vector<float>& importance, std::vector<Tile>& tiles);
+
+	ShadowAtlas();
+	~ShadowAtlas();
+
+	// (re)creates the atlas and its cache for the budget in bytes
+	bool Init(size_t budget);
+
+	int GetSize() const { return m_size; }
+	// the atlas and its cache
+	size_t GetBytes() const { return 2 * TEXEL_BYTES * m_size * m_size; }
+	GLuint GetTexture() const { return m_texture; }
+	GLuint GetFBO() const { return m_fbo; }
+	GLuint GetCacheFBO() const { return m_cache_fbo; }
+};
+
+#endif
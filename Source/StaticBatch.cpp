@@ -0,0 +1,154 @@
+#include "StaticBatch.h"
+#include "AssetManager.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <string>
+
+namespace
+{
+	// parts draw alike when their material and textures are the same
+	bool same_material(const GeometryNode::Objects& a, const GeometryNode::Objects& b)
+	{
+		return a.diffuse == b.diffuse && a.ambient == b.ambient && a.specular == b.specular &&
+			a.shininess == b.shininess && a.metallic == b.metallic &&
+			a.diffuse_textureID == b.diffuse_textureID && a.normal_textureID == b.normal_textureID &&
+			a.bump_textureID == b.bump_textureID && a.emissive_textureID == b.emissive_textureID &&
+			a.mask_textureID == b.mask_textureID;
+	}
+}
+
+StaticBatch::StaticBatch()
+{
+	// every batch is an asset of its own
+	static int batches = 0;
+	m_name = "StaticBatch" + std::to_string(batches++);
+	m_uploaded = false;
+}
+
+StaticBatch::~StaticBatch()
+{
+	release();
+}
+
+void StaticBatch::release()
+{
+	if (m_uploaded)
+		AssetManager::GetInstance().ReleaseAsset(m_name);
+	m_node.m_vao = 0;
+	m_node.m_arena_range = {};
+	m_uploaded = false;
+}
+
+void StaticBatch::Clear()
+{
+	for (GeometryNode* node : m_batched)
+		node->m_batched = false;
+	m_batched.clear();
+
+	m_node.parts.clear();
+	m_mesh.vertices.clear();
+	m_mesh.normals.clear();
+	m_mesh.textureCoord.clear();
+	m_mesh.tangents.clear();
+	m_mesh.bitangents.clear();
+	m_mesh.indices.clear();
+	release();
+}
+
+void StaticBatch::Merge(const std::vector<GeometryNode*>& nodes)
+{
+	Clear();
+
+	// the triangles of every material, in the vertices of the batch
+	std::vector<std::vector<unsigned int>> material_indices;
+	std::vector<unsigned int> remap;
+	glm::vec3 bounds_min(FLT_MAX), bounds_max(-FLT_MAX);
+
+	for (GeometryNode* node : nodes)
+	{
+		const GeometricMesh* mesh = node->m_mesh;
+		if (mesh == nullptr || !node->IsResident())
+			continue;
+
+		const glm::mat4& model = node->app_model_matrix;
+		const glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(model)));
+		const bool texcoords = mesh->textureCoord.size() == mesh->vertices.size();
+		const bool tangents = mesh->tangents.size() == mesh->vertices.size() && mesh->bitangents.size() == mesh->vertices.size();
+
+		// a vertex of the node is copied once whatever the number of triangles and parts using it
+		remap.assign(mesh->vertices.size(), UINT_MAX);
+		for (auto& part : node->parts)
+		{
+			size_t material = 0;
+			while (material < m_node.parts.size() && !same_material(m_node.parts[material], part))
+				material++;
+			if (material == m_node.parts.size())
+			{
+				m_node.parts.push_back(part);
+				material_indices.emplace_back();
+			}
+
+			std::vector<unsigned int>& indices = material_indices[material];
+			for (unsigned int k = part.start_offset; k < part.start_offset + part.count; k++)
+			{
+				unsigned int source = node->m_indexed ? mesh->indices[k] : k;
+				if (remap[source] == UINT_MAX)
+				{
+					remap[source] = (unsigned int)m_mesh.vertices.size();
+					m_mesh.vertices.push_back(glm::vec3(model * glm::vec4(mesh->vertices[source], 1.f)));
+					m_mesh.normals.push_back(glm::normalize(normal_matrix * mesh->normals[source]));
+					m_mesh.textureCoord.push_back(texcoords ? mesh->textureCoord[source] : glm::vec2(0.f));
+					m_mesh.tangents.push_back(tangents ? normal_matrix * mesh->tangents[source] : glm::vec3(0.f));
+					m_mesh.bitangents.push_back(tangents ? normal_matrix * mesh->bitangents[source] : glm::vec3(0.f));
+				}
+				indices.push_back(remap[source]);
+			}
+		}
+
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 position((corner & 1) ? node->m_aabb.max.x : node->m_aabb.min.x, (corner & 2) ? node->m_aabb.max.y : node->m_aabb.min.y,
+				(corner & 4) ? node->m_aabb.max.z : node->m_aabb.min.z);
+			position = glm::vec3(model * glm::vec4(position, 1.f));
+			bounds_min = glm::min(bounds_min, position);
+			bounds_max = glm::max(bounds_max, position);
+		}
+
+		node->m_batched = true;
+		m_batched.push_back(node);
+	}
+
+	// the materials follow each other in the index buffer
+	for (size_t material = 0; material < m_node.parts.size(); material++)
+	{
+		m_node.parts[material].start_offset = (unsigned int)m_mesh.indices.size();
+		m_node.parts[material].count = (unsigned int)material_indices[material].size();
+		m_mesh.indices.insert(m_mesh.indices.end(), material_indices[material].begin(), material_indices[material].end());
+	}
+
+	m_mesh.aabb_min = bounds_min;
+	m_mesh.aabb_max = bounds_max;
+	m_node.m_aabb.min = bounds_min;
+	m_node.m_aabb.max = bounds_max;
+	m_node.m_aabb.center = 0.5f * (bounds_min + bounds_max);
+	m_node.model_matrix = m_node.app_model_matrix = glm::mat4(1.f);
+	m_node.m_indexed = true;
+	m_node.m_mesh = &m_mesh;
+}
+
+void StaticBatch::Upload()
+{
+	release();
+	if (m_mesh.indices.empty())
+		return;
+
+	m_node.m_vao = AssetManager::GetInstance().RequestAsset(m_name, &m_mesh);
+	AssetManager::GetInstance().GetArenaRange(m_name, m_node.m_arena_range);
+	m_uploaded = (m_node.m_vao != 0);
+}
+
+size_t StaticBatch::GetBytes() const
+{
+	return m_mesh.vertices.size() * (4 * sizeof(glm::vec3) + sizeof(glm::vec2)) + m_mesh.indices.size() * sizeof(unsigned int);
+}
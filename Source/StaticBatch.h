@@ -0,0 +1,43 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include "GeometryNode.h"
+#include "GeometricMesh.h"
+#include <vector>
+#include <string>
+
+// The static nodes merged by material into one vertex and one index buffer
+// Merge pre-transforms the parts of the nodes by their app_model_matrix and appends the
+// triangles of the parts that share a material and its textures into one range of the index
+// buffer, Upload creates the buffers. The batch is drawn as a GeometryNode with one part per
+// material, so the whole static level takes one draw per material in every pass
+class StaticBatch
+{
+	GeometricMesh m_mesh;
+	GeometryNode m_node;
+	std::vector<GeometryNode*> m_batched;
+	std::string m_name;
+	bool m_uploaded;
+
+	void release();
+
+public:
+	StaticBatch();
+	~StaticBatch();
+
+	// the nodes need their mesh and textures, they are marked m_batched
+	void Merge(const std::vector<GeometryNode*>& nodes);
+	// needs a context, the mesh is kept for the next merge
+	void Upload();
+	// the nodes are drawn on their own again
+	void Clear();
+
+	bool IsUploaded() const { return m_uploaded; }
+	GeometryNode* GetNode() { return &m_node; }
+	size_t GetNodeCount() const { return m_batched.size(); }
+	size_t GetMaterialCount() const { return m_node.parts.size(); }
+	// the vertices and indices of the merged buffers
+	size_t GetBytes() const;
+};
+
+#endif
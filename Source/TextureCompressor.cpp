@@ -0,0 +1,701 @@
+#include "TextureCompressor.h"
+#include "JobSystem.h"
+#include "Tools.h"
+#include "VirtualFileSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// RGBA texels of one mip level, tightly packed
+	struct Level
+	{
+		int width;
+		int height;
+		std::vector<unsigned char> texels;
+	};
+
+	int block_bytes(TextureCompressor::Format format)
+	{
+		return (format == TextureCompressor::BC1) ? 8 : 16;
+	}
+
+	// split the block rows (or texel rows) of a level into a few jobs per thread
+	void parallel_rows(int rows, const std::function<void(size_t, size_t)>& function)
+	{
+		JobSystem& jobs = JobSystem::GetInstance();
+		size_t grain = std::max<size_t>(1, (size_t)rows / (jobs.GetThreadCount() * 4));
+		JobCounter counter;
+		jobs.ParallelFor(counter, (size_t)rows, grain, function);
+		jobs.Wait(counter);
+	}
+
+	// Mip chain
+	// a box filter over 2x2 texels, the normal maps are renormalized after averaging
+
+	void downsample(const Level& source, Level& target, bool normals)
+	{
+		target.width = std::max(1, source.width / 2);
+		target.height = std::max(1, source.height / 2);
+		target.texels.resize((size_t)target.width * target.height * 4);
+
+		parallel_rows(target.height, [&](size_t begin, size_t end)
+		{
+			for (int y = (int)begin; y < (int)end; y++)
+			{
+				int y0 = std::min(y * 2, source.height - 1), y1 = std::min(y * 2 + 1, source.height - 1);
+				for (int x = 0; x < target.width; x++)
+				{
+					int x0 = std::min(x * 2, source.width - 1), x1 = std::min(x * 2 + 1, source.width - 1);
+					const unsigned char* texels[4] = {
+						&source.texels[((size_t)y0 * source.width + x0) * 4], &source.texels[((size_t)y0 * source.width + x1) * 4],
+						&source.texels[((size_t)y1 * source.width + x0) * 4], &source.texels[((size_t)y1 * source.width + x1) * 4] };
+					unsigned char* out = &target.texels[((size_t)y * target.width + x) * 4];
+
+					if (normals)
+					{
+						float n[3] = { 0.f, 0.f, 0.f };
+						for (auto texel : texels)
+							for (int c = 0; c < 3; c++)
+								n[c] += texel[c] / 127.5f - 1.f;
+						float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+						for (int c = 0; c < 3; c++)
+							out[c] = (unsigned char)std::min(255.f, std::max(0.f, (length > 0.f ? n[c] / length : 0.f) * 127.5f + 127.5f + 0.5f));
+						out[3] = 255;
+					}
+					else
+					{
+						for (int c = 0; c < 4; c++)
+							out[c] = (unsigned char)((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+					}
+				}
+			}
+		});
+	}
+
+	// BC1 colour block
+	// the endpoints start at the ends of the principal axis of the colours and are then
+	// refined by least squares against the chosen indices, as long as the error drops
+
+	uint16_t pack565(const float color[3])
+	{
+		int r = (int)(std::min(255.f, std::max(0.f, color[0])) * 31.f / 255.f + 0.5f);
+		int g = (int)(std::min(255.f, std::max(0.f, color[1])) * 63.f / 255.f + 0.5f);
+		int b = (int)(std::min(255.f, std::max(0.f, color[2])) * 31.f / 255.f + 0.5f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void unpack565(uint16_t packed, int color[3])
+	{
+		int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	// the 4 colours of the block, c0 > c1 is the 4 colour mode
+	void color_palette(uint16_t c0, uint16_t c1, int palette[4][3])
+	{
+		unpack565(c0, palette[0]);
+		unpack565(c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			if (c0 > c1)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+	}
+
+	// picks the nearest palette colour of every texel, returns the squared error
+	int color_indices(const unsigned char texels[16][4], const int palette[4][3], uint32_t& indices)
+	{
+		int error = 0;
+		indices = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, best_error = 1 << 30;
+			for (int p = 0; p < 4; p++)
+			{
+				int dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1], db = texels[i][2] - palette[p][2];
+				int e = dr * dr + dg * dg + db * db;
+				if (e < best_error) { best_error = e; best = p; }
+			}
+			indices |= (uint32_t)best << (i * 2);
+			error += best_error;
+		}
+		return error;
+	}
+
+	// quantizes the endpoints into the 4 colour mode and picks the indices
+	int encode_endpoints(const unsigned char texels[16][4], const float a[3], const float b[3], unsigned char* block)
+	{
+		uint16_t c0 = pack565(a), c1 = pack565(b);
+		if (c0 < c1)
+			std::swap(c0, c1);
+
+		uint32_t indices = 0;
+		int error = 0;
+		int palette[4][3];
+		color_palette(c0, c1, palette);
+		if (c0 == c1)
+		{
+			// a single colour, every texel takes the first endpoint
+			for (int i = 0; i < 16; i++)
+				for (int c = 0; c < 3; c++)
+					error += (texels[i][c] - palette[0][c]) * (texels[i][c] - palette[0][c]);
+		}
+		else
+		{
+			error = color_indices(texels, palette, indices);
+		}
+
+		memcpy(block, &c0, 2);
+		memcpy(block + 2, &c1, 2);
+		memcpy(block + 4, &indices, 4);
+		return error;
+	}
+
+	void encode_color_block(const unsigned char texels[16][4], unsigned char* block)
+	{
+		float mean[3] = { 0.f, 0.f, 0.f };
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 3; c++)
+				mean[c] += texels[i][c] / 16.f;
+
+		float covariance[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+		for (int i = 0; i < 16; i++)
+		{
+			float d[3] = { texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2] };
+			covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+			covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+		}
+
+		// power iteration for the principal axis
+		float axis[3] = { 1.f, 1.f, 1.f };
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[3] = {
+				covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+				covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+				covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+			float length = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+			if (length < 1e-6f)
+				break;
+			for (int c = 0; c < 3; c++)
+				axis[c] = next[c] / length;
+		}
+		float axis_length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		for (int c = 0; c < 3; c++)
+			axis[c] /= axis_length;
+
+		float min_t = 0.f, max_t = 0.f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1] + (texels[i][2] - mean[2]) * axis[2];
+			min_t = std::min(min_t, t);
+			max_t = std::max(max_t, t);
+		}
+
+		float a[3], b[3];
+		for (int c = 0; c < 3; c++)
+		{
+			a[c] = mean[c] + axis[c] * max_t;
+			b[c] = mean[c] + axis[c] * min_t;
+		}
+		int error = encode_endpoints(texels, a, b, block);
+
+		for (int iteration = 0; iteration < 2 && error > 0; iteration++)
+		{
+			uint16_t c0, c1;
+			uint32_t indices;
+			memcpy(&c0, block, 2);
+			memcpy(&c1, block + 2, 2);
+			memcpy(&indices, block + 4, 4);
+			if (c0 == c1)
+				break;
+
+			// weight of the first endpoint for the indices 0 to 3
+			const float weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+			float aa = 0.f, bb = 0.f, ab = 0.f, ax[3] = { 0.f, 0.f, 0.f }, bx[3] = { 0.f, 0.f, 0.f };
+			for (int i = 0; i < 16; i++)
+			{
+				float w = weights[(indices >> (i * 2)) & 3];
+				aa += w * w;
+				bb += (1.f - w) * (1.f - w);
+				ab += w * (1.f - w);
+				for (int c = 0; c < 3; c++)
+				{
+					ax[c] += w * texels[i][c];
+					bx[c] += (1.f - w) * texels[i][c];
+				}
+			}
+			float determinant = aa * bb - ab * ab;
+			if (std::fabs(determinant) < 1e-6f)
+				break;
+			for (int c = 0; c < 3; c++)
+			{
+				a[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+				b[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+			}
+
+			unsigned char refined[8];
+			int refined_error = encode_endpoints(texels, a, b, refined);
+			if (refined_error >= error)
+				break;
+			error = refined_error;
+			memcpy(block, refined, 8);
+		}
+	}
+
+	// BC4 channel block, the alpha of BC3 and each channel of BC5
+
+	void channel_palette(int a0, int a1, int palette[8])
+	{
+		palette[0] = a0;
+		palette[1] = a1;
+		if (a0 > a1)
+		{
+			for (int i = 1; i < 7; i++)
+				palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+		}
+		else
+		{
+			for (int i = 1; i < 5; i++)
+				palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	void encode_channel_block(const unsigned char texels[16][4], int channel, unsigned char* block)
+	{
+		int a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; i++)
+		{
+			a0 = std::max(a0, (int)texels[i][channel]);
+			a1 = std::min(a1, (int)texels[i][channel]);
+		}
+
+		int palette[8];
+		channel_palette(a0, a1, palette);
+
+		uint64_t indices = 0;
+		if (a0 != a1)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0, best_error = 1 << 30;
+				for (int p = 0; p < 8; p++)
+				{
+					int e = std::abs(texels[i][channel] - palette[p]);
+					if (e < best_error) { best_error = e; best = p; }
+				}
+				indices |= (uint64_t)best << (i * 3);
+			}
+		}
+
+		block[0] = (unsigned char)a0;
+		block[1] = (unsigned char)a1;
+		for (int i = 0; i < 6; i++)
+			block[2 + i] = (unsigned char)(indices >> (i * 8));
+	}
+
+	void decode_channel_block(const unsigned char* block, int channel, unsigned char texels[16][4])
+	{
+		int palette[8];
+		channel_palette(block[0], block[1], palette);
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; i++)
+			indices |= (uint64_t)block[2 + i] << (i * 8);
+		for (int i = 0; i < 16; i++)
+			texels[i][channel] = (unsigned char)palette[(indices >> (i * 3)) & 7];
+	}
+
+	void decode_color_block(const unsigned char* block, unsigned char texels[16][4])
+	{
+		uint16_t c0, c1;
+		uint32_t indices;
+		memcpy(&c0, block, 2);
+		memcpy(&c1, block + 2, 2);
+		memcpy(&indices, block + 4, 4);
+		int palette[4][3];
+		color_palette(c0, c1, palette);
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 3; c++)
+				texels[i][c] = (unsigned char)palette[(indices >> (i * 2)) & 3][c];
+	}
+
+	// the 4x4 texels of a block, the ones outside of the level repeat its last row and column
+	void fetch_block(const Level& level, int bx, int by, unsigned char texels[16][4])
+	{
+		for (int y = 0; y < 4; y++)
+		{
+			int ty = std::min(by * 4 + y, level.height - 1);
+			for (int x = 0; x < 4; x++)
+			{
+				int tx = std::min(bx * 4 + x, level.width - 1);
+				memcpy(texels[y * 4 + x], &level.texels[((size_t)ty * level.width + tx) * 4], 4);
+			}
+		}
+	}
+
+	void encode_block(TextureCompressor::Format format, const unsigned char texels[16][4], unsigned char* block)
+	{
+		switch (format)
+		{
+			case TextureCompressor::BC1:
+				encode_color_block(texels, block);
+				break;
+			case TextureCompressor::BC3:
+				encode_channel_block(texels, 3, block);
+				encode_color_block(texels, block + 8);
+				break;
+			case TextureCompressor::BC5:
+				encode_channel_block(texels, 0, block);
+				encode_channel_block(texels, 1, block + 8);
+				break;
+		}
+	}
+
+	void decode_block(TextureCompressor::Format format, const unsigned char* block, unsigned char texels[16][4])
+	{
+		switch (format)
+		{
+			case TextureCompressor::BC1:
+				decode_color_block(block, texels);
+				break;
+			case TextureCompressor::BC3:
+				decode_channel_block(block, 3, texels);
+				decode_color_block(block + 8, texels);
+				break;
+			case TextureCompressor::BC5:
+				decode_channel_block(block, 0, texels);
+				decode_channel_block(block + 8, 1, texels);
+				break;
+		}
+	}
+
+	void encode_level(TextureCompressor::Format format, const Level& level, unsigned char* blocks)
+	{
+		const int blocks_x = (level.width + 3) / 4, blocks_y = (level.height + 3) / 4;
+		const int bytes = block_bytes(format);
+		parallel_rows(blocks_y, [&](size_t begin, size_t end)
+		{
+			unsigned char texels[16][4];
+			for (int by = (int)begin; by < (int)end; by++)
+			{
+				for (int bx = 0; bx < blocks_x; bx++)
+				{
+					fetch_block(level, bx, by, texels);
+					encode_block(format, texels, blocks + ((size_t)by * blocks_x + bx) * bytes);
+				}
+			}
+		});
+	}
+
+	// PSNR of the decoded blocks against the level, over the channels the format keeps
+	float level_psnr(TextureCompressor::Format format, const Level& level, const unsigned char* blocks)
+	{
+		const int channels = (format == TextureCompressor::BC1) ? 3 : (format == TextureCompressor::BC3) ? 4 : 2;
+		const int blocks_x = (level.width + 3) / 4, blocks_y = (level.height + 3) / 4;
+		const int bytes = block_bytes(format);
+
+		double squared_error = 0.0;
+		unsigned char decoded[16][4];
+		for (int by = 0; by < blocks_y; by++)
+		{
+			for (int bx = 0; bx < blocks_x; bx++)
+			{
+				decode_block(format, blocks + ((size_t)by * blocks_x + bx) * bytes, decoded);
+				for (int y = 0; y < 4 && by * 4 + y < level.height; y++)
+				{
+					for (int x = 0; x < 4 && bx * 4 + x < level.width; x++)
+					{
+						const unsigned char* texel = &level.texels[((size_t)(by * 4 + y) * level.width + bx * 4 + x) * 4];
+						for (int c = 0; c < channels; c++)
+						{
+							double d = (double)texel[c] - decoded[y * 4 + x][c];
+							squared_error += d * d;
+						}
+					}
+				}
+			}
+		}
+
+		double mse = squared_error / ((double)level.width * level.height * channels);
+		return (mse > 0.0) ? (float)(10.0 * std::log10(255.0 * 255.0 / mse)) : 99.f;
+	}
+
+	// .dds cache
+	// a plain DDS with the FourCC of the format and a full mip chain. The blocks are stored
+	// bottom row first, the way they are uploaded, so other viewers show the image upside down.
+	// The reserved words record the size and write time of the source image and the PSNR.
+	const uint32_t dds_magic = 0x20534444; // "DDS "
+	const uint32_t cache_tag = 0x58544744; // "DGTX"
+	const uint32_t cache_version = 1;
+
+	struct DDSPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t masks[4];
+	};
+
+	struct DDSHeader
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t linearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DDSPixelFormat format;
+		uint32_t caps[4];
+		uint32_t reserved2;
+	};
+
+	uint32_t four_cc(TextureCompressor::Format format)
+	{
+		const char* code = (format == TextureCompressor::BC1) ? "DXT1" : (format == TextureCompressor::BC3) ? "DXT5" : "ATI2";
+		return (uint32_t)code[0] | ((uint32_t)code[1] << 8) | ((uint32_t)code[2] << 16) | ((uint32_t)code[3] << 24);
+	}
+
+	int level_count(int width, int height)
+	{
+		int levels = 1;
+		while (width > 1 || height > 1)
+		{
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			levels++;
+		}
+		return levels;
+	}
+
+	size_t chain_size(TextureCompressor::Format format, int width, int height, int levels)
+	{
+		size_t size = 0;
+		for (int level = 0; level < levels; level++)
+		{
+			size += TextureCompressor::LevelSize(format, width, height);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		return size;
+	}
+}
+
+namespace TextureCompressor
+{
+	Format ChooseFormat(const char* filename, const unsigned char* pixels, int width, int height, int pitch, int channels)
+	{
+		std::string name = Tools::tolowerCase(filename);
+		size_t extension = name.find_last_of('.');
+		if (extension != std::string::npos && extension >= 2 && name.compare(extension - 2, 2, "_n") == 0)
+			return BC5;
+
+		if (channels == 4)
+		{
+			for (int y = 0; y < height; y++)
+			{
+				const unsigned char* row = pixels + (size_t)y * pitch;
+				for (int x = 0; x < width; x++)
+				{
+					if (row[x * 4 + 3] != 255)
+						return BC3;
+				}
+			}
+		}
+		return BC1;
+	}
+
+	bool Compress(const unsigned char* pixels, int width, int height, int pitch, int channels, bool swapRB, Format format, CompressedTexture& texture)
+	{
+		if (pixels == nullptr || width <= 0 || height <= 0 || (channels != 3 && channels != 4))
+			return false;
+
+		std::vector<Level> levels(1);
+		levels[0].width = width;
+		levels[0].height = height;
+		levels[0].texels.resize((size_t)width * height * 4);
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char* row = pixels + (size_t)y * pitch;
+			unsigned char* out = &levels[0].texels[(size_t)y * width * 4];
+			for (int x = 0; x < width; x++, row += channels, out += 4)
+			{
+				out[0] = row[swapRB ? 2 : 0];
+				out[1] = row[1];
+				out[2] = row[swapRB ? 0 : 2];
+				out[3] = (channels == 4) ? row[3] : 255;
+			}
+		}
+
+		while (levels.back().width > 1 || levels.back().height > 1)
+		{
+			levels.emplace_back();
+			downsample(levels[levels.size() - 2], levels.back(), format == BC5);
+		}
+
+		texture.format = format;
+		texture.width = width;
+		texture.height = height;
+		texture.levels = (int)levels.size();
+		texture.blocks.resize(chain_size(format, width, height, texture.levels));
+
+		size_t offset = 0;
+		for (auto& level : levels)
+		{
+			encode_level(format, level, &texture.blocks[offset]);
+			offset += LevelSize(format, level.width, level.height);
+		}
+
+		texture.psnr = level_psnr(format, levels[0], texture.blocks.data());
+		return true;
+	}
+
+	size_t LevelSize(Format format, int width, int height)
+	{
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * block_bytes(format);
+	}
+
+	GLenum GLFormat(Format format)
+	{
+		switch (format)
+		{
+			case BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+			case BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			// GL 3.0 or ARB_texture_compression_rgtc, TextureManager keeps BC5 off without them
+			default: return GL_COMPRESSED_RG_RGTC2;
+		}
+	}
+
+	const char* FormatName(Format format)
+	{
+		switch (format)
+		{
+			case BC1: return "BC1";
+			case BC3: return "BC3";
+			default: return "BC5";
+		}
+	}
+
+	std::string CacheFilename(const char* filename)
+	{
+		std::string path(filename);
+		size_t extension = path.find_last_of('.');
+		if (extension != std::string::npos && path.find_first_of("/\\", extension) == std::string::npos)
+			path.erase(extension);
+		return path + ".dds";
+	}
+
+	bool LoadCache(const char* filename, CompressedTexture& texture)
+	{
+		VirtualFile file;
+		if (!VirtualFileSystem::GetInstance().Open(CacheFilename(filename).c_str(), file))
+			return false;
+
+		uint32_t magic = 0;
+		DDSHeader header;
+		if (file.Size() < sizeof(magic) + sizeof(header))
+			return false;
+		memcpy(&magic, file.Data(), sizeof(magic));
+		memcpy(&header, file.Data() + sizeof(magic), sizeof(header));
+		if (magic != dds_magic || header.size != sizeof(DDSHeader) || header.reserved1[0] != cache_tag || header.reserved1[1] != cache_version)
+			return false;
+
+		// the AssetCooker encodes the ones in archives from the images packed with them, they are not checked
+		if (!file.IsPacked())
+		{
+			Tools::FileInfo source;
+			uint64_t size = header.reserved1[2] | ((uint64_t)header.reserved1[3] << 32);
+			int64_t modified = (int64_t)(header.reserved1[4] | ((uint64_t)header.reserved1[5] << 32));
+			if (!Tools::GetFileInfo(filename, source) || source.size != size || source.modified != modified)
+				return false;
+		}
+
+		Format format;
+		if (header.format.fourCC == four_cc(BC1)) format = BC1;
+		else if (header.format.fourCC == four_cc(BC3)) format = BC3;
+		else if (header.format.fourCC == four_cc(BC5)) format = BC5;
+		else return false;
+
+		const int width = (int)header.width, height = (int)header.height, levels = (int)header.mipMapCount;
+		if (width <= 0 || height <= 0 || levels != level_count(width, height))
+			return false;
+		size_t size = chain_size(format, width, height, levels);
+		if (file.Size() != sizeof(magic) + sizeof(header) + size)
+			return false;
+
+		texture.format = format;
+		texture.width = width;
+		texture.height = height;
+		texture.levels = levels;
+		memcpy(&texture.psnr, &header.reserved1[6], sizeof(float));
+		const unsigned char* blocks = reinterpret_cast<const unsigned char*>(file.Data()) + sizeof(magic) + sizeof(header);
+		texture.blocks.assign(blocks, blocks + size);
+		return true;
+	}
+
+	void SerializeCache(const CompressedTexture& texture, const Tools::FileInfo* source, std::vector<char>& data)
+	{
+		DDSHeader header = {};
+		header.size = sizeof(DDSHeader);
+		header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip map count, linear size
+		header.height = (uint32_t)texture.height;
+		header.width = (uint32_t)texture.width;
+		header.linearSize = (uint32_t)LevelSize(texture.format, texture.width, texture.height);
+		header.mipMapCount = (uint32_t)texture.levels;
+		header.reserved1[0] = cache_tag;
+		header.reserved1[1] = cache_version;
+		if (source)
+		{
+			header.reserved1[2] = (uint32_t)source->size;
+			header.reserved1[3] = (uint32_t)(source->size >> 32);
+			header.reserved1[4] = (uint32_t)source->modified;
+			header.reserved1[5] = (uint32_t)((uint64_t)source->modified >> 32);
+		}
+		memcpy(&header.reserved1[6], &texture.psnr, sizeof(float));
+		header.format.size = sizeof(DDSPixelFormat);
+		header.format.flags = 0x4; // FourCC
+		header.format.fourCC = four_cc(texture.format);
+		header.caps[0] = 0x1000 | 0x8 | 0x400000; // texture, complex, mip map
+
+		data.resize(sizeof(dds_magic) + sizeof(header) + texture.blocks.size());
+		memcpy(data.data(), &dds_magic, sizeof(dds_magic));
+		memcpy(data.data() + sizeof(dds_magic), &header, sizeof(header));
+		if (!texture.blocks.empty())
+			memcpy(data.data() + sizeof(dds_magic) + sizeof(header), texture.blocks.data(), texture.blocks.size());
+	}
+
+	bool SaveCache(const char* filename, const CompressedTexture& texture)
+	{
+		// only describe a source that is on the disk
+		Tools::FileInfo source;
+		if (!Tools::GetFileInfo(filename, source))
+			return false;
+
+		std::vector<char> data;
+		SerializeCache(texture, &source, data);
+		std::string cache = CacheFilename(filename);
+		if (!Tools::WriteFileAtomic(cache.c_str(), data.data(), data.size()))
+		{
+			printf("TextureCompressor: could not write %s\n", cache.c_str());
+			return false;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,52 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include "GLEW\glew.h"
+#include "Tools.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU encoder of the block compressed texture formats and the .dds cache of its results
+// BC1 keeps the colour of opaque textures in 4 bits per texel, BC3 adds an interpolated
+// alpha block for the transparent ones and BC5 keeps the two channels of the tangent space
+// normal maps, the geometry pass rebuilds z from them. The last two take 8 bits per texel.
+namespace TextureCompressor
+{
+	enum Format { BC1 = 0, BC3, BC5 };
+
+	struct CompressedTexture
+	{
+		Format format;
+		int width;
+		int height;
+		// the blocks of every mip level down to 1x1, the largest level first
+		int levels;
+		std::vector<unsigned char> blocks;
+		// of the largest level against the source, over the channels the format keeps
+		float psnr;
+	};
+
+	// BC5 for the files that end with _N, BC3 when some texel is not opaque, BC1 otherwise
+	Format ChooseFormat(const char* filename, const unsigned char* pixels, int width, int height, int pitch, int channels);
+
+	// encode an image of 3 or 4 channels and its whole mip chain, the rows are pitch bytes apart
+	// swapRB for BGR(A) pixels. The block rows are encoded in parallel by the job system
+	bool Compress(const unsigned char* pixels, int width, int height, int pitch, int channels, bool swapRB, Format format, CompressedTexture& texture);
+
+	// bytes of the blocks of a width x height level
+	size_t LevelSize(Format format, int width, int height);
+	GLenum GLFormat(Format format);
+	const char* FormatName(Format format);
+
+	// the .dds next to an image file
+	std::string CacheFilename(const char* filename);
+	// the cached blocks of an image, as long as the image did not change since they were written
+	bool LoadCache(const char* filename, CompressedTexture& texture);
+	bool SaveCache(const char* filename, const CompressedTexture& texture);
+	// the .dds contents of the blocks, without the size and write time of the image when source is
+	// null (for archives)
+	void SerializeCache(const CompressedTexture& texture, const Tools::FileInfo* source, std::vector<char>& data);
+};
+
+#endif
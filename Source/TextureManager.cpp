@@ -1,8 +1,13 @@
 #include "TextureManager.h"
 #include <algorithm>
 #include "SDL2/SDL_image.h"
+#include "VirtualFileSystem.h"
+#include "JobSystem.h"
 #include <iostream>
 
+bool TextureManager::compressTextures = false;
+bool TextureManager::compressNormalMaps = true;
+
 // Texture
 TextureManager::TextureManager()
 {
@@ -35,81 +40,232 @@ int TextureManager::findTexture(const char* filename, bool hasMipmaps)
 	return -1;
 }
 
-GLuint TextureManager::RequestTexture(const char* filename, bool hasMipmaps)
+GLuint TextureManager::FindTexture(const char* filename, bool hasMipmaps)
 {
-	// first check if we can find it in the manager
 	int index = findTexture(filename, hasMipmaps);
+	return (index != -1) ? textures[index].textureID : 0;
+}
 
-	if (index != -1)
-		return textures[index].textureID;
+bool TextureManager::DecodeImage(const char* filename, Image& image)
+{
+	if (compressTextures)
+	{
+		image.compressed.reset(new TextureCompressor::CompressedTexture());
+		if (TextureCompressor::LoadCache(filename, *image.compressed) &&
+			(compressNormalMaps || image.compressed->format != TextureCompressor::BC5))
+		{
+			image.width = image.compressed->width;
+			image.height = image.compressed->height;
+			return true;
+		}
+		image.compressed.reset();
+	}
 
-	// load the texture
-	SDL_Surface* surf = IMG_Load(filename);
+	VirtualFile file;
+	SDL_Surface* surf = VirtualFileSystem::GetInstance().Open(filename, file) ?
+		IMG_Load_RW(SDL_RWFromConstMem(file.Data(), (int)file.Size()), 1) : nullptr;
+	file.Close();
 	if (surf == 0)
 	{
 		printf("Could not Load texture %s\n", filename);
 		printf("SDL load Error %s\n", SDL_GetError());
-		return 0; // error
+		return false; // error
 	}
-	
-	TextureContainer container;
-	container.filename = filename;
-	container.hasMipmaps = hasMipmaps;
-	GLenum texture_format;
-	GLenum internal_texture_format;
-	GLint nOfColors;
-	glGenTextures(1, &container.textureID);
-	glBindTexture(GL_TEXTURE_2D, container.textureID);
-	nOfColors = surf->format->BytesPerPixel;
+	image.surface.reset(surf);
+
+	image.width = surf->w;
+	image.height = surf->h;
 
-	switch (surf->format->BytesPerPixel)
+	const int bytes = surf->format->BytesPerPixel;
+	switch (bytes)
 	{
 		case 3: // no alpha channel
-			if (surf->format->Rmask == 0x000000ff) texture_format = GL_RGB;
-			else texture_format = GL_BGR;
-			nOfColors = GL_RGB;
+			if (surf->format->Rmask == 0x000000ff) image.format = GL_RGB;
+			else image.format = GL_BGR;
+			image.internalFormat = GL_RGB;
 			break;
 		case 4: // contains alpha channel
-			if (surf->format->Rmask == 0x000000ff)	 texture_format = GL_RGBA;
-			else texture_format = GL_BGRA;
-			nOfColors = GL_RGBA;
+			if (surf->format->Rmask == 0x000000ff)	 image.format = GL_RGBA;
+			else image.format = GL_BGRA;
+			image.internalFormat = GL_RGBA;
 			break;
 
 		default:
 			printf("Error in number of colors at %s\n", filename);
+			image.surface.reset();
+			return false;
 	}
 
-	unsigned char* data = new unsigned char[surf->w * surf->h * surf->format->BytesPerPixel];
-
-	// flip image
-	for (int y = 0; y < surf->h; y++)
+	// OpenGL reads the rows with the pitch of the surface, as a row length in pixels or
+	// as the alignment SDL pads the rows of 3 byte pixels to
+	const int row_bytes = surf->w * bytes;
+	if (surf->pitch % bytes == 0)
+	{
+		image.rowLength = surf->pitch / bytes;
+		image.alignment = 1;
+	}
+	else if (surf->pitch == ((row_bytes + 3) & ~3))
 	{
-		memcpy(
-			&data[(surf->h - y - 1) * surf->w * surf->format->BytesPerPixel],
-			&static_cast<unsigned char*>(surf->pixels)[y * surf->w * surf->format->BytesPerPixel],
-			surf->w * surf->format->BytesPerPixel * sizeof(unsigned char));
+		image.rowLength = 0;
+		image.alignment = 4;
+	}
+	else
+	{
+		printf("Unexpected row pitch at %s\n", filename);
+		image.surface.reset();
+		return false;
 	}
 
+	// flip image in place, swapping the rows from the outside in
 	SDL_LockSurface(surf);
-	glTexImage2D(GL_TEXTURE_2D, 0, nOfColors, surf->w, surf->h, 0, texture_format, GL_UNSIGNED_BYTE, data);
+	unsigned char* pixels = static_cast<unsigned char*>(surf->pixels);
+	for (int y = 0; y < surf->h / 2; y++)
+	{
+		unsigned char* top = pixels + (size_t)y * surf->pitch;
+		unsigned char* bottom = pixels + (size_t)(surf->h - y - 1) * surf->pitch;
+		std::swap_ranges(top, top + row_bytes, bottom);
+	}
+
+	if (compressTextures)
+	{
+		TextureCompressor::Format format = TextureCompressor::ChooseFormat(filename, pixels, surf->w, surf->h, surf->pitch, bytes);
+		image.compressed.reset(new TextureCompressor::CompressedTexture());
+		if (format == TextureCompressor::BC5 && !compressNormalMaps)
+		{
+			// the geometry pass only reads the two channels of the normal maps
+			image.internalFormat = GL_RG8;
+			image.compressed.reset();
+		}
+		else if (TextureCompressor::Compress(pixels, surf->w, surf->h, surf->pitch, bytes, image.format == GL_BGR || image.format == GL_BGRA, format, *image.compressed))
+		{
+			printf("Compressed %s to %s, PSNR %.2f dB\n", filename, TextureCompressor::FormatName(format), image.compressed->psnr);
+			TextureCompressor::SaveCache(filename, *image.compressed);
+		}
+		else
+		{
+			image.compressed.reset();
+		}
+	}
 	SDL_UnlockSurface(surf);
-	delete[] data;
+
+	// the blocks replace the pixels
+	if (image.compressed)
+		image.surface.reset();
+	return true;
+}
+
+GLuint TextureManager::RequestTexture(const char* filename, bool hasMipmaps, const Image* image)
+{
+	// first check if we can find it in the manager
+	int index = findTexture(filename, hasMipmaps);
+
+	if (index != -1)
+		return textures[index].textureID;
+
+	// load the texture
+	Image decoded;
+	if (image == nullptr)
+	{
+		if (!DecodeImage(filename, decoded))
+			return 0; // error
+		image = &decoded;
+	}
+
+	TextureContainer container;
+	container.filename = filename;
+	container.hasMipmaps = hasMipmaps;
+	glGenTextures(1, &container.textureID);
+	glBindTexture(GL_TEXTURE_2D, container.textureID);
+
+	if (image->compressed)
+	{
+		// every mip level comes from the encoder
+		const TextureCompressor::CompressedTexture& compressed = *image->compressed;
+		const GLenum format = TextureCompressor::GLFormat(compressed.format);
+		int width = compressed.width, height = compressed.height;
+		size_t offset = 0;
+		for (int level = 0; level < compressed.levels; level++)
+		{
+			const size_t size = TextureCompressor::LevelSize(compressed.format, width, height);
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, (GLsizei)size, &compressed.blocks[offset]);
+			offset += size;
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, compressed.levels - 1);
+	}
+	else
+	{
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, image->rowLength);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, image->alignment);
+		glTexImage2D(GL_TEXTURE_2D, 0, image->internalFormat, image->width, image->height, 0, image->format, GL_UNSIGNED_BYTE, image->Pixels());
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
 
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-	if (hasMipmaps)
+	if (image->compressed)
+	{
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	}
+	else if (hasMipmaps)
 	{
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glGenerateMipmap(GL_TEXTURE_2D);
 	}
 
-	if (surf) SDL_FreeSurface(surf);
 	glBindTexture(GL_TEXTURE_2D, 0); // unbind the texture
 
 	// save the texture
 	textures.push_back(container);
 	return container.textureID;
-}
\ No newline at end of file
+}
+
+void TextureManager::RequestTextures(const std::vector<std::string>& filenames, std::vector<GLuint>& ids, bool hasMipmaps)
+{
+	ids.assign(filenames.size(), 0);
+
+	// every file that is not uploaded yet is decoded once, even if it is listed again
+	std::vector<size_t> missing;
+	for (size_t i = 0; i < filenames.size(); i++)
+	{
+		ids[i] = this->FindTexture(filenames[i].c_str(), hasMipmaps);
+		if (ids[i] != 0)
+			continue;
+
+		bool listed = false;
+		for (size_t j : missing)
+			listed = listed || filenames[j] == filenames[i];
+		if (!listed)
+			missing.push_back(i);
+	}
+
+	std::vector<Image> images(missing.size());
+	std::vector<char> decoded(missing.size(), 0);
+	JobCounter counter;
+	JobSystem& jobs = JobSystem::GetInstance();
+	jobs.ParallelFor(counter, missing.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			decoded[i] = DecodeImage(filenames[missing[i]].c_str(), images[i]) ? 1 : 0;
+	});
+	jobs.Wait(counter);
+
+	// the uploads stay on the calling thread, it owns the context
+	for (size_t i = 0; i < missing.size(); i++)
+	{
+		if (decoded[i])
+			this->RequestTexture(filenames[missing[i]].c_str(), hasMipmaps, &images[i]);
+		images[i].surface.reset();
+	}
+
+	for (size_t i = 0; i < filenames.size(); i++)
+	{
+		if (ids[i] == 0)
+			ids[i] = this->FindTexture(filenames[i].c_str(), hasMipmaps);
+	}
+}
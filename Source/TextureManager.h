@@ -3,12 +3,39 @@
 
 #include "SDL2/SDL.h"
 #include "GLEW\glew.h"
+#include "TextureCompressor.h"
 #include <string>
 #include <vector>
+#include <memory>
 
 // Singleton Class of Texture Manager
 class TextureManager
 {
+public:
+	struct SurfaceDeleter
+	{
+		void operator()(SDL_Surface* surface) const { SDL_FreeSurface(surface); }
+	};
+
+	// decoded pixels of an image file, bottom row first as OpenGL expects them
+	// the pixels stay in the SDL surface they were decoded to, flipped in place, and are
+	// uploaded straight from it with the row length of the surface
+	struct Image
+	{
+		int width;
+		int height;
+		GLenum format;
+		GLint internalFormat;
+		// GL_UNPACK_ROW_LENGTH and GL_UNPACK_ALIGNMENT of the rows
+		GLint rowLength;
+		GLint alignment;
+		std::unique_ptr<SDL_Surface, SurfaceDeleter> surface;
+		// the blocks and mip levels instead of the surface when textures are compressed
+		std::unique_ptr<TextureCompressor::CompressedTexture> compressed;
+
+		const void* Pixels() const { return surface ? surface->pixels : nullptr; }
+	};
+
 protected:
 	struct TextureContainer
 	{
@@ -18,6 +45,10 @@ protected:
 	};
 	std::vector<TextureContainer> textures;
 
+	// set before the textures are loaded, read by the decoding jobs
+	static bool compressTextures;
+	static bool compressNormalMaps;
+
 	// find the texture with the fiven filename and mipmaps
 	int findTexture(const char* filename, bool hasMipmaps);
 	GLenum internalFormat(uint8_t bitsPerPixel);
@@ -35,7 +66,25 @@ public:
 	void Clear();
 
 	// Request a texture handle
-	GLuint RequestTexture(const char* filename, bool hasMipmaps = false);
+	// with an image the file was already decoded (e.g. by a job) and it is only uploaded
+	GLuint RequestTexture(const char* filename, bool hasMipmaps = false, const Image* image = nullptr);
+	// Request the texture handles of many files, the ones that are not uploaded yet are
+	// decoded in parallel by the job system and then uploaded on the calling thread
+	// ids gets one handle per filename, 0 for the files that could not be loaded
+	void RequestTextures(const std::vector<std::string>& filenames, std::vector<GLuint>& ids, bool hasMipmaps = false);
+	// the texture handle if it is already uploaded, otherwise 0
+	GLuint FindTexture(const char* filename, bool hasMipmaps = false);
+
+	// decode an image file without touching OpenGL, it can be called from any thread
+	// with compression the image is encoded into blocks with mipmaps, or read from its .dds cache
+	static bool DecodeImage(const char* filename, Image& image);
+
+	// upload the textures block compressed (BC1, BC3 and BC5 for the normal maps), the
+	// context has to support S3TC. The .dds cache of each texture is written on the first load
+	static void SetCompression(bool enabled) { compressTextures = enabled; }
+	// BC5 needs RGTC, without it the normal maps are uploaded as uncompressed RG
+	static void SetNormalMapCompression(bool enabled) { compressNormalMaps = enabled; }
+	static bool IsCompressing() { return compressTextures; }
 
 protected:
 	TextureManager();	
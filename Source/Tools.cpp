@@ -2,6 +2,19 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace Tools
 {
@@ -63,6 +76,33 @@ namespace Tools
 		return error;
 	}
 
+	GLuint GrowBuffer(GLuint buffer, size_t used_bytes, size_t new_bytes, GLenum usage)
+	{
+		// the errors of earlier calls would be taken for the one of the allocation
+		for (int i = 0; i < 8 && glGetError() != GL_NO_ERROR; i++);
+
+		GLuint grown = 0;
+		glGenBuffers(1, &grown);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+		glBufferData(GL_COPY_WRITE_BUFFER, new_bytes, nullptr, usage);
+		if (grown == 0 || glGetError() == GL_OUT_OF_MEMORY)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			glDeleteBuffers(1, &grown);
+			return 0;
+		}
+
+		if (used_bytes > 0)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used_bytes);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+		return grown;
+	}
+
 	GLenum CheckFramebufferStatus(GLuint framebuffer_object)
 	{
 		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
@@ -95,4 +135,205 @@ namespace Tools
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 		return status;
 	}
+
+	uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		uint64_t hash = seed;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	bool GetFileInfo(const char* filename, FileInfo& info)
+	{
+#ifdef _WIN32
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &data) || (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			return false;
+		info.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+		info.modified = (int64_t)(((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+#else
+		struct stat data;
+		if (stat(filename, &data) != 0 || S_ISDIR(data.st_mode))
+			return false;
+		info.size = (uint64_t)data.st_size;
+		info.modified = (int64_t)data.st_mtim.tv_sec * 1000000000 + data.st_mtim.tv_nsec;
+#endif
+		return true;
+	}
+
+	bool WriteFileAtomic(const char* filename, const void* data, size_t size)
+	{
+		std::string temporary = std::string(filename) + ".tmp";
+		{
+			std::ofstream out(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!out)
+				return false;
+			out.write(static_cast<const char*>(data), size);
+			if (!out)
+			{
+				out.close();
+				std::remove(temporary.c_str());
+				return false;
+			}
+		}
+#ifdef _WIN32
+		bool renamed = MoveFileExA(temporary.c_str(), filename, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		bool renamed = std::rename(temporary.c_str(), filename) == 0;
+#endif
+		if (!renamed)
+			std::remove(temporary.c_str());
+		return renamed;
+	}
+
+	std::vector<std::string> ListFiles(const char* folder, const char* extension, bool recursive)
+	{
+		std::vector<std::string> files;
+		std::string path(folder);
+		if (!path.empty() && path.back() != '/' && path.back() != '\\')
+			path += '/';
+		std::string ext = tolowerCase(extension);
+
+		auto matches = [&ext](const std::string& name)
+		{
+			return name.size() > ext.size() &&
+				tolowerCase(name.substr(name.size() - ext.size())) == ext;
+		};
+
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE handle = FindFirstFileA((path + "*").c_str(), &data);
+		if (handle == INVALID_HANDLE_VALUE)
+			return files;
+		do
+		{
+			bool directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+			if (!directory && matches(data.cFileName))
+				files.push_back(path + data.cFileName);
+			else if (directory && recursive && strcmp(data.cFileName, ".") != 0 && strcmp(data.cFileName, "..") != 0)
+			{
+				std::vector<std::string> children = ListFiles((path + data.cFileName).c_str(), extension, true);
+				files.insert(files.end(), children.begin(), children.end());
+			}
+		} while (FindNextFileA(handle, &data));
+		FindClose(handle);
+#else
+		DIR* dir = opendir(path.c_str());
+		if (dir == nullptr)
+			return files;
+		while (dirent* entry = readdir(dir))
+		{
+			bool directory = entry->d_type == DT_DIR;
+			if (!directory && matches(entry->d_name))
+				files.push_back(path + entry->d_name);
+			else if (directory && recursive && strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+			{
+				std::vector<std::string> children = ListFiles((path + entry->d_name).c_str(), extension, true);
+				files.insert(files.end(), children.begin(), children.end());
+			}
+		}
+		closedir(dir);
+#endif
+		// directory order is not defined, keep the result stable
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	MappedFile::MappedFile()
+	{
+		m_data = nullptr;
+		m_size = 0;
+#ifdef _WIN32
+		m_file = INVALID_HANDLE_VALUE;
+		m_mapping = nullptr;
+#endif
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(const char* filename)
+	{
+		Close();
+#ifdef _WIN32
+		m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (m_file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size))
+		{
+			Close();
+			return false;
+		}
+		m_size = (size_t)size.QuadPart;
+
+		// empty files cannot be mapped
+		if (m_size == 0)
+		{
+			m_data = "";
+			return true;
+		}
+
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_mapping == nullptr)
+		{
+			Close();
+			return false;
+		}
+		m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+		int fd = open(filename, O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(fd, &info) != 0)
+		{
+			close(fd);
+			return false;
+		}
+		m_size = (size_t)info.st_size;
+
+		if (m_size == 0)
+		{
+			close(fd);
+			m_data = "";
+			return true;
+		}
+
+		void* view = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		m_data = (view == MAP_FAILED) ? nullptr : static_cast<const char*>(view);
+		if (m_data) madvise(view, m_size, MADV_SEQUENTIAL);
+#endif
+		if (m_data == nullptr)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef _WIN32
+		if (m_data && m_size > 0) UnmapViewOfFile(m_data);
+		if (m_mapping) CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+		m_mapping = nullptr;
+		m_file = INVALID_HANDLE_VALUE;
+#else
+		if (m_data && m_size > 0) munmap(const_cast<char*>(m_data), m_size);
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
 };
\ No newline at end of file
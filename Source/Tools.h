@@ -1,4 +1,6 @@
 #include <string>
+#include <vector>
+#include <cstdint>
 #include "GLEW\glew.h"
 
 #ifndef TOOLS_H
@@ -17,6 +19,54 @@ namespace Tools
 	GLenum CheckGLError();
 
 	GLenum CheckFramebufferStatus(GLuint framebuffer_object);
+
+	// a new buffer of new_bytes with the first used_bytes of buffer copied over, buffer is deleted;
+	// 0 with buffer left as it was when the driver runs out of memory
+	GLuint GrowBuffer(GLuint buffer, size_t used_bytes, size_t new_bytes, GLenum usage);
+
+	// 64 bit FNV-1a of a block of memory, pass the previous hash as seed to continue it
+	uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+	struct FileInfo
+	{
+		uint64_t size;
+		// last write time in platform ticks, only meant to be compared for equality
+		int64_t modified;
+	};
+
+	// size and last write time of a file, false if it does not exist
+	bool GetFileInfo(const char* filename, FileInfo& info);
+
+	// writes a temporary file and renames it over filename, readers never see half a file
+	bool WriteFileAtomic(const char* filename, const void* data, size_t size);
+
+	// list the files of a folder (and of its sub folders when recursive) that end with the given extension
+	std::vector<std::string> ListFiles(const char* folder, const char* extension, bool recursive = false);
+
+	// read-only view of a whole file mapped into memory
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool Open(const char* filename);
+		void Close();
+
+		const char* Data() const { return m_data; }
+		size_t Size() const { return m_size; }
+
+	private:
+		const char* m_data;
+		size_t m_size;
+#ifdef _WIN32
+		void* m_file;
+		void* m_mapping;
+#endif
+
+		MappedFile(const MappedFile&);
+		void operator=(const MappedFile&);
+	};
 };
 
 #endif
\ No newline at end of file
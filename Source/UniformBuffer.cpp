@@ -0,0 +1,185 @@
+#include "UniformBuffer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+UniformBuffer::UniformBuffer()
+{
+	m_buffer = 0;
+	m_persistent = false;
+	m_mapped = nullptr;
+	m_frames = 0;
+	m_frame = 0;
+	m_region_size = 0;
+	m_alignment = 256;
+	m_region = nullptr;
+	m_cursor = 0;
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	destroy();
+}
+
+bool UniformBuffer::Init(int frames)
+{
+	destroy();
+
+	m_frames = std::max(1, frames);
+	m_frame = 0;
+	m_fences.assign(m_frames, nullptr);
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m_alignment);
+	m_alignment = std::max(m_alignment, 16);
+	m_persistent = GLEW_ARB_buffer_storage != 0;
+
+	return create(64 * 1024);
+}
+
+bool UniformBuffer::create(GLsizeiptr region_size)
+{
+	m_region_size = Aligned(region_size);
+	const GLsizeiptr size = m_region_size * m_frames;
+
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+	if (m_persistent)
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+		m_mapped = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+		if (m_mapped == nullptr)
+		{
+			printf("UniformBuffer: could not map the buffer persistently\n");
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			glDeleteBuffers(1, &m_buffer);
+			m_buffer = 0;
+			m_persistent = false;
+			return create(region_size);
+		}
+	}
+	else
+	{
+		glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return true;
+}
+
+void UniformBuffer::destroy()
+{
+	for (int frame = 0; frame < (int)m_fences.size(); frame++)
+		wait(frame);
+
+	if (m_buffer != 0)
+	{
+		if (m_mapped != nullptr)
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &m_buffer);
+	}
+	m_buffer = 0;
+	m_mapped = nullptr;
+	m_region = nullptr;
+}
+
+void UniformBuffer::wait(int frame)
+{
+	GLsync& fence = m_fences[frame];
+	if (fence == nullptr)
+		return;
+
+	// the GPU is usually frames ahead of this, so the first check rarely has to wait
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	while (result == GL_TIMEOUT_EXPIRED)
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+bool UniformBuffer::Begin(GLsizeiptr size)
+{
+	if (m_frames == 0)
+		return false;
+
+	m_frame = (m_frame + 1) % m_frames;
+
+	// a frame that does not fit grows every region, the old buffer has to be idle first
+	if (size > m_region_size)
+	{
+		int frames = m_frames;
+		destroy();
+		m_frames = frames;
+		m_fences.assign(m_frames, nullptr);
+		if (!create(std::max(size, m_region_size * 2)))
+			return false;
+	}
+
+	wait(m_frame);
+
+	const GLintptr offset = m_region_size * m_frame;
+	if (m_persistent)
+	{
+		m_region = m_mapped + offset;
+	}
+	else
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+		m_region = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, offset, m_region_size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	m_cursor = 0;
+	return m_region != nullptr;
+}
+
+void* UniformBuffer::Allocate(GLsizeiptr size, GLintptr& offset)
+{
+	offset = 0;
+	if (m_region == nullptr || m_cursor + size > m_region_size)
+	{
+		printf("UniformBuffer: the blocks of the frame do not fit\n");
+		return nullptr;
+	}
+
+	void* data = m_region + m_cursor;
+	offset = m_region_size * m_frame + m_cursor;
+	m_cursor += Aligned(size);
+	return data;
+}
+
+GLintptr UniformBuffer::Write(const void* data, GLsizeiptr size)
+{
+	GLintptr offset;
+	void* block = Allocate(size, offset);
+	if (block != nullptr)
+		memcpy(block, data, size);
+	return offset;
+}
+
+void UniformBuffer::End()
+{
+	if (!m_persistent && m_region != nullptr)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	m_region = nullptr;
+}
+
+void UniformBuffer::Fence()
+{
+	if (m_frames == 0)
+		return;
+	if (m_fences[m_frame] != nullptr)
+		glDeleteSync(m_fences[m_frame]);
+	m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void UniformBuffer::BindRange(GLuint binding, GLintptr offset, GLsizeiptr size)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_buffer, offset, size);
+}
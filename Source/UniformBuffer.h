@@ -0,0 +1,58 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include "GLEW\glew.h"
+#include <vector>
+
+// Ring of uniform buffer regions, one per frame in flight
+// every frame writes its blocks into the next region and binds ranges of it, a fence
+// keeps the CPU from writing into a region the GPU still reads. With ARB_buffer_storage
+// the buffer stays mapped (persistent and coherent), otherwise the region is mapped
+// unsynchronized between Begin and End, so write every block of a frame before drawing
+class UniformBuffer
+{
+	GLuint m_buffer;
+	bool m_persistent;
+	unsigned char* m_mapped;
+
+	int m_frames;
+	int m_frame;
+	GLsizeiptr m_region_size;
+	GLint m_alignment;
+
+	// the region of the current frame while it is written
+	unsigned char* m_region;
+	GLsizeiptr m_cursor;
+
+	std::vector<GLsync> m_fences;
+
+	bool create(GLsizeiptr region_size);
+	void destroy();
+	void wait(int frame);
+
+public:
+	UniformBuffer();
+	~UniformBuffer();
+
+	bool Init(int frames = 3);
+
+	// start writing the blocks of a frame, at most size bytes with the alignment of every block
+	bool Begin(GLsizeiptr size);
+	// room for a block in the region to fill in place, nullptr if it does not fit
+	void* Allocate(GLsizeiptr size, GLintptr& offset);
+	// copy a block into the region, returns its offset in the buffer for BindRange
+	GLintptr Write(const void* data, GLsizeiptr size);
+	template<typename T> GLintptr Write(const T& block) { return Write(&block, sizeof(T)); }
+	// the blocks are written, they can be bound
+	void End();
+	// after the last draw of the frame that reads the region
+	void Fence();
+
+	void BindRange(GLuint binding, GLintptr offset, GLsizeiptr size);
+
+	// size of a block rounded up to the offset alignment of the uniform buffers
+	GLsizeiptr Aligned(GLsizeiptr size) const { return (size + m_alignment - 1) / m_alignment * m_alignment; }
+	bool IsPersistent() const { return m_persistent; }
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "VirtualFileSystem.h"
+#include "LZ4.h"
+#include <cstring>
+
+VirtualFile::VirtualFile()
+{
+	m_data = nullptr;
+	m_size = 0;
+	m_packed = false;
+}
+
+void VirtualFile::Close()
+{
+	m_mapped.Close();
+	std::vector<char>().swap(m_buffer);
+	m_data = nullptr;
+	m_size = 0;
+	m_packed = false;
+}
+
+VirtualFileSystem::VirtualFileSystem()
+{
+
+}
+
+VirtualFileSystem::~VirtualFileSystem()
+{
+	this->Clear();
+}
+
+void VirtualFileSystem::Clear()
+{
+	archives.clear();
+}
+
+bool VirtualFileSystem::Mount(const char* filename)
+{
+	Archive archive;
+	archive.filename = filename;
+	archive.file.reset(new Tools::MappedFile());
+	if (!archive.file->Open(filename))
+		return false;
+
+	const char* data = archive.file->Data();
+	const uint64_t size = archive.file->Size();
+
+	PackFile::Header header;
+	if (size < sizeof(header))
+	{
+		printf("VirtualFileSystem: %s is not an archive\n", filename);
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, PackFile::Magic, sizeof(PackFile::Magic)) != 0 || header.version != PackFile::Version ||
+		header.toc_offset % PackFile::Alignment != 0 || header.toc_offset > size ||
+		(size - header.toc_offset) / sizeof(PackFile::Entry) < header.entry_count ||
+		header.names_offset > size || size - header.names_offset < header.names_size)
+	{
+		printf("VirtualFileSystem: %s is not a version %u archive or it is damaged\n", filename, PackFile::Version);
+		return false;
+	}
+
+	archive.entries = reinterpret_cast<const PackFile::Entry*>(data + header.toc_offset);
+	archive.names = data + header.names_offset;
+	archive.count = header.entry_count;
+
+	for (uint32_t i = 0; i < archive.count; i++)
+	{
+		const PackFile::Entry& entry = archive.entries[i];
+		if (entry.offset > size || size - entry.offset < entry.stored_size ||
+			entry.name_offset > header.names_size || header.names_size - entry.name_offset < entry.name_length)
+		{
+			printf("VirtualFileSystem: %s is damaged\n", filename);
+			return false;
+		}
+	}
+
+	printf("Mounted %s with %u files\n", filename, archive.count);
+	archives.push_back(std::move(archive));
+	return true;
+}
+
+const PackFile::Entry* VirtualFileSystem::findEntry(const Archive& archive, const std::string& name) const
+{
+	uint32_t first = 0, last = archive.count;
+	while (first < last)
+	{
+		uint32_t middle = first + (last - first) / 2;
+		const PackFile::Entry& entry = archive.entries[middle];
+		int order = name.compare(0, std::string::npos, archive.names + entry.name_offset, entry.name_length);
+		if (order == 0)
+			return &entry;
+		if (order < 0) last = middle;
+		else first = middle + 1;
+	}
+	return nullptr;
+}
+
+bool VirtualFileSystem::Open(const char* filename, VirtualFile& file) const
+{
+	file.Close();
+
+	if (!archives.empty())
+	{
+		std::string name = PackFile::NormalizeName(filename);
+		for (auto archive = archives.rbegin(); archive != archives.rend(); ++archive)
+		{
+			const PackFile::Entry* entry = findEntry(*archive, name);
+			if (entry == nullptr)
+				continue;
+
+			const char* stored = archive->file->Data() + entry->offset;
+			if (entry->flags & PackFile::COMPRESSED_LZ4)
+			{
+				file.m_buffer.resize((size_t)entry->size);
+				if (!LZ4::Decompress(stored, (size_t)entry->stored_size, file.m_buffer.data(), file.m_buffer.size()))
+				{
+					printf("VirtualFileSystem: %s is damaged in %s\n", filename, archive->filename.c_str());
+					file.Close();
+					return false;
+				}
+				// empty files still need a valid pointer
+				file.m_data = file.m_buffer.empty() ? "" : file.m_buffer.data();
+			}
+			else
+			{
+				file.m_data = stored;
+			}
+			file.m_size = (size_t)entry->size;
+			file.m_packed = true;
+			return true;
+		}
+	}
+
+	if (!file.m_mapped.Open(filename))
+		return false;
+	file.m_data = file.m_mapped.Data();
+	file.m_size = file.m_mapped.Size();
+	return true;
+}
+
+bool VirtualFileSystem::Exists(const char* filename) const
+{
+	std::string name = PackFile::NormalizeName(filename);
+	for (auto& archive : archives)
+	{
+		if (findEntry(archive, name) != nullptr)
+			return true;
+	}
+	Tools::FileInfo info;
+	return Tools::GetFileInfo(filename, info);
+}
+
+void VirtualFileSystem::ListEntries(std::vector<std::string>& names) const
+{
+	for (auto& archive : archives)
+	{
+		for (uint32_t i = 0; i < archive.count; i++)
+			names.push_back(std::string(archive.names + archive.entries[i].name_offset, archive.entries[i].name_length));
+	}
+}
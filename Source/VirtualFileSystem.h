@@ -0,0 +1,84 @@
+#ifndef VIRTUAL_FILE_SYSTEM_H
+#define VIRTUAL_FILE_SYSTEM_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "PackFile.h"
+#include "Tools.h"
+
+// read-only contents of a file of the virtual file system
+class VirtualFile
+{
+public:
+	VirtualFile();
+
+	const char* Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+	bool IsOpen() const { return m_data != nullptr; }
+	// true when the file came from a mounted archive instead of the disk
+	bool IsPacked() const { return m_packed; }
+
+	void Close();
+
+private:
+	friend class VirtualFileSystem;
+
+	// loose files are mapped, stored entries point into the archive
+	// and compressed entries are decompressed into the buffer
+	Tools::MappedFile m_mapped;
+	std::vector<char> m_buffer;
+	const char* m_data;
+	size_t m_size;
+	bool m_packed;
+
+	VirtualFile(const VirtualFile&);
+	void operator=(const VirtualFile&);
+};
+
+// Singleton Class of the Virtual File System
+// files are looked up in the mounted archives first (the last mounted wins) and then on the disk
+// mount the archives before the loading starts, after that Open can be called from any thread
+class VirtualFileSystem
+{
+protected:
+	struct Archive
+	{
+		std::string filename;
+		std::unique_ptr<Tools::MappedFile> file;
+		const PackFile::Entry* entries;
+		const char* names;
+		uint32_t count;
+	};
+	std::vector<Archive> archives;
+
+	// binary search of the sorted table of contents
+	const PackFile::Entry* findEntry(const Archive& archive, const std::string& name) const;
+
+public:
+	// get the static instance of Virtual File System
+	static VirtualFileSystem& GetInstance()
+	{
+		static VirtualFileSystem vfs;
+		return vfs;
+	}
+	~VirtualFileSystem();
+
+	// map a .pak archive, false if it is missing or damaged
+	bool Mount(const char* filename);
+	// unmount all the archives
+	void Clear();
+
+	// open a file of an archive or of the disk
+	bool Open(const char* filename, VirtualFile& file) const;
+	bool Exists(const char* filename) const;
+
+	// the names of the entries of every mounted archive
+	void ListEntries(std::vector<std::string>& names) const;
+
+protected:
+	VirtualFileSystem();
+	void operator=(VirtualFileSystem const&);
+};
+
+#endif
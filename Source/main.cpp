@@ -3,10 +3,15 @@
 #include <chrono>
 #include "GLEW\glew.h"
 #include "Renderer.h"
+#include "Benchmarks.h"
+#include "VirtualFileSystem.h"
+#include "JobSystem.h"
+#include "TextureManager.h"
 #include <thread>         // std::this_thread::sleep_for
 #include <Windows.h>
 #include <mmsystem.h>
 #include <string>
+#include <cstring>
 #include <thread>
 #pragma comment(lib, "winmm.lib")
 
@@ -25,6 +30,9 @@ SDL_Event event;
 
 Renderer* renderer = nullptr;
 
+// --uncompressed-textures uploads the decoded pixels instead of the BC blocks
+bool compress_textures = true;
+
 void playSoundAsync(const std::string& filename)
 {
 	std::string command = "open \"" + filename + "\" type mpegvideo alias mp3";
@@ -92,6 +100,9 @@ bool init()
 	// some versions of glew may cause an opengl error in initialization
 	glGetError();
 
+	TextureManager::SetCompression(compress_textures && GLEW_EXT_texture_compression_s3tc);
+	TextureManager::SetNormalMapCompression(GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc);
+
 	renderer = new Renderer();
 	bool engine_initialized = renderer->Init(SCREEN_WIDTH, SCREEN_HEIGHT);
 
@@ -100,6 +111,24 @@ bool init()
 
 int main(int argc, char* argv[])
 {
+	// offline measurements, e.g. --bench obj Assets/Dungeon
+	if (Benchmarks::Run(argc - 1, argv + 1))
+	{
+		return EXIT_SUCCESS;
+	}
+
+	// --single-thread runs every job on the main thread in submission order, for debugging
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--single-thread") == 0)
+			JobSystem::GetInstance().Init(1);
+		else if (strcmp(argv[i], "--uncompressed-textures") == 0)
+			compress_textures = false;
+	}
+
+	// the archive of the AssetCooker is optional, without it the loose files are read
+	VirtualFileSystem::GetInstance().Mount("Assets/Assets.pak");
+
 	//Initialize SDL, glew, engine
 	if (init() == false)
 	{
@@ -107,6 +136,14 @@ int main(int argc, char* argv[])
 		return EXIT_FAILURE;
 	}
 
+	// the benchmarks that draw the scene run once the renderer is initialized
+	if (Benchmarks::NeedsRenderer(argc - 1, argv + 1))
+	{
+		Benchmarks::RunWithRenderer(argc - 1, argv + 1, *renderer, window);
+		clean_up();
+		return EXIT_SUCCESS;
+	}
+
 	//Quit flag
 	bool quit = false;
 	bool mouse_button_pressed = false;
@@ -148,6 +185,16 @@ int main(int argc, char* argv[])
 				{
 					renderer->CameraMoveRight(true);
 				}
+				else if (event.key.keysym.sym == SDLK_l)
+				{
+					// cycle the multi-pass, single pass and clustered deferred shading
+					renderer->SetLightingMode((Renderer::LightingMode)((renderer->GetLightingMode() + 1) % (Renderer::LIGHTING_CLUSTERED + 1)));
+				}
+				else if (event.key.keysym.sym == SDLK_g)
+				{
+					// switch between the RGBA32F and the compact G-buffer
+					renderer->SetGBufferLayout(renderer->GetGBufferLayout() == Renderer::GBUFFER_FULL ? Renderer::GBUFFER_COMPACT : Renderer::GBUFFER_FULL);
+				}
 				else if (event.key.keysym.sym == SDLK_r) {
 					renderer->HeroDoorCheck();
 				}